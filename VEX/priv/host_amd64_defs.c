@@ -750,6 +750,15 @@ AMD64Instr* AMD64Instr_Goto ( IRJumpKind jk, AMD64CondCode cond, AMD64RI* dst )
    i->Ain.Goto.jk   = jk;
    return i;
 }
+AMD64Instr* AMD64Instr_XDirect ( Addr64 dstGA, AMD64AMode* amRIP,
+                                 AMD64CondCode cond ) {
+   AMD64Instr* i        = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag               = Ain_XDirect;
+   i->Ain.XDirect.dstGA = dstGA;
+   i->Ain.XDirect.amRIP = amRIP;
+   i->Ain.XDirect.cond  = cond;
+   return i;
+}
 AMD64Instr* AMD64Instr_CMov64 ( AMD64CondCode cond, AMD64RM* src, HReg dst ) {
    AMD64Instr* i      = LibVEX_Alloc(sizeof(AMD64Instr));
    i->tag             = Ain_CMov64;
@@ -1161,6 +1170,20 @@ void ppAMD64Instr ( AMD64Instr* i, Bool mode64 )
             vex_printf(" }");
          }
          return;
+      case Ain_XDirect:
+         vex_printf("(xDirect) ");
+         if (i->Ain.XDirect.cond != Acc_ALWAYS) {
+            vex_printf("if (%%rflags.%s) { ", 
+                       showAMD64CondCode(i->Ain.XDirect.cond));
+         }
+         vex_printf("movabsq $0x%llx,%%rax ; ", i->Ain.XDirect.dstGA);
+         vex_printf("movq %%rax,");
+         ppAMD64AMode(i->Ain.XDirect.amRIP);
+         vex_printf(" ; decl 0(%%rsp) ; call *$chain_me or goto dispatcher");
+         if (i->Ain.XDirect.cond != Acc_ALWAYS) {
+            vex_printf(" }");
+         }
+         return;
       case Ain_CMov64:
          vex_printf("cmov%s ", showAMD64CondCode(i->Ain.CMov64.cond));
          ppAMD64RM(i->Ain.CMov64.src);
@@ -1544,6 +1567,12 @@ void getRegUsage_AMD64Instr ( HRegUsage* u, AMD64Instr* i, Bool mode64 )
                available to the allocator.  But still .. */
             addHRegUse(u, HRmWrite, hregAMD64_RBP());
          return;
+      case Ain_XDirect:
+         addRegUsage_AMD64AMode(u, i->Ain.XDirect.amRIP);
+         addHRegUse(u, HRmWrite, hregAMD64_RAX()); /* used for next guest addr */
+         addHRegUse(u, HRmWrite, hregAMD64_RDX()); /* used for dispatcher addr */
+         addHRegUse(u, HRmWrite, hregAMD64_R11()); /* used for chain-me addr */
+         return;
       case Ain_CMov64:
          addRegUsage_AMD64RM(u, i->Ain.CMov64.src, HRmRead);
          addHRegUse(u, HRmModify, i->Ain.CMov64.dst);
@@ -1778,6 +1807,9 @@ void mapRegs_AMD64Instr ( HRegRemap* m, AMD64Instr* i, Bool mode64 )
       case Ain_Goto:
          mapRegs_AMD64RI(m, i->Ain.Goto.dst);
          return;
+      case Ain_XDirect:
+         mapRegs_AMD64AMode(m, i->Ain.XDirect.amRIP);
+         return;
       case Ain_CMov64:
          mapRegs_AMD64RM(m, i->Ain.CMov64.src);
          mapReg(m, &i->Ain.CMov64.dst);
@@ -2346,7 +2378,8 @@ static UChar* do_ffree_st ( UChar* p, Int n )
 Int emit_AMD64Instr ( UChar* buf, Int nbuf, AMD64Instr* i, 
                       Bool mode64,
                       void* dispatch_unassisted,
-                      void* dispatch_assisted )
+                      void* dispatch_assisted,
+                      void* dispatch_chain_me )
 {
    UInt /*irno,*/ opc, opc_rr, subopc_imm, opc_imma, opc_cl, opc_imm, subopc;
    UInt   xtra;
@@ -2355,7 +2388,7 @@ Int emit_AMD64Instr ( UChar* buf, Int nbuf, AMD64Instr* i,
    UChar* p = &buf[0];
    UChar* ptmp;
    Int    j;
-   vassert(nbuf >= 32);
+   vassert(nbuf >= 48);
    vassert(mode64 == True);
 
    /* Wrap an integer as a int register, for use assembling
@@ -2938,6 +2971,105 @@ Int emit_AMD64Instr ( UChar* buf, Int nbuf, AMD64Instr* i,
       goto done;
    }
 
+   case Ain_XDirect: {
+      /* The dispatcher keeps its count of blocks still to run in the
+         32-bit word at 0(%rsp).  A chainable exit does the
+         dispatcher's job itself:
+
+            movabsq $dstGA, %rax
+            movq    %rax, amRIP
+            subl    $1, 0(%rsp)
+            jz      1f
+            movabsq $chain_me, %r11     <- patchable; see
+            call    *%r11               <- chainXDirect_AMD64
+         1: addl    $1, 0(%rsp)
+            movabsq $dispatch_unassisted, %rdx
+            jmp     *%rdx
+
+         so that, once chained, control only goes back to the
+         dispatcher when the count runs out.  The patched code may
+         also bump the destination's entry count, which the
+         dispatcher would otherwise have done; see
+         chainXDirect_AMD64.  Since a chained jump
+         also bypasses the dispatcher's store of %rax to the guest
+         RIP, the exit does that itself; otherwise a fault in the
+         destination's first insn would be reported at a stale RIP.
+         Without a chain-me stub, just the first and last two insns
+         are emitted, as for a boring Ain_Goto. */
+      vassert(dispatch_unassisted != NULL);
+
+      /* Use ptmp for backpatching conditional jumps. */
+      ptmp = NULL;
+
+      /* First off, if this is conditional, create a conditional
+         jump over the rest of it. */
+      if (i->Ain.XDirect.cond != Acc_ALWAYS) {
+         /* jmp fwds if !condition */
+         *p++ = toUChar(0x70 + (i->Ain.XDirect.cond ^ 1));
+         ptmp = p; /* fill in this bit later */
+         *p++ = 0; /* # of bytes to jump over; don't know how many yet. */
+      }
+
+      /* movabsq $dstGA, %rax */
+      *p++ = 0x48;
+      *p++ = 0xB8;
+      p = emit64(p, i->Ain.XDirect.dstGA);
+
+      if (dispatch_chain_me != NULL) {
+         /* movq %rax, amRIP */
+         *p++ = rexAMode_M(hregAMD64_RAX(), i->Ain.XDirect.amRIP);
+         *p++ = 0x89;
+         p = doAMode_M(p, hregAMD64_RAX(), i->Ain.XDirect.amRIP);
+         /* subl $1, 0(%rsp) */
+         *p++ = 0x83;
+         *p++ = 0x2C;
+         *p++ = 0x24;
+         *p++ = 0x01;
+         /* jz over the next two insns (13 bytes) */
+         *p++ = 0x74;
+         *p++ = 0x0D;
+         /* movabsq $chain_me, %r11 */
+         *p++ = 0x49;
+         *p++ = 0xBB;
+         p = emit64(p, Ptr_to_ULong(dispatch_chain_me));
+         /* call *%r11 */
+         *p++ = 0x41;
+         *p++ = 0xFF;
+         *p++ = 0xD3;
+         /* addl $1, 0(%rsp), so that the dispatcher's own decrement
+            is the one that reaches zero */
+         *p++ = 0x83;
+         *p++ = 0x04;
+         *p++ = 0x24;
+         *p++ = 0x01;
+      }
+
+      /* Get the dispatcher address into %rdx, and go there. */
+      if (fitsIn32Bits(Ptr_to_ULong(dispatch_unassisted))) {
+         /* movl sign-extend(imm32), %rdx */
+         *p++ = 0x48;
+         *p++ = 0xC7;
+         *p++ = 0xC2;
+         p = emit32(p, (UInt)Ptr_to_ULong(dispatch_unassisted));
+      } else {
+         /* movabsq $imm64, %rdx */
+         *p++ = 0x48;
+         *p++ = 0xBA;
+         p = emit64(p, Ptr_to_ULong(dispatch_unassisted));
+      }
+      /* jmp *%rdx */
+      *p++ = 0xFF;
+      *p++ = 0xE2;
+
+      /* Fix up the conditional jump, if there was one. */
+      if (i->Ain.XDirect.cond != Acc_ALWAYS) {
+         Int delta = p - ptmp;
+         vassert(delta > 0 && delta < 60);
+         *ptmp = toUChar(delta-1);
+      }
+      goto done;
+   }
+
    case Ain_CMov64:
       vassert(i->Ain.CMov64.cond != Acc_ALWAYS);
       if (i->Ain.CMov64.src->tag == Arm_Reg) {
@@ -3690,12 +3822,132 @@ Int emit_AMD64Instr ( UChar* buf, Int nbuf, AMD64Instr* i,
    /*NOTREACHED*/
    
   done:
-   vassert(p - &buf[0] <= 32);
+   vassert(p - &buf[0] <= 48);
    return p - &buf[0];
 
 #  undef fake
 }
 
+
+/* Read little-endian words from code which is being patched; the
+   reverse of emit32 and emit64. */
+static UInt read32 ( UChar* p )
+{
+   return ((UInt)p[0]) | ((UInt)p[1] << 8) 
+          | ((UInt)p[2] << 16) | ((UInt)p[3] << 24);
+}
+
+static ULong read64 ( UChar* p )
+{
+   return ((ULong)read32(p)) | (((ULong)read32(p+4)) << 32);
+}
+
+/* Is the 13 bytes at p an unchained XDirect, ie
+
+      movabsq $disp_cp_chain_me, %r11 ; call *%r11  ? */
+static Bool is_unchained_XDirect ( UChar* p, void* disp_cp_chain_me )
+{
+   return p[0] == 0x49 && p[1] == 0xBB
+          && read64(&p[2])
+             == Ptr_to_ULong(disp_cp_chain_me)
+          && p[10] == 0x41 && p[11] == 0xFF && p[12] == 0xD3;
+}
+
+VexInvalRange chainXDirect_AMD64 ( void* place_to_chain,
+                                   void* disp_cp_chain_me_EXPECTED,
+                                   void* place_to_jump_to,
+                                   UInt* place_to_count )
+{
+   VexInvalRange vir;
+   UChar* p     = (UChar*)place_to_chain;
+   Long   delta = (Long)((HWord)place_to_jump_to - ((HWord)p + 5));
+   Long   cdelta, jdelta;
+   Int    k;
+
+   vassert(is_unchained_XDirect(p, disp_cp_chain_me_EXPECTED));
+
+   /* The counting form, if the counter and the destination are both
+      in range of a rel32 from here:
+         incl disp32(%rip) ; jmp disp32 ; ud2
+      Clobbering the host flags is fine, as nothing is live across a
+      block exit. */
+   cdelta = (Long)((HWord)place_to_count   - ((HWord)p + 6));
+   jdelta = (Long)((HWord)place_to_jump_to - ((HWord)p + 11));
+   if (place_to_count != NULL
+       && cdelta == (Long)(Int)cdelta && jdelta == (Long)(Int)jdelta) {
+      p[0]  = 0xFF;
+      p[1]  = 0x05;
+      (void)emit32(&p[2], (UInt)(Int)cdelta);
+      p[6]  = 0xE9;
+      (void)emit32(&p[7], (UInt)(Int)jdelta);
+      p[11] = 0x0F;
+      p[12] = 0x0B;
+   } else
+   if (delta == (Long)(Int)delta) {
+      /* In range of a rel32 jump, which avoids the indirect jump:
+            jmp disp32 ; ud2 ; ud2 ; ud2 ; ud2
+         The ud2s are never reached; they just fill up the space. */
+      p[0] = 0xE9;
+      (void)emit32(&p[1], (UInt)(Int)delta);
+      for (k = 5; k < 13; k += 2) {
+         p[k]   = 0x0F;
+         p[k+1] = 0x0B;
+      }
+   } else {
+      /* movabsq $place_to_jump_to, %r11 ; jmp *%r11 */
+      (void)emit64(&p[2], Ptr_to_ULong(place_to_jump_to));
+      p[12] = 0xE3;
+   }
+
+   vir.start = (HWord)place_to_chain;
+   vir.len   = 13;
+   return vir;
+}
+
+VexInvalRange unchainXDirect_AMD64 ( void* place_to_unchain,
+                                     void* place_to_jump_to_EXPECTED,
+                                     void* disp_cp_chain_me )
+{
+   VexInvalRange vir;
+   UChar* p = (UChar*)place_to_unchain;
+   Bool   valid = False;
+   Int    k;
+
+   if (p[0] == 0xFF) {
+      /* incl disp32(%rip) ; jmp disp32 ; ud2 */
+      Long delta = (Long)(Int)read32(&p[7]);
+      valid = p[1] == 0x05 && p[6] == 0xE9
+              && (HWord)p + 11 + delta == (HWord)place_to_jump_to_EXPECTED
+              && p[11] == 0x0F && p[12] == 0x0B;
+   } else
+   if (p[0] == 0xE9) {
+      /* jmp disp32 ; ud2 ; ud2 ; ud2 ; ud2 */
+      Long delta = (Long)(Int)read32(&p[1]);
+      valid = (HWord)p + 5 + delta == (HWord)place_to_jump_to_EXPECTED;
+      for (k = 5; k < 13; k += 2)
+         valid = valid && p[k] == 0x0F && p[k+1] == 0x0B;
+   } else {
+      /* movabsq $place_to_jump_to_EXPECTED, %r11 ; jmp *%r11 */
+      valid = p[0] == 0x49 && p[1] == 0xBB
+              && read64(&p[2])
+                 == Ptr_to_ULong(place_to_jump_to_EXPECTED)
+              && p[10] == 0x41 && p[11] == 0xFF && p[12] == 0xE3;
+   }
+   vassert(valid);
+
+   /* movabsq $disp_cp_chain_me, %r11 ; call *%r11 */
+   p[0] = 0x49;
+   p[1] = 0xBB;
+   (void)emit64(&p[2], Ptr_to_ULong(disp_cp_chain_me));
+   p[10] = 0x41;
+   p[11] = 0xFF;
+   p[12] = 0xD3;
+
+   vir.start = (HWord)place_to_unchain;
+   vir.len   = 13;
+   return vir;
+}
+
 /*---------------------------------------------------------------*/
 /*--- end                                   host_amd64_defs.c ---*/
 /*---------------------------------------------------------------*/
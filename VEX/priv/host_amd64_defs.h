@@ -367,6 +367,7 @@ typedef
       Ain_Push,        /* push 64-bit value on stack */
       Ain_Call,        /* call to address in register */
       Ain_Goto,        /* conditional/unconditional jmp to dst */
+      Ain_XDirect,     /* chainable jmp to a constant guest address */
       Ain_CMov64,      /* conditional move */
       Ain_MovxLQ,      /* reg-reg move, zx-ing/sx-ing top half */
       Ain_LoadEX,      /* mov{s,z}{b,w,l}q from mem to reg */
@@ -494,6 +495,18 @@ typedef
             AMD64CondCode cond;
             AMD64RI*      dst;
          } Goto;
+         /* Pseudo-insn.  Boring goto a constant guest address, on
+            the given condition (which could be Acc_ALWAYS).  If the
+            code is made with a chain-me stub, this can later be
+            patched to jump straight to the destination's
+            translation; see chainXDirect_AMD64.  amRIP is where
+            the guest RIP lives, so that dstGA can be stored there
+            before a chained jump bypasses the dispatcher. */
+         struct {
+            Addr64        dstGA;
+            AMD64AMode*   amRIP;
+            AMD64CondCode cond;
+         } XDirect;
          /* Mov src to dst on the given condition, which may not
             be the bogus Acc_ALWAYS. */
          struct {
@@ -693,6 +706,8 @@ extern AMD64Instr* AMD64Instr_Div        ( Bool syned, Int sz, AMD64RM* );
 extern AMD64Instr* AMD64Instr_Push       ( AMD64RMI* );
 extern AMD64Instr* AMD64Instr_Call       ( AMD64CondCode, Addr64, Int );
 extern AMD64Instr* AMD64Instr_Goto       ( IRJumpKind, AMD64CondCode cond, AMD64RI* dst );
+extern AMD64Instr* AMD64Instr_XDirect    ( Addr64 dstGA, AMD64AMode* amRIP,
+                                           AMD64CondCode cond );
 extern AMD64Instr* AMD64Instr_CMov64     ( AMD64CondCode, AMD64RM* src, HReg dst );
 extern AMD64Instr* AMD64Instr_MovxLQ     ( Bool syned, HReg src, HReg dst );
 extern AMD64Instr* AMD64Instr_LoadEX     ( UChar szSmall, Bool syned,
@@ -745,7 +760,8 @@ extern Bool         isMove_AMD64Instr      ( AMD64Instr*, HReg*, HReg* );
 extern Int          emit_AMD64Instr        ( UChar* buf, Int nbuf, AMD64Instr*, 
                                              Bool,
                                              void* dispatch_unassisted,
-                                             void* dispatch_assisted );
+                                             void* dispatch_assisted,
+                                             void* dispatch_chain_me );
 
 extern void genSpill_AMD64  ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                               HReg rreg, Int offset, Bool );
@@ -757,6 +773,17 @@ extern HInstrArray* iselSB_AMD64           ( IRSB*, VexArch,
                                                     VexArchInfo*,
                                                     VexAbiInfo* );
 
+/* Patch/unpatch the chainable part of an Ain_XDirect.  These must
+   agree with the code emit_AMD64Instr generates for it. */
+extern VexInvalRange chainXDirect_AMD64 ( void* place_to_chain,
+                                          void* disp_cp_chain_me_EXPECTED,
+                                          void* place_to_jump_to,
+                                          UInt* place_to_count );
+
+extern VexInvalRange unchainXDirect_AMD64 ( void* place_to_unchain,
+                                            void* place_to_jump_to_EXPECTED,
+                                            void* disp_cp_chain_me );
+
 #endif /* ndef __VEX_HOST_AMD64_DEFS_H */
 
 /*---------------------------------------------------------------*/
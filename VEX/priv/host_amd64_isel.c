@@ -44,6 +44,7 @@
 #include "host_generic_simd64.h"
 #include "host_generic_simd128.h"
 #include "host_amd64_defs.h"
+#include "libvex_guest_offsets.h"
 
 
 /*---------------------------------------------------------*/
@@ -283,6 +284,15 @@ static Bool isZeroU32 ( IRExpr* e )
           && e->Iex.Const.con->Ico.U32 == 0;
 }
 
+/* The guest RIP's slot in the guest state, for Ain_XDirect.  Only
+   an amd64 guest's code is ever chained (see LibVEX_Translate), so
+   this is the only guest whose RIP XDirect need store. */
+
+static AMD64AMode* amRIP ( void )
+{
+   return AMD64AMode_IR(OFFSET_amd64_RIP, hregAMD64_RBP());
+}
+
 /* Make a int reg-reg move. */
 
 static AMD64Instr* mk_iMOVsd_RR ( HReg src, HReg dst )
@@ -4123,6 +4133,13 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
       AMD64CondCode cc;
       if (stmt->Ist.Exit.dst->tag != Ico_U64)
          vpanic("iselStmt(amd64): Ist_Exit: dst is not a 64-bit value");
+      if (stmt->Ist.Exit.jk == Ijk_Boring) {
+         /* A side exit to a known place: make it chainable. */
+         cc = iselCondCode(env,stmt->Ist.Exit.guard);
+         addInstr(env, AMD64Instr_XDirect(stmt->Ist.Exit.dst->Ico.U64,
+                                          amRIP(), cc));
+         return;
+      }
       dst = iselIntExpr_RI(env, IRExpr_Const(stmt->Ist.Exit.dst));
       cc  = iselCondCode(env,stmt->Ist.Exit.guard);
       addInstr(env, AMD64Instr_Goto(stmt->Ist.Exit.jk, cc, dst));
@@ -4151,6 +4168,14 @@ static void iselNext ( ISelEnv* env, IRExpr* next, IRJumpKind jk )
       ppIRExpr(next);
       vex_printf("\n");
    }
+   if (next->tag == Iex_Const
+       && (jk == Ijk_Boring || jk == Ijk_Call)) {
+      /* A direct jump or call: make it chainable. */
+      vassert(next->Iex.Const.con->tag == Ico_U64);
+      addInstr(env, AMD64Instr_XDirect(next->Iex.Const.con->Ico.U64,
+                                       amRIP(), Acc_ALWAYS));
+      return;
+   }
    ri = iselIntExpr_RI(env, next);
    addInstr(env, AMD64Instr_Goto(jk, Acc_ALWAYS,ri));
 }
@@ -2689,7 +2689,8 @@ static UInt* imm32_to_iregNo ( UInt* p, Int rD, UInt imm32 )
 
 Int emit_ARMInstr ( UChar* buf, Int nbuf, ARMInstr* i,
                     Bool mode64,
-                    void* dispatch_unassisted, void* dispatch_assisted ) 
+                    void* dispatch_unassisted, void* dispatch_assisted,
+                    void* dispatch_chain_me ) 
 {
    UInt* p = (UInt*)buf;
    vassert(nbuf >= 32);
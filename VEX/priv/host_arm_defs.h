@@ -965,7 +965,8 @@ extern Bool isMove_ARMInstr      ( ARMInstr*, HReg*, HReg* );
 extern Int  emit_ARMInstr        ( UChar* buf, Int nbuf, ARMInstr*, 
                                    Bool,
                                    void* dispatch_unassisted,
-                                   void* dispatch_assisted );
+                                   void* dispatch_assisted,
+                                   void* dispatch_chain_me );
 
 extern void genSpill_ARM  ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                             HReg rreg, Int offset, Bool );
@@ -2654,7 +2654,8 @@ static UChar* mkFormVA ( UChar* p, UInt opc1, UInt r1, UInt r2,
 */
 Int emit_PPCInstr ( UChar* buf, Int nbuf, PPCInstr* i, 
                     Bool mode64,
-                    void* dispatch_unassisted, void* dispatch_assisted )
+                    void* dispatch_unassisted, void* dispatch_assisted,
+                    void* dispatch_chain_me )
 {
    UChar* p = &buf[0];
    UChar* ptmp = p;
@@ -849,7 +849,8 @@ extern Bool         isMove_PPCInstr      ( PPCInstr*, HReg*, HReg* );
 extern Int          emit_PPCInstr        ( UChar* buf, Int nbuf, PPCInstr*, 
                                            Bool mode64,
                                            void* dispatch_unassisted,
-                                           void* dispatch_assisted );
+                                           void* dispatch_assisted,
+                                           void* dispatch_chain_me );
 
 extern void genSpill_PPC  ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                             HReg rreg, Int offsetB, Bool mode64 );
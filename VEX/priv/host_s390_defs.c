@@ -7027,7 +7027,8 @@ s390_insn_mfence_emit(UChar *buf, const s390_insn *insn)
 
 Int
 emit_S390Instr(UChar *buf, Int nbuf, s390_insn *insn, Bool mode64,
-               void *dispatch_unassisted, void *dispatch_assisted)
+               void *dispatch_unassisted, void *dispatch_assisted,
+               void *dispatch_chain_me)
 {
    UChar *end;
 
@@ -1991,7 +1991,8 @@ static UChar* push_word_from_tags ( UChar* p, UShort tags )
 Int emit_X86Instr ( UChar* buf, Int nbuf, X86Instr* i, 
                     Bool mode64,
                     void* dispatch_unassisted,
-                    void* dispatch_assisted )
+                    void* dispatch_assisted,
+                    void* dispatch_chain_me )
 {
    UInt irno, opc, opc_rr, subopc_imm, opc_imma, opc_cl, opc_imm, subopc;
 
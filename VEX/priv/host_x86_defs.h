@@ -675,7 +675,8 @@ extern Bool         isMove_X86Instr      ( X86Instr*, HReg*, HReg* );
 extern Int          emit_X86Instr        ( UChar* buf, Int nbuf, X86Instr*, 
                                            Bool,
                                            void* dispatch_unassisted,
-                                           void* dispatch_assisted );
+                                           void* dispatch_assisted,
+                                           void* dispatch_chain_me );
 
 extern void genSpill_X86  ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                             HReg rreg, Int offset, Bool );
@@ -185,7 +185,8 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    void         (*ppReg)        ( HReg );
    HInstrArray* (*iselSB)       ( IRSB*, VexArch, VexArchInfo*, 
                                                   VexAbiInfo* );
-   Int          (*emit)         ( UChar*, Int, HInstr*, Bool, void*, void* );
+   Int          (*emit)         ( UChar*, Int, HInstr*, Bool,
+                                  void*, void*, void* );
    IRExpr*      (*specHelper)   ( HChar*, IRExpr**, IRStmt**, Int );
    Bool         (*preciseMemExnsFn) ( Int, Int );
 
@@ -252,7 +253,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppInstr      = (void(*)(HInstr*, Bool)) ppX86Instr;
          ppReg        = (void(*)(HReg)) ppHRegX86;
          iselSB       = iselSB_X86;
-         emit         = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*))
+         emit         = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*,void*))
                         emit_X86Instr;
          host_is_bigendian = False;
          host_word_type    = Ity_I32;
@@ -260,6 +261,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          /* jump-to-dispatcher scheme */
          vassert(vta->dispatch_unassisted != NULL);
          vassert(vta->dispatch_assisted != NULL);
+         vassert(vta->dispatch_chain_me == NULL);
          break;
 
       case VexArchAMD64:
@@ -277,7 +279,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppInstr     = (void(*)(HInstr*, Bool)) ppAMD64Instr;
          ppReg       = (void(*)(HReg)) ppHRegAMD64;
          iselSB      = iselSB_AMD64;
-         emit        = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*))
+         emit        = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*,void*))
                        emit_AMD64Instr;
          host_is_bigendian = False;
          host_word_type    = Ity_I64;
@@ -285,6 +287,9 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          /* jump-to-dispatcher scheme */
          vassert(vta->dispatch_unassisted != NULL);
          vassert(vta->dispatch_assisted != NULL);
+         /* chained exits store the guest RIP at its amd64 offset */
+         vassert(vta->dispatch_chain_me == NULL
+                 || vta->arch_guest == VexArchAMD64);
          break;
 
       case VexArchPPC32:
@@ -299,7 +304,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppInstr     = (void(*)(HInstr*,Bool)) ppPPCInstr;
          ppReg       = (void(*)(HReg)) ppHRegPPC;
          iselSB      = iselSB_PPC;
-         emit        = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*))
+         emit        = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*,void*))
                        emit_PPCInstr;
          host_is_bigendian = True;
          host_word_type    = Ity_I32;
@@ -307,6 +312,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          /* return-to-dispatcher scheme */
          vassert(vta->dispatch_unassisted == NULL);
          vassert(vta->dispatch_assisted == NULL);
+         vassert(vta->dispatch_chain_me == NULL);
          break;
 
       case VexArchPPC64:
@@ -321,7 +327,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppInstr     = (void(*)(HInstr*, Bool)) ppPPCInstr;
          ppReg       = (void(*)(HReg)) ppHRegPPC;
          iselSB      = iselSB_PPC;
-         emit        = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*))
+         emit        = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*,void*))
                        emit_PPCInstr;
          host_is_bigendian = True;
          host_word_type    = Ity_I64;
@@ -329,6 +335,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          /* return-to-dispatcher scheme */
          vassert(vta->dispatch_unassisted == NULL);
          vassert(vta->dispatch_assisted == NULL);
+         vassert(vta->dispatch_chain_me == NULL);
          break;
 
       case VexArchS390X:
@@ -343,7 +350,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppInstr     = (void(*)(HInstr*, Bool)) ppS390Instr;
          ppReg       = (void(*)(HReg)) ppHRegS390;
          iselSB      = iselSB_S390;
-         emit        = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*))
+         emit        = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*,void*))
                        emit_S390Instr;
          host_is_bigendian = True;
          host_word_type    = Ity_I64;
@@ -351,6 +358,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          /* return-to-dispatcher scheme */
          vassert(vta->dispatch_unassisted == NULL);
          vassert(vta->dispatch_assisted == NULL);
+         vassert(vta->dispatch_chain_me == NULL);
          break;
 
       case VexArchARM:
@@ -365,13 +373,14 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppInstr     = (void(*)(HInstr*, Bool)) ppARMInstr;
          ppReg       = (void(*)(HReg)) ppHRegARM;
          iselSB      = iselSB_ARM;
-         emit        = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*))
+         emit        = (Int(*)(UChar*,Int,HInstr*,Bool,void*,void*,void*))
                        emit_ARMInstr;
          host_is_bigendian = False;
          host_word_type    = Ity_I32;
          vassert(are_valid_hwcaps(VexArchARM, vta->archinfo_host.hwcaps));
          vassert(vta->dispatch_unassisted == NULL);
          vassert(vta->dispatch_assisted == NULL);
+         vassert(vta->dispatch_chain_me == NULL);
          /* return-to-dispatcher scheme */
          break;
 
@@ -713,7 +722,8 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          vex_printf("\n");
       }
       j = (*emit)( insn_bytes, sizeof insn_bytes, rcode->arr[i], mode64,
-                   vta->dispatch_unassisted, vta->dispatch_assisted );
+                   vta->dispatch_unassisted, vta->dispatch_assisted,
+                   vta->dispatch_chain_me );
       if (vex_traceflags & VEX_TRACE_ASM) {
          for (k = 0; k < j; k++)
             if (insn_bytes[k] < 16)
@@ -746,6 +756,43 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
 }
 
 
+/* --------- Chain/Unchain XDirects. --------- */
+
+VexInvalRange LibVEX_Chain ( VexArch arch_host,
+                             void*   place_to_chain,
+                             void*   disp_cp_chain_me_EXPECTED,
+                             void*   place_to_jump_to,
+                             UInt*   place_to_count )
+{
+   vassert(vex_initdone);
+   switch (arch_host) {
+      case VexArchAMD64:
+         return chainXDirect_AMD64( place_to_chain,
+                                    disp_cp_chain_me_EXPECTED,
+                                    place_to_jump_to,
+                                    place_to_count );
+      default:
+         vpanic("LibVEX_Chain: unsupported host insn set");
+   }
+}
+
+VexInvalRange LibVEX_UnChain ( VexArch arch_host,
+                               void*   place_to_unchain,
+                               void*   place_to_jump_to_EXPECTED,
+                               void*   disp_cp_chain_me )
+{
+   vassert(vex_initdone);
+   switch (arch_host) {
+      case VexArchAMD64:
+         return unchainXDirect_AMD64( place_to_unchain,
+                                      place_to_jump_to_EXPECTED,
+                                      disp_cp_chain_me );
+      default:
+         vpanic("LibVEX_UnChain: unsupported host insn set");
+   }
+}
+
+
 /* --------- Emulation warnings. --------- */
 
 HChar* LibVEX_EmWarn_string ( VexEmWarn ew )
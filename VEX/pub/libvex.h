@@ -594,6 +594,23 @@ typedef
       */
       void* dispatch_unassisted;
       void* dispatch_assisted;
+
+      /* IN: optionally, the address of the dispatcher's chain-me
+         stub.  Only used on amd64 hosts; must be NULL elsewhere.
+
+         If non-NULL, a boring exit to a constant guest address does
+         not jump to 'dispatch_unassisted' but, with the next guest
+         address in %rax as usual, decrements the 32-bit dispatch
+         counter at 0(%rsp) and calls the stub.  The stub is expected
+         to find the exit from its return address and arrange, by
+         LibVEX_Chain, for the exit to jump directly to the
+         translation of its destination in future.  If the decrement
+         brings the counter to zero, the counter is incremented again
+         and control goes to 'dispatch_unassisted' instead.
+
+         If NULL, all exits jump to the dispatcher as described
+         above. */
+      void* dispatch_chain_me;
    }
    VexTranslateArgs;
 
@@ -601,6 +618,46 @@ typedef
 extern 
 VexTranslateResult LibVEX_Translate ( VexTranslateArgs* );
 
+
+/* A range of host code which has been modified by LibVEX_Chain or
+   LibVEX_UnChain, and so may need the instruction cache flushing. */
+typedef
+   struct {
+      HWord start;
+      HWord len;
+   }
+   VexInvalRange;
+
+/* Chain the exit at place_to_chain, which must currently call
+   disp_cp_chain_me_EXPECTED (see 'dispatch_chain_me' above), so that
+   it jumps directly to place_to_jump_to.  place_to_chain is the
+   address of the exit's patchable part, which for amd64 is 13 bytes
+   before the return address pushed by the call to the chain-me
+   stub.
+
+   If place_to_count is non-NULL, the chained exit also increments the
+   32-bit counter there each time it is taken, so that a caller which
+   counts entries to translations in its dispatcher doesn't lose those
+   that no longer go through it.  That is only possible when both the
+   counter and place_to_jump_to are within 2GB of place_to_chain;
+   otherwise the exit is chained without it, and the function returns
+   with *place_to_count unchanged either way. */
+extern
+VexInvalRange LibVEX_Chain ( VexArch arch_host,
+                             void*   place_to_chain,
+                             void*   disp_cp_chain_me_EXPECTED,
+                             void*   place_to_jump_to,
+                             UInt*   place_to_count );
+
+/* Undo the effect of LibVEX_Chain: the exit at place_to_unchain,
+   which must currently jump to place_to_jump_to_EXPECTED, is made to
+   call disp_cp_chain_me again. */
+extern
+VexInvalRange LibVEX_UnChain ( VexArch arch_host,
+                               void*   place_to_unchain,
+                               void*   place_to_jump_to_EXPECTED,
+                               void*   disp_cp_chain_me );
+
 /* A subtlety re interaction between self-checking translations and
    bb-chasing.  The supplied chase_into_ok function should say NO
    (False) when presented with any address for which you might want to
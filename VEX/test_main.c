@@ -223,6 +223,7 @@ int main ( int argc, char** argv )
 #if 1 /* x86, amd64 hosts */
       vta.dispatch_unassisted = (void*)0x12345678;
       vta.dispatch_assisted   = (void*)0x12345678;
+      vta.dispatch_chain_me   = NULL;
 #else /* ppc32, ppc64 hosts */
       vta.dispatch        = NULL;
 #endif
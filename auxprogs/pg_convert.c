@@ -0,0 +1,297 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Convert a binary Privgrind dump into its JSON form.          ---*/
+/*---                                                 pg_convert.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* Usage: pg_convert <binary-dump> [<json-file>]
+
+   Reads a file written by privgrind --output-format=binary and writes
+   the same JSON document that --output-format=json would have written
+   (to stdout if no output file is given).  The layout of the input is
+   described in privgrind/pg_binary.h. */
+
+#include "pg_binary.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*---------------------------------------------------------------*/
+
+static const char* in_name;
+static FILE*       in;
+static FILE*       out;
+
+static void panic ( const char* what )
+{
+   fprintf(stderr, "pg_convert: %s: %s\n", in_name, what);
+   exit(1);
+}
+
+static unsigned long long get_u ( void )
+{
+   unsigned long long v = 0;
+   int shift = 0, c;
+   do {
+      c = getc(in);
+      if (c == EOF)
+         panic("unexpected end of file");
+      if (shift >= 64)
+         panic("bad varint");
+      v |= (unsigned long long)(c & 0x7f) << shift;
+      shift += 7;
+   } while (c & 0x80);
+   return v;
+}
+
+static long long get_s ( void )
+{
+   unsigned long long v = get_u();
+   return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+/* Returns 1 if another record follows in the current section, 0 at its
+   end. */
+static int next_record ( void )
+{
+   unsigned long long m = get_u();
+   if (m == PG_BIN_RECORD) return 1;
+   if (m == PG_BIN_END)    return 0;
+   panic("bad section marker");
+   return 0;
+}
+
+/* As next_record, for the accesses section, whose records may also be
+   PG_BIN_SITE_RECORDs; returns the marker. */
+static unsigned long long next_access_record ( void )
+{
+   unsigned long long m = get_u();
+   if (m == PG_BIN_RECORD || m == PG_BIN_SITE_RECORD || m == PG_BIN_END)
+      return m;
+   panic("bad section marker");
+   return 0;
+}
+
+
+/*---------------------------------------------------------------*/
+
+static char**             strings;
+static unsigned long long n_strings;
+
+static void read_strings ( void )
+{
+   unsigned long long i, len;
+
+   n_strings = get_u();
+   if (n_strings == 0)
+      panic("empty string table");
+   strings = calloc(n_strings, sizeof(char*));
+   if (strings == NULL)
+      panic("out of memory");
+   for (i = 0; i < n_strings; i++) {
+      len = get_u();
+      strings[i] = malloc(len + 1);
+      if (strings[i] == NULL)
+         panic("out of memory");
+      if (fread(strings[i], 1, len, in) != len)
+         panic("unexpected end of file");
+      strings[i][len] = 0;
+   }
+}
+
+static const char* string ( unsigned long long i )
+{
+   if (i >= n_strings)
+      panic("bad string index");
+   return strings[i];
+}
+
+static void section_end ( int last )
+{
+   fprintf(out, last ? "\t\t{}\n\t]\n}" : "\t\t{}\n\t],\n");
+}
+
+static void convert_functions ( int folded )
+{
+   unsigned long long id, n, iter, base;
+   const char* label;
+
+   fprintf(out, "{\n\t\"functions\":[\n");
+   while (next_record()) {
+      id    = get_u();
+      label = string(get_u());
+      (void)get_u();   /* filename: not part of the JSON dump */
+      base  = folded ? 0 : get_u();
+      n     = get_u();
+      if (folded) {
+         for (; n > 0; n--) {
+            iter = get_u();
+            fprintf(out, "\t\t{\"id\":%llu, \"iteration\":%llu, "
+                         "\"label\":\"%s\", \"count\":%llu },\n",
+                    id, iter, label, get_u());
+         }
+      } else {
+         for (iter = base + n; iter > base; iter--) {
+            fprintf(out, "\t\t{\"id\":%llu, \"iteration\":%llu, "
+                         "\"label\":\"%s\" },\n",
+                    id, iter, label);
+         }
+      }
+   }
+   section_end(0);
+}
+
+static void convert_calls ( void )
+{
+   unsigned long long j = 0, source_id, target_id, thread;
+   long long source_iter = 0, target_iter = 0;
+
+   fprintf(out, "\n\t\"calls\":[\n");
+   while (next_record()) {
+      source_id    = get_u();
+      source_iter += get_s();
+      target_id    = get_u();
+      target_iter += get_s();
+      thread       = get_u();
+      fprintf(out, "\t\t{\"id\":%llu, "
+                   "\"source_id\":%llu,  \"source_iteration\":%llu, "
+                   "\"target_id\":%llu, \"target_iteration\":%llu, "
+                   "\"thread\":%llu },\n",
+              j++, source_id, (unsigned long long)source_iter,
+              target_id, (unsigned long long)target_iter, thread);
+   }
+   section_end(0);
+}
+
+static void convert_locations ( void )
+{
+   unsigned long long addr = 0;
+
+   fprintf(out, "\n\t\"locations\":[\n");
+   while (next_record()) {
+      addr += get_s();
+      fprintf(out, "\t\t{\"id\":%llu },\n", addr);
+   }
+   section_end(0);
+}
+
+static void convert_sites ( void )
+{
+   unsigned long long id, size;
+
+   fprintf(out, "\n\t\"sites\":[\n");
+   while (next_record()) {
+      id   = get_u();
+      size = get_u();
+      fprintf(out, "\t\t{\"id\":%llu, \"size\":%llu },\n", id, size);
+   }
+   section_end(0);
+}
+
+static void convert_accesses ( void )
+{
+   unsigned long long j = 0, source_id, target = 0, site, rd, wr, thread;
+   unsigned long long source_iter = 0, m;
+
+   fprintf(out, "\n\t\"accesses\":[\n");
+   while ((m = next_access_record()) != PG_BIN_END) {
+      source_id    = get_u();
+      source_iter += get_s();
+      if (m == PG_BIN_SITE_RECORD) {
+         site      = get_u();
+      } else {
+         target   += get_s();
+      }
+      rd           = get_u();
+      wr           = get_u();
+      thread       = get_u();
+      fprintf(out, "\t\t{\"id\":%llu, "
+                   "\"source_id\":%llu, \"source_iteration\":%llu, "
+                   "\"%s\":%llu, "
+                   "\"bytes_read\":%llu, \"bytes_written\":%llu, "
+                   "\"thread\":%llu},\n",
+              j++, source_id, source_iter,
+              m == PG_BIN_SITE_RECORD ? "target_site" : "target_id",
+              m == PG_BIN_SITE_RECORD ? site : target,
+              rd, wr, thread);
+   }
+   section_end(1);
+}
+
+
+/*---------------------------------------------------------------*/
+
+int main ( int argc, char** argv )
+{
+   char magic[PG_BIN_MAGIC_LEN];
+   unsigned long long flags;
+
+   if (argc < 2 || argc > 3) {
+      fprintf(stderr, "usage: pg_convert <binary-dump> [<json-file>]\n");
+      return 1;
+   }
+
+   in_name = argv[1];
+   in = fopen(in_name, "rb");
+   if (in == NULL) {
+      perror(in_name);
+      return 1;
+   }
+   if (fread(magic, 1, PG_BIN_MAGIC_LEN, in) != PG_BIN_MAGIC_LEN
+       || memcmp(magic, PG_BIN_MAGIC, PG_BIN_MAGIC_LEN) != 0)
+      panic("not a privgrind binary dump");
+   if (get_u() != PG_BIN_VERSION)
+      panic("unsupported version");
+   flags = get_u();
+
+   out = stdout;
+   if (argc == 3) {
+      out = fopen(argv[2], "w");
+      if (out == NULL) {
+         perror(argv[2]);
+         return 1;
+      }
+   }
+
+   read_strings();
+   convert_functions(flags & PG_BIN_FOLDED);
+   convert_calls();
+   convert_locations();
+   convert_sites();
+   convert_accesses();
+
+   if (fclose(out) != 0) {
+      perror(argc == 3 ? argv[2] : "stdout");
+      return 1;
+   }
+   fclose(in);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                             pg_convert.c ---*/
+/*--------------------------------------------------------------------*/
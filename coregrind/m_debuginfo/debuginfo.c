@@ -157,6 +157,189 @@ static void move_DebugInfo_one_step_forward ( DebugInfo* di )
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Address-range index over debugInfo_list              ---*/
+/*------------------------------------------------------------*/
+
+/* Finding the DebugInfo that covers an address used to mean walking
+   debugInfo_list and checking each DebugInfo's ranges in turn, which
+   is slow when a process has several hundred objects mapped.  Instead
+   we keep, for each kind of lookup, an array of the address ranges of
+   all DebugInfos sorted by start address, so that finding the
+   DebugInfo that covers an address is a binary search.
+
+   The arrays are rebuilt lazily, on the first lookup after any
+   DebugInfo has been created, discarded, or had its mappings or
+   tables changed; di_index__invalidate must be called whenever that
+   happens.  In normal operation the ranges of different DebugInfos
+   don't overlap.  If for some reason they do (for example, a stale
+   DebugInfo for an object that was mapped but never read) we can't
+   know which one the list search would have found, so
+   di_index__find tells the caller to fall back to scanning the
+   list. */
+
+typedef
+   enum {
+      DiIx_SymText=0, /* r-x mapping, for text symbols */
+      DiIx_SymData,   /* .data, .sdata, .bss, .sbss, .rodata */
+      DiIx_Loc,       /* .text, for line number info */
+      DiIx_Cfsi,      /* [cfsi_minavma, cfsi_maxavma] */
+      DiIx_N
+   }
+   DiIxKind;
+
+typedef
+   struct {
+      Addr       lo;
+      Addr       hi;  /* inclusive */
+      DebugInfo* di;
+   }
+   DiIxEnt;
+
+typedef
+   struct {
+      DiIxEnt* ents;
+      Word     used;
+      Word     size;
+      Bool     overlaps;
+   }
+   DiIx;
+
+static DiIx di_index[DiIx_N];
+static Bool di_index_valid = False;
+
+/* Returned by di_index__find when the list must be searched. */
+#define DI_INDEX_UNUSABLE ((DebugInfo*)1)
+
+static void di_index__invalidate ( void )
+{
+   di_index_valid = False;
+}
+
+static void di_index__add ( DiIx* ix, DebugInfo* di, Addr avma, SizeT size )
+{
+   if (size == 0)
+      return;
+   if (ix->used == ix->size) {
+      Word     new_sz = ix->size == 0 ? 64 : 2 * ix->size;
+      DiIxEnt* new_ents = ML_(dinfo_zalloc)( "di.debuginfo.dia.1",
+                                             new_sz * sizeof(DiIxEnt) );
+      if (ix->ents) {
+         VG_(memcpy)( new_ents, ix->ents, ix->used * sizeof(DiIxEnt) );
+         ML_(dinfo_free)( ix->ents );
+      }
+      ix->ents = new_ents;
+      ix->size = new_sz;
+   }
+   ix->ents[ix->used].lo = avma;
+   ix->ents[ix->used].hi = avma + size - 1;
+   ix->ents[ix->used].di = di;
+   ix->used++;
+}
+
+static Int cmp_DiIxEnt_by_lo ( void* va, void* vb )
+{
+   DiIxEnt* a = (DiIxEnt*)va;
+   DiIxEnt* b = (DiIxEnt*)vb;
+   if (a->lo < b->lo) return -1;
+   if (a->lo > b->lo) return 1;
+   return 0;
+}
+
+/* Sort ix's entries, merge overlapping ranges belonging to the same
+   DebugInfo, and note whether any ranges of different DebugInfos
+   overlap. */
+static void di_index__canonicalise ( DiIx* ix )
+{
+   Word i, j;
+   ix->overlaps = False;
+   if (ix->used == 0)
+      return;
+   VG_(ssort)( ix->ents, ix->used, sizeof(DiIxEnt), cmp_DiIxEnt_by_lo );
+   j = 0;
+   for (i = 1; i < ix->used; i++) {
+      if (ix->ents[i].lo <= ix->ents[j].hi) {
+         if (ix->ents[i].di != ix->ents[j].di)
+            ix->overlaps = True;
+         if (ix->ents[i].hi > ix->ents[j].hi)
+            ix->ents[j].hi = ix->ents[i].hi;
+      } else {
+         ix->ents[++j] = ix->ents[i];
+      }
+   }
+   ix->used = j + 1;
+}
+
+static void di_index__rebuild ( void )
+{
+   DebugInfo* di;
+   Int        k;
+
+   for (k = 0; k < DiIx_N; k++)
+      di_index[k].used = 0;
+
+   for (di = debugInfo_list; di != NULL; di = di->next) {
+      if (di->have_rx_map)
+         di_index__add( &di_index[DiIx_SymText], di,
+                        di->rx_map_avma, di->rx_map_size );
+      if (di->data_present)
+         di_index__add( &di_index[DiIx_SymData], di,
+                        di->data_avma, di->data_size );
+      if (di->sdata_present)
+         di_index__add( &di_index[DiIx_SymData], di,
+                        di->sdata_avma, di->sdata_size );
+      if (di->bss_present)
+         di_index__add( &di_index[DiIx_SymData], di,
+                        di->bss_avma, di->bss_size );
+      if (di->sbss_present)
+         di_index__add( &di_index[DiIx_SymData], di,
+                        di->sbss_avma, di->sbss_size );
+      if (di->rodata_present)
+         di_index__add( &di_index[DiIx_SymData], di,
+                        di->rodata_avma, di->rodata_size );
+      if (di->text_present)
+         di_index__add( &di_index[DiIx_Loc], di,
+                        di->text_avma, di->text_size );
+      if (di->cfsi_used > 0)
+         di_index__add( &di_index[DiIx_Cfsi], di,
+                        di->cfsi_minavma,
+                        di->cfsi_maxavma - di->cfsi_minavma + 1 );
+   }
+
+   for (k = 0; k < DiIx_N; k++)
+      di_index__canonicalise( &di_index[k] );
+
+   di_index_valid = True;
+}
+
+/* Find the DebugInfo whose ranges of the given kind include ptr.
+   Returns NULL if there is none, or DI_INDEX_UNUSABLE if the caller
+   must search debugInfo_list itself. */
+static DebugInfo* di_index__find ( DiIxKind kind, Addr ptr )
+{
+   DiIx* ix;
+   Word  lo, hi, mid;
+
+   if (UNLIKELY(!di_index_valid))
+      di_index__rebuild();
+
+   ix = &di_index[kind];
+   if (UNLIKELY(ix->overlaps))
+      return DI_INDEX_UNUSABLE;
+
+   lo = 0;
+   hi = ix->used - 1;
+   while (True) {
+      /* current unsearched space is from lo to hi, inclusive. */
+      if (lo > hi) return NULL; /* not found */
+      mid = (lo + hi) / 2;
+      if (ptr < ix->ents[mid].lo) { hi = mid-1; continue; }
+      if (ptr > ix->ents[mid].hi) { lo = mid+1; continue; }
+      return ix->ents[mid].di;
+   }
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Notification (acquire/discard) helpers               ---*/
 /*------------------------------------------------------------*/
@@ -210,6 +393,10 @@ static void free_DebugInfo ( DebugInfo* di )
 
    vg_assert(di != NULL);
    if (di->filename)   ML_(dinfo_free)(di->filename);
+   if (di->buildid)    ML_(dinfo_free)(di->buildid);
+   if (di->deferred_path) ML_(dinfo_free)(di->deferred_path);
+   if (di->deferred_cu_ranges) VG_(deleteXA)(di->deferred_cu_ranges);
+   if (di->deferred_cus_read)  VG_(deleteXA)(di->deferred_cus_read);
    if (di->symtab)     ML_(dinfo_free)(di->symtab);
    if (di->loctab)     ML_(dinfo_free)(di->loctab);
    if (di->cfsi)       ML_(dinfo_free)(di->cfsi);
@@ -304,6 +491,7 @@ static void discard_DebugInfo ( DebugInfo* di )
                          reason);
          vg_assert(*prev_next_ptr == curr);
          *prev_next_ptr = curr->next;
+         di_index__invalidate();
          if (curr->have_dinfo)
             VG_(redir_notify_delete_DebugInfo)( curr );
          free_DebugInfo(curr);
@@ -474,6 +662,7 @@ DebugInfo* find_or_create_DebugInfo_for ( UChar* filename, UChar* memname )
       vg_assert(di);
       di->next = debugInfo_list;
       debugInfo_list = di;
+      di_index__invalidate();
    }
    return di;
 }
@@ -794,6 +983,10 @@ ULong VG_(di_notify_mmap)( Addr a, Bool allow_SkFileV )
       }
    }
 
+   /* The mapping details just noted are used by the text symbol
+      index. */
+   di_index__invalidate();
+
    /* If we don't have an rx and rw mapping, or if we already have
       debuginfo for this mapping for whatever reason, go no
       further. */
@@ -831,6 +1024,8 @@ ULong VG_(di_notify_mmap)( Addr a, Bool allow_SkFileV )
       cfsi_cache__invalidate();
       /* prepare read data for use */
       ML_(canonicaliseTables)( di );
+      /* and rebuild the address-range index when next needed. */
+      di_index__invalidate();
       /* notify m_redir about it */
       TRACE_SYMTAB("\n------ Notifying m_redir ------\n");
       VG_(redir_notify_new_DebugInfo)( di );
@@ -847,7 +1042,9 @@ ULong VG_(di_notify_mmap)( Addr a, Bool allow_SkFileV )
       TRACE_SYMTAB("\n------ ELF reading failed ------\n");
       /* Something went wrong (eg. bad ELF file).  Should we delete
          this DebugInfo?  No - it contains info on the rw/rx
-         mappings, at least. */
+         mappings, at least.  But the reader may have filled in some
+         of its ranges before giving up. */
+      di_index__invalidate();
       di_handle = 0;
       vg_assert(di->have_dinfo == False);
    }
@@ -1105,6 +1302,7 @@ void VG_(di_notify_pdb_debuginfo)( Int fd_obj, Addr avma_obj,
         ML_(read_pdb_debug_info) do it. */
      ML_(read_pdb_debug_info)( di, avma_obj, unknown_purpose__reloc,
                                pdbimage, n_pdbimage, pdbname, pdb_mtime );
+     di_index__invalidate();
      // JRS fixme: take notice of return value from read_pdb_debug_info,
      // and handle failure
      vg_assert(di->have_dinfo); // fails if PDB read failed
@@ -1149,6 +1347,35 @@ void VG_(di_discard_ALL_debuginfo)( void )
 /*--- plausible-looking stack dumps.                       ---*/
 /*------------------------------------------------------------*/
 
+/* If di's DWARF line number and variable info was left unread when
+   its object was mapped (--lazy-debuginfo=yes), read it now. */
+static void read_deferred_dinfo ( DebugInfo* di )
+{
+   if (LIKELY(!di->deferred_dwarf))
+      return;
+#  if defined(VGO_linux)
+   ML_(read_elf_deferred_debug_info)( di );
+   ML_(canonicaliseDeferredTables)( di );
+#  endif
+   vg_assert(!di->deferred_dwarf);
+}
+
+/* As read_deferred_dinfo, but only as much as is needed to look up
+   the line info for ptr: when .debug_aranges says which compilation
+   unit covers it, read just that unit's lines. */
+static void read_deferred_lines ( DebugInfo* di, Addr ptr )
+{
+   if (LIKELY(!di->deferred_dwarf))
+      return;
+#  if defined(VGO_linux)
+   if (ML_(read_elf_deferred_cu_lines)( di, ptr )) {
+      ML_(canonicaliseDeferredLoctab)( di );
+      return;
+   }
+#  endif
+   read_deferred_dinfo( di );
+}
+
 /* Search all symtabs that we know about to locate ptr.  If found, set
    *pdi to the relevant DebugInfo, and *symno to the symtab entry
    *number within that.  If not found, *psi is set to NULL.
@@ -1164,6 +1391,18 @@ static void search_all_symtabs ( Addr ptr, /*OUT*/DebugInfo** pdi,
    DebugInfo* di;
    Bool       inRange;
 
+   di = di_index__find( findText ? DiIx_SymText : DiIx_SymData, ptr );
+   if (LIKELY(di != DI_INDEX_UNUSABLE)) {
+      if (di == NULL) goto not_found;
+      sno = ML_(search_one_symtab) ( 
+               di, ptr, match_anywhere_in_sym, findText );
+      if (sno == -1) goto not_found;
+      *symno = sno;
+      *pdi = di;
+      return;
+   }
+
+   /* The index can't help; search the list. */
    for (di = debugInfo_list; di != NULL; di = di->next) {
 
       if (findText) {
@@ -1224,11 +1463,25 @@ static void search_all_loctabs ( Addr ptr, /*OUT*/DebugInfo** pdi,
 {
    Word       lno;
    DebugInfo* di;
+
+   di = di_index__find( DiIx_Loc, ptr );
+   if (LIKELY(di != DI_INDEX_UNUSABLE)) {
+      if (di == NULL) goto not_found;
+      read_deferred_lines( di, ptr );
+      lno = ML_(search_one_loctab) ( di, ptr );
+      if (lno == -1) goto not_found;
+      *locno = lno;
+      *pdi = di;
+      return;
+   }
+
+   /* The index can't help; search the list. */
    for (di = debugInfo_list; di != NULL; di = di->next) {
       if (di->text_present
           && di->text_size > 0
           && di->text_avma <= ptr 
           && ptr < di->text_avma + di->text_size) {
+         read_deferred_lines( di, ptr );
          lno = ML_(search_one_loctab) ( di, ptr );
          if (lno == -1) goto not_found;
          *locno = lno;
@@ -1530,6 +1783,19 @@ DebugInfo* VG_(find_DebugInfo) ( Addr a )
    return NULL;
 }
 
+/* Find the DebugInfo with the given handle, as returned by
+   VG_(di_notify_mmap) and passed to tools' new_mem_mmap trackers.
+   Returns NULL if there is none, e.g. because it has been discarded. */
+DebugInfo* VG_(find_DebugInfo_by_handle) ( ULong di_handle )
+{
+   DebugInfo* di;
+   for (di = debugInfo_list; di != NULL; di = di->next) {
+      if (di->handle == di_handle)
+         return di;
+   }
+   return NULL;
+}
+
 /* Map a code address to a filename.  Returns True if successful.  */
 Bool VG_(get_filename)( Addr a, Char* filename, Int n_filename )
 {
@@ -1978,6 +2244,19 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
 
    if (0) VG_(printf)("search for %#lx\n", ip);
 
+   di = di_index__find( DiIx_Cfsi, ip );
+   if (LIKELY(di != DI_INDEX_UNUSABLE)) {
+      if (di != NULL) {
+         /* No other DebugInfo's CFSI ranges include ip, so if it isn't
+            in this one, it isn't anywhere. */
+         n_steps++;
+         i = ML_(search_one_cfitab)( di, ip );
+         vg_assert(i >= -1 && i < (Word)di->cfsi_used);
+      }
+      goto done;
+   }
+
+   /* The index can't help; search the list. */
    for (di = debugInfo_list; di != NULL; di = di->next) {
       Word j;
       n_steps++;
@@ -1999,6 +2278,7 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
       }
    }
 
+  done:
    if (i == -1) {
 
       /* we didn't find it. */
@@ -2486,6 +2766,21 @@ static void zterm_XA ( XArray* dst )
    offset of data_addr from the start of the variable.  Note that
    regs, which supplies ip,sp,fp values, will be NULL for global
    variables, and non-NULL for local variables. */
+/* Is 'data_addr' in di's rw mapping or one of its data-ish sections,
+   where its global variables would be? */
+static Bool data_address_is_in_object ( DebugInfo* di, Addr data_addr )
+{
+#  define IN_RANGE(_avma, _size) \
+      ((_avma) <= data_addr && data_addr - (_avma) < (_size))
+   return (di->have_rw_map && IN_RANGE(di->rw_map_avma, di->rw_map_size))
+          || (di->data_present   && IN_RANGE(di->data_avma,   di->data_size))
+          || (di->sdata_present  && IN_RANGE(di->sdata_avma,  di->sdata_size))
+          || (di->bss_present    && IN_RANGE(di->bss_avma,    di->bss_size))
+          || (di->sbss_present   && IN_RANGE(di->sbss_avma,   di->sbss_size))
+          || (di->rodata_present && IN_RANGE(di->rodata_avma, di->rodata_size));
+#  undef IN_RANGE
+}
+
 static Bool data_address_is_in_var ( /*OUT*/PtrdiffT* offset,
                                      XArray* /* TyEnt */ tyents,
                                      DiVariable*   var,
@@ -2895,6 +3190,8 @@ Bool consider_vars_in_frame ( /*MOD*/XArray* /* of HChar */ dname1,
    }
    /* End of performance-enhancing hack. */
 
+   read_deferred_dinfo( di );
+
    /* any var info at all? */
    if (!di->varinfo)
       return False;
@@ -3016,6 +3313,11 @@ Bool VG_(get_data_description)(
       /* text segment missing? unlikely, but handle it .. */
       if (!di->text_present || di->text_size == 0)
          continue;
+      /* Globals live in the data-ish sections, so there's no need to
+         read deferred var info for objects that don't hold
+         data_addr. */
+      if (di->deferred_dwarf && data_address_is_in_object( di, data_addr ))
+         read_deferred_dinfo( di );
       /* any var info at all? */
       if (!di->varinfo)
          continue;
@@ -3367,6 +3669,8 @@ void* /* really, XArray* of StackBlock */
    }
    /* End of performance-enhancing hack. */
 
+   read_deferred_dinfo( di );
+
    /* any var info at all? */
    if (!di->varinfo)
       return res; /* currently empty */
@@ -3461,6 +3765,11 @@ void* /* really, XArray* of GlobalBlock */
                        ML_(dinfo_free), sizeof(GlobalBlock) );
    tl_assert(gvars);
 
+   /* Without --read-var-info=yes there is nothing to find, so don't
+      read deferred line info just to find that out. */
+   if (VG_(clo_read_var_info))
+      read_deferred_dinfo( di );
+
    /* any var info at all? */
    if (!di->varinfo)
       return gvars;
@@ -3615,6 +3924,11 @@ const UChar* VG_(DebugInfo_get_filename)(const DebugInfo* di)
    return di->filename;
 }
 
+const UChar* VG_(DebugInfo_get_buildid)(const DebugInfo* di)
+{
+   return di->buildid;
+}
+
 PtrdiffT VG_(DebugInfo_get_text_bias)(const DebugInfo* di)
 {
    return di->text_present ? di->text_bias : 0;
@@ -49,6 +49,23 @@ void ML_(read_debuginfo_dwarf3)
           UChar* debug_line_img, Word debug_line_sz,  /* .debug_line */
           UChar* debug_str_img,  Word debug_str_sz ); /* .debug_str */
 
+/* Read the line info of just the compilation unit at unit_off in
+   .debug_info.  Units read this way are skipped by a later
+   ML_(read_debuginfo_dwarf3) on the same DebugInfo. */
+extern
+void ML_(read_debuginfo_dwarf3_unit)
+        ( struct _DebugInfo* di, ULong unit_off,
+          UChar* debug_info_img, Word debug_info_sz,  /* .debug_info */
+          UChar* debug_abbv_img, Word debug_abbv_sz,  /* .debug_abbrev */
+          UChar* debug_line_img, Word debug_line_sz,  /* .debug_line */
+          UChar* debug_str_img,  Word debug_str_sz ); /* .debug_str */
+
+/* Read .debug_aranges into di->deferred_cu_ranges. */
+extern
+void ML_(read_debug_aranges) ( struct _DebugInfo* di,
+                               UChar* debug_aranges_img,
+                               Word debug_aranges_sz );
+
 /* --------------------
    DWARF1 reader
    -------------------- */
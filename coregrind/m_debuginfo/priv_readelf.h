@@ -50,6 +50,17 @@ extern Bool ML_(is_elf_object_file)( void* image, SizeT n_image );
 */
 extern Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di );
 
+/* Read the DWARF line number and variable info that
+   ML_(read_elf_debug_info) left unread because of --lazy-debuginfo=yes.
+   Clears di->deferred_dwarf, whether or not the info could be read. */
+extern Bool ML_(read_elf_deferred_debug_info) ( struct _DebugInfo* di );
+
+/* Read just the deferred line info of the compilation unit covering
+   avma, as located by .debug_aranges.  Returns False if that can't be
+   done, in which case use ML_(read_elf_deferred_debug_info) instead. */
+extern Bool ML_(read_elf_deferred_cu_lines) ( struct _DebugInfo* di,
+                                              Addr avma );
+
 
 #endif /* ndef __PRIV_READELF_H */
 
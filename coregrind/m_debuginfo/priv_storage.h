@@ -384,6 +384,26 @@ ML_(cmp_for_DiAddrRange_range) ( const void* keyV, const void* elemV );
 */
 #define N_EHFRAME_SECTS 2
 
+/* Where a section is in an object or debuginfo file, so that it can
+   be found again after the file has been unmapped. */
+typedef
+   struct {
+      Bool  present;
+      UWord foff;
+      SizeT size;
+   }
+   DiSectLoc;
+
+/* The code of one compilation unit, from .debug_aranges: avmas
+   [avma_lo, avma_hi] are in the unit at cu_off in .debug_info. */
+typedef
+   struct {
+      Addr  avma_lo;
+      Addr  avma_hi;
+      ULong cu_off;
+   }
+   DiCuRange;
+
 struct _DebugInfo {
 
    /* Admin stuff */
@@ -446,6 +466,37 @@ struct _DebugInfo {
       VG_AR_DINFO. */
    UChar* soname;
 
+   /* The file's GNU build-id, as a hex string, or NULL if it has none.
+      In VG_AR_DINFO. */
+   UChar* buildid;
+
+   /* With --lazy-debuginfo=yes, the DWARF line number and variable
+      info isn't read along with everything else, but the first time
+      it is needed (see ML_(read_elf_deferred_debug_info)).  Until then
+      .deferred_dwarf is True, and the deferred_* fields say where the
+      .debug_* sections are in the file .deferred_path (which is
+      .filename or a separate debuginfo file, and is in VG_AR_DINFO),
+      which was .deferred_path_size bytes long at the time. */
+   Bool      deferred_dwarf;
+   UChar*    deferred_path;
+   SizeT     deferred_path_size;
+   DiSectLoc deferred_info;   /* .debug_info */
+   DiSectLoc deferred_abbv;   /* .debug_abbrev */
+   DiSectLoc deferred_line;   /* .debug_line */
+   DiSectLoc deferred_str;    /* .debug_str */
+   DiSectLoc deferred_ranges; /* .debug_ranges */
+   DiSectLoc deferred_loc;    /* .debug_loc */
+
+   /* If the object has a .debug_aranges section, line info can be
+      read a compilation unit at a time, as addresses are looked up
+      (see ML_(read_elf_deferred_cu_lines)).  .deferred_cu_ranges
+      (XArray of DiCuRange, sorted by .avma_lo) says which unit holds
+      which code, and .deferred_cus_read (XArray of ULong, sorted)
+      which units' line info has been read so far.  Both are NULL if
+      there is no .debug_aranges, and both are in VG_AR_DINFO. */
+   XArray*   deferred_cu_ranges;
+   XArray*   deferred_cus_read;
+
    /* Description of some important mapped segments.  The presence or
       absence of the mapping is denoted by the _present field, since
       in some obscure circumstances (to do with data/sdata/bss) it is
@@ -770,6 +821,14 @@ extern void ML_(canonicaliseTables) ( struct _DebugInfo* di );
    called on it's own to sort just this table. */
 extern void ML_(canonicaliseCFI) ( struct _DebugInfo* di );
 
+/* Canonicalise the line number and variable info tables only, after
+   deferred DWARF info has been read into them. */
+extern void ML_(canonicaliseDeferredTables) ( struct _DebugInfo* di );
+
+/* Canonicalise the line number table only, after the line info of
+   one more compilation unit has been read into it. */
+extern void ML_(canonicaliseDeferredLoctab) ( struct _DebugInfo* di );
+
 /* ------ Searching ------ */
 
 /* Find a symbol-table index containing the specified pointer, or -1
@@ -1157,6 +1157,61 @@ void read_unitinfo_dwarf2( /*OUT*/UnitInfo* ui,
 ////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////
 
+static Int cmp_unit_offs ( void* v1, void* v2 )
+{
+   ULong o1 = *(ULong*)v1;
+   ULong o2 = *(ULong*)v2;
+   return o1 < o2 ? -1 : o1 > o2 ? 1 : 0;
+}
+
+/* Has the line info of the unit at unit_off already been read by
+   ML_(read_debuginfo_dwarf3_unit)? */
+static Bool unit_lines_read ( struct _DebugInfo* di, ULong unit_off )
+{
+   return di->deferred_cus_read != NULL
+          && VG_(lookupXA)( di->deferred_cus_read, &unit_off, NULL, NULL );
+}
+
+/* Read the line info for the compilation unit whose header is at
+   block_img in .debug_info, and which is blklen_len + blklen bytes
+   long; the caller has checked that it's all inside the section. */
+static void read_unit_lines ( struct _DebugInfo* di,
+                              UChar* block_img, Int blklen_len,
+                              UChar* debug_abbv_img,
+                              UChar* debug_line_img, Word debug_line_sz,
+                              UChar* debug_str_img )
+{
+   UnitInfo ui;
+   UShort   ver;
+
+   /* version should be 2 */
+   ver = *((UShort*)( block_img + blklen_len ));
+   if ( ver != 2 && ver != 3 && ver != 4 ) {
+      ML_(symerr)( di, True,
+                   "Ignoring non-Dwarf2/3/4 block in .debug_info" );
+      return;
+   }
+
+   /* Fill ui with offset in .debug_line and compdir */
+   read_unitinfo_dwarf2( &ui, block_img, 
+                              debug_abbv_img, debug_str_img );
+   if (0)
+      VG_(printf)( "   => LINES=0x%llx    NAME=%s     DIR=%s\n", 
+                   ui.stmt_list, ui.name, ui.compdir );
+
+   /* Ignore blocks with no .debug_line associated block */
+   if ( ui.stmt_list == -1LL )
+      return;
+
+   if (0) 
+      VG_(printf)("debug_line_sz %ld, ui.stmt_list %lld  %s\n",
+                  debug_line_sz, ui.stmt_list, ui.name );
+   /* Read the .debug_line block for this compile unit */
+   read_dwarf2_lineblock( 
+      di, &ui, debug_line_img + ui.stmt_list, 
+               debug_line_sz  - ui.stmt_list );
+}
+
 /* Collect the debug info from DWARF3 debugging sections
  * of a given module.
  * 
@@ -1170,8 +1225,6 @@ void ML_(read_debuginfo_dwarf3)
           UChar* debug_line_img, Word debug_line_sz, /* .debug_line */
           UChar* debug_str_img,  Word debug_str_sz ) /* .debug_str */
 {
-   UnitInfo ui;
-   UShort   ver;
    UChar*   block_img;
    UChar*   end1_img;
    ULong    blklen;
@@ -1204,36 +1257,144 @@ void ML_(read_debuginfo_dwarf3)
          return;
       }
 
-      /* version should be 2 */
-      ver = *((UShort*)( block_img + blklen_len ));
-      if ( ver != 2 && ver != 3 && ver != 4 ) {
-         ML_(symerr)( di, True,
-                      "Ignoring non-Dwarf2/3/4 block in .debug_info" );
-         continue;
-      }
-      
-      /* Fill ui with offset in .debug_line and compdir */
       if (0)
          VG_(printf)( "Reading UnitInfo at 0x%lx.....\n",
                       block_img - debug_info_img + 0UL );
-      read_unitinfo_dwarf2( &ui, block_img, 
-                                 debug_abbv_img, debug_str_img );
-      if (0)
-         VG_(printf)( "   => LINES=0x%llx    NAME=%s     DIR=%s\n", 
-                      ui.stmt_list, ui.name, ui.compdir );
-      
-      /* Ignore blocks with no .debug_line associated block */
-      if ( ui.stmt_list == -1LL )
+      if (unit_lines_read( di, block_img - debug_info_img ))
          continue;
-      
-      if (0) 
-         VG_(printf)("debug_line_sz %ld, ui.stmt_list %lld  %s\n",
-                     debug_line_sz, ui.stmt_list, ui.name );
-      /* Read the .debug_line block for this compile unit */
-      read_dwarf2_lineblock( 
-         di, &ui, debug_line_img + ui.stmt_list, 
-                  debug_line_sz  - ui.stmt_list );
+      read_unit_lines( di, block_img, blklen_len, debug_abbv_img,
+                       debug_line_img, debug_line_sz, debug_str_img );
+   }
+}
+
+void ML_(read_debuginfo_dwarf3_unit)
+        ( struct _DebugInfo* di, ULong unit_off,
+          UChar* debug_info_img, Word debug_info_sz, /* .debug_info */
+          UChar* debug_abbv_img, Word debug_abbv_sz, /* .debug_abbrev */
+          UChar* debug_line_img, Word debug_line_sz, /* .debug_line */
+          UChar* debug_str_img,  Word debug_str_sz ) /* .debug_str */
+{
+   UChar* block_img;
+   ULong  blklen;
+   Bool   blklen_is_64;
+   Int    blklen_len;
+
+   if (unit_lines_read( di, unit_off ))
+      return;
+
+   /* Whatever happens, don't try this unit again. */
+   if (di->deferred_cus_read == NULL) {
+      di->deferred_cus_read
+         = VG_(newXA)( ML_(dinfo_zalloc), "di.rdd3u.1",
+                       ML_(dinfo_free), sizeof(ULong) );
+      VG_(setCmpFnXA)( di->deferred_cus_read, cmp_unit_offs );
+   }
+   VG_(addToXA)( di->deferred_cus_read, &unit_off );
+   VG_(sortXA)( di->deferred_cus_read );
+
+   if (debug_info_sz < 4 || unit_off > (ULong)debug_info_sz - 4) {
+      ML_(symerr)( di, True, "Unit offset beyond .debug_info; ignoring" );
+      return;
+   }
+   block_img  = debug_info_img + unit_off;
+   blklen     = read_initial_length_field( block_img, &blklen_is_64 );
+   blklen_len = blklen_is_64 ? 12 : 4;
+   if ( blklen + blklen_len > (ULong)debug_info_sz - unit_off ) {
+      ML_(symerr)( di, True, "Unit truncated in .debug_info; ignoring" );
+      return;
+   }
+   read_unit_lines( di, block_img, blklen_len, debug_abbv_img,
+                    debug_line_img, debug_line_sz, debug_str_img );
+}
+
+
+static Int cmp_DiCuRange ( void* v1, void* v2 )
+{
+   DiCuRange* r1 = (DiCuRange*)v1;
+   DiCuRange* r2 = (DiCuRange*)v2;
+   return r1->avma_lo < r2->avma_lo ? -1 : r1->avma_lo > r2->avma_lo ? 1 : 0;
+}
+
+/* Each set in .debug_aranges is a header naming a unit in .debug_info,
+   then (address, length) pairs, aligned to twice the address size
+   from the start of the set and ended by a (0, 0) pair.  Sets that
+   aren't version 2, or whose addresses aren't host words, are
+   skipped, so a unit may be missing; callers must allow for that. */
+void ML_(read_debug_aranges) ( struct _DebugInfo* di,
+                               UChar* debug_aranges_img,
+                               Word debug_aranges_sz )
+{
+   UChar*    set_img;
+   UChar*    end_img = debug_aranges_img + debug_aranges_sz;
+   UChar*    p;
+   UChar*    set_end;
+   ULong     setlen, unit_off;
+   Bool      is64;
+   UShort    ver;
+   UChar     asize, segsize;
+   Word      hdr;
+   Addr      addr;
+   UWord     len;
+   DiCuRange r;
+
+   vg_assert(di->deferred_cu_ranges == NULL);
+   di->deferred_cu_ranges
+      = VG_(newXA)( ML_(dinfo_zalloc), "di.rda.1",
+                    ML_(dinfo_free), sizeof(DiCuRange) );
+   VG_(setCmpFnXA)( di->deferred_cu_ranges, cmp_DiCuRange );
+
+   for ( set_img = debug_aranges_img;
+         set_img + 4 <= end_img;
+         set_img = set_end ) {
+      /* A 64-bit initial length takes 12 bytes, which may not all be
+         there; don't read past the section looking for them. */
+      is64    = *((UInt*)set_img) == 0xFFFFFFFF;
+      hdr     = is64 ? 12 : 4;
+      if ( end_img - set_img < hdr ) {
+         ML_(symerr)( di, True,
+                      "Last set header truncated in .debug_aranges; "
+                      "ignoring" );
+         break;
+      }
+      setlen  = read_initial_length_field( set_img, &is64 );
+      if ( setlen > (ULong)(end_img - set_img) - hdr ) {
+         ML_(symerr)( di, True,
+                      "Last set truncated in .debug_aranges; ignoring" );
+         break;
+      }
+      set_end = set_img + hdr + setlen;
+      p       = set_img + hdr;
+      if ( p + 2 + (is64 ? 8 : 4) + 2 > set_end )
+         continue;
+      ver = *((UShort*)p);
+      p += 2;
+      if (is64) {
+         unit_off = *((ULong*)p);
+         p += 8;
+      } else {
+         unit_off = *((UInt*)p);
+         p += 4;
+      }
+      asize   = *p++;
+      segsize = *p++;
+      if ( ver != 2 || asize != sizeof(Addr) || segsize != 0 )
+         continue;
+      while ( (p - set_img) % (2 * asize) != 0 )
+         p++;
+      for ( ; p + 2 * asize <= set_end; p += 2 * asize ) {
+         addr = *((Addr*)p);
+         len  = *((UWord*)(p + asize));
+         if (addr == 0 && len == 0)
+            break;
+         if (len == 0)
+            continue;
+         r.avma_lo = addr + di->text_debug_bias;
+         r.avma_hi = r.avma_lo + len - 1;
+         r.cu_off  = unit_off;
+         VG_(addToXA)( di->deferred_cu_ranges, &r );
+      }
    }
+   VG_(sortXA)( di->deferred_cu_ranges );
 }
 
 
@@ -1049,7 +1049,7 @@ static
 Addr find_debug_file( struct _DebugInfo* di,
                       Char* objpath, Char* buildid,
                       Char* debugname, UInt crc,
-                      /*OUT*/UWord* size )
+                      /*OUT*/UWord* size, /*OUT*/Char** path )
 {
    Char *debugpath = NULL;
    Addr addr = 0;
@@ -1095,10 +1095,11 @@ Addr find_debug_file( struct _DebugInfo* di,
    if (addr) {
       TRACE_SYMTAB("\n");
       TRACE_SYMTAB("------ Found a debuginfo file: %s\n", debugpath);
+      *path = debugpath;
+   } else if (debugpath) {
+      ML_(dinfo_free)(debugpath);
    }
 
-   ML_(dinfo_free)(debugpath);
-
    return addr;
 }
 
@@ -1145,6 +1146,43 @@ Word file_offset_from_svma ( /*OUT*/Bool* ok,
    return 0;
 }
 
+/* Read DWARF line number info, and variable info if wanted, from the
+   given .debug_* section images. */
+static
+void read_dwarf_line_and_var_info (
+        struct _DebugInfo* di,
+        UChar* debug_info_img,   SizeT debug_info_sz,   /* .debug_info */
+        UChar* debug_abbv_img,   SizeT debug_abbv_sz,   /* .debug_abbrev */
+        UChar* debug_line_img,   SizeT debug_line_sz,   /* .debug_line */
+        UChar* debug_str_img,    SizeT debug_str_sz,    /* .debug_str */
+        UChar* debug_ranges_img, SizeT debug_ranges_sz, /* .debug_ranges */
+        UChar* debug_loc_img,    SizeT debug_loc_sz     /* .debug_loc */
+     )
+{
+   /* The old reader: line numbers and unwind info only */
+   ML_(read_debuginfo_dwarf3) ( di,
+                                debug_info_img, debug_info_sz,
+                                debug_abbv_img, debug_abbv_sz,
+                                debug_line_img, debug_line_sz,
+                                debug_str_img,  debug_str_sz );
+
+   /* The new reader: read the DIEs in .debug_info to acquire
+      information on variable types and locations.  But only if
+      the tool asks for it, or the user requests it on the
+      command line. */
+   if (VG_(needs).var_info /* the tool requires it */
+       || VG_(clo_read_var_info) /* the user asked for it */) {
+      ML_(new_dwarf3_reader)(
+         di, debug_info_img,   debug_info_sz,
+             debug_abbv_img,   debug_abbv_sz,
+             debug_line_img,   debug_line_sz,
+             debug_str_img,    debug_str_sz,
+             debug_ranges_img, debug_ranges_sz,
+             debug_loc_img,    debug_loc_sz
+      );
+   }
+}
+
 /* The central function for reading ELF debug info.  For the
    object/exe specified by the DebugInfo, find ELF sections, then read
    the symbols, line number info, file name info, CFA (stack-unwind
@@ -1173,6 +1211,7 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
    /* Ditto for any ELF debuginfo file that we might happen to load. */
    Addr          dimage   = 0;
    UWord         n_dimage = 0;
+   Char*         dpath    = NULL;
 
    /* ELF header for the main file.  Should == oimage since is at
       start of file. */
@@ -1935,6 +1974,7 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
       UChar*     debug_str_img    = NULL; /* .debug_str    (dwarf2) */
       UChar*     debug_ranges_img = NULL; /* .debug_ranges (dwarf2) */
       UChar*     debug_loc_img    = NULL; /* .debug_loc    (dwarf2) */
+      UChar*     debug_aranges_img = NULL; /* .debug_aranges (dwarf2) */
       UChar*     debug_frame_img  = NULL; /* .debug_frame  (dwarf2) */
       UChar*     dwarf1d_img      = NULL; /* .debug        (dwarf1) */
       UChar*     dwarf1l_img      = NULL; /* .line         (dwarf1) */
@@ -1956,6 +1996,7 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
       SizeT      debug_str_sz    = 0;
       SizeT      debug_ranges_sz = 0;
       SizeT      debug_loc_sz    = 0;
+      SizeT      debug_aranges_sz = 0;
       SizeT      debug_frame_sz  = 0;
       SizeT      dwarf1d_sz      = 0;
       SizeT      dwarf1l_sz      = 0;
@@ -2030,6 +2071,7 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
          FIND(".debug_str",     debug_str_sz,    debug_str_img)
          FIND(".debug_ranges",  debug_ranges_sz, debug_ranges_img)
          FIND(".debug_loc",     debug_loc_sz,    debug_loc_img)
+         FIND(".debug_aranges", debug_aranges_sz, debug_aranges_img)
          FIND(".debug_frame",   debug_frame_sz,  debug_frame_img)
 
          FIND(".debug",         dwarf1d_sz,      dwarf1d_img)
@@ -2058,8 +2100,10 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
 #        undef FIND
       }
 
-      /* Look for a build-id */
+      /* Look for a build-id.  This is kept in the DebugInfo, where it
+         identifies the object to the translation cache. */
       buildid = find_buildid(oimage, n_oimage);
+      di->buildid = (UChar*)buildid;
 
       /* Look for a debug image */
       if (buildid != NULL || debuglink_img != NULL) {
@@ -2075,14 +2119,14 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
 
             /* See if we can find a matching debug file */
             dimage = find_debug_file( di, di->filename, buildid,
-                                      debuglink_img, crc, &n_dimage );
+                                      debuglink_img, crc, &n_dimage,
+                                      &dpath );
          } else {
             /* See if we can find a matching debug file */
-            dimage = find_debug_file( di, di->filename, buildid, NULL, 0, &n_dimage );
+            dimage = find_debug_file( di, di->filename, buildid, NULL, 0,
+                                      &n_dimage, &dpath );
          }
 
-         ML_(dinfo_free)(buildid);
-
          if (dimage != 0 
              && n_dimage >= sizeof(ElfXX_Ehdr)
              && ML_(is_elf_object_file)((void*)dimage, n_dimage)) {
@@ -2259,6 +2303,8 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
                FIND(need_dwarf2, ".debug_ranges", debug_ranges_sz, 
                                                                debug_ranges_img)
                FIND(need_dwarf2, ".debug_loc",    debug_loc_sz,  debug_loc_img)
+               FIND(need_dwarf2, ".debug_aranges", debug_aranges_sz,
+                                                               debug_aranges_img)
                FIND(need_dwarf2, ".debug_frame",  debug_frame_sz,
                                                                debug_frame_img)
                FIND(need_dwarf1, ".debug",        dwarf1d_sz,    dwarf1d_img)
@@ -2341,27 +2387,70 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
       if (debug_info_img && debug_abbv_img && debug_line_img
                                            /* && debug_str_img */) {
 
-         /* The old reader: line numbers and unwind info only */
-         ML_(read_debuginfo_dwarf3) ( di,
-                                      debug_info_img, debug_info_sz,
-                                      debug_abbv_img, debug_abbv_sz,
-                                      debug_line_img, debug_line_sz,
-                                      debug_str_img,  debug_str_sz );
-
-         /* The new reader: read the DIEs in .debug_info to acquire
-            information on variable types and locations.  But only if
-            the tool asks for it, or the user requests it on the
-            command line. */
-         if (VG_(needs).var_info /* the tool requires it */
-             || VG_(clo_read_var_info) /* the user asked for it */) {
-            ML_(new_dwarf3_reader)(
-               di, debug_info_img,   debug_info_sz,
-                   debug_abbv_img,   debug_abbv_sz,
-                   debug_line_img,   debug_line_sz,
-                   debug_str_img,    debug_str_sz,
-                   debug_ranges_img, debug_ranges_sz,
-                   debug_loc_img,    debug_loc_sz
-            );
+         /* With --lazy-debuginfo=yes, just note where the sections
+            are, so that ML_(read_elf_deferred_debug_info) can read
+            them when they are first needed.  That is only possible if
+            they are all in the same file, which they should be. */
+         Bool  defer = False;
+         Addr  base  = 0;
+         UWord n_base = 0;
+         if (VG_(clo_lazy_debuginfo)) {
+            Bool in_debug = dimage != 0
+                            && (Addr)debug_info_img >= dimage
+                            && (Addr)debug_info_img < dimage + n_dimage;
+            base   = in_debug ? dimage   : oimage;
+            n_base = in_debug ? n_dimage : n_oimage;
+#           define IN_BASE(_img, _sz) \
+               ((_img) == NULL \
+                || contained_within(base, n_base, (Addr)(_img), (_sz)))
+            defer  = (!in_debug || dpath != NULL)
+                     && IN_BASE(debug_info_img,   debug_info_sz)
+                     && IN_BASE(debug_abbv_img,   debug_abbv_sz)
+                     && IN_BASE(debug_line_img,   debug_line_sz)
+                     && IN_BASE(debug_str_img,    debug_str_sz)
+                     && IN_BASE(debug_ranges_img, debug_ranges_sz)
+                     && IN_BASE(debug_loc_img,    debug_loc_sz);
+#           undef IN_BASE
+            if (defer) {
+               di->deferred_path
+                  = ML_(dinfo_strdup)( "di.redi.3",
+                                       base == dimage ? dpath
+                                                      : (Char*)di->filename );
+               di->deferred_path_size = n_base;
+            }
+         }
+
+         if (defer) {
+#           define NOTE(_loc, _img, _sz) \
+               do { di->_loc.present = (_img) != NULL; \
+                    di->_loc.foff    = (_img) ? (Addr)(_img) - base : 0; \
+                    di->_loc.size    = (_img) ? (_sz) : 0; \
+               } while (0)
+            NOTE(deferred_info,   debug_info_img,   debug_info_sz);
+            NOTE(deferred_abbv,   debug_abbv_img,   debug_abbv_sz);
+            NOTE(deferred_line,   debug_line_img,   debug_line_sz);
+            NOTE(deferred_str,    debug_str_img,    debug_str_sz);
+            NOTE(deferred_ranges, debug_ranges_img, debug_ranges_sz);
+            NOTE(deferred_loc,    debug_loc_img,    debug_loc_sz);
+#           undef NOTE
+            /* With .debug_aranges, line info can be read a unit at a
+               time; see ML_(read_elf_deferred_cu_lines). */
+            if (debug_aranges_img
+                && contained_within(base, n_base, (Addr)debug_aranges_img,
+                                    debug_aranges_sz))
+               ML_(read_debug_aranges)( di, debug_aranges_img,
+                                        debug_aranges_sz );
+            di->deferred_dwarf = True;
+            TRACE_SYMTAB("deferring DWARF line/var info, in %s\n",
+                         di->deferred_path);
+         } else {
+            read_dwarf_line_and_var_info( di,
+                                          debug_info_img,   debug_info_sz,
+                                          debug_abbv_img,   debug_abbv_sz,
+                                          debug_line_img,   debug_line_sz,
+                                          debug_str_img,    debug_str_sz,
+                                          debug_ranges_img, debug_ranges_sz,
+                                          debug_loc_img,    debug_loc_sz );
          }
       }
       if (dwarf1d_img && dwarf1l_img) {
@@ -2410,10 +2499,200 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
    }
    m_res = VG_(am_munmap_valgrind) ( oimage, n_oimage );
    vg_assert(!sr_isError(m_res));
+   if (dpath)
+      ML_(dinfo_free)(dpath);
    return res;
   } 
 }
 
+
+static void unmap_deferred_file ( Addr image, UWord n_image )
+{
+   SysRes m_res = VG_(am_munmap_valgrind) ( image, n_image );
+   vg_assert(!sr_isError(m_res));
+}
+
+/* Map the file holding di's deferred DWARF info aboard again, in
+   *image / *n_image.  If it has changed size or build-id since it was
+   first read, give up rather than read garbage: then return False, and
+   there's nothing to unmap. */
+static Bool map_deferred_file ( struct _DebugInfo* di,
+                                /*OUT*/Addr* image, /*OUT*/UWord* n_image )
+{
+   SysRes fd, sres;
+   Long   n_imageLL;
+
+   *image   = 0;
+   *n_image = 0;
+
+   fd = VG_(open)(di->deferred_path, VKI_O_RDONLY, 0);
+   if (sr_isError(fd)) {
+      ML_(symerr)(di, True, "Can't reopen file to read deferred debug info");
+      return False;
+   }
+   n_imageLL = VG_(fsize)(sr_Res(fd));
+   if (n_imageLL <= 0 || (ULong)n_imageLL != (ULong)di->deferred_path_size) {
+      ML_(symerr)(di, True, "File has changed since it was mapped; "
+                            "deferred debug info not read");
+      VG_(close)(sr_Res(fd));
+      return False;
+   }
+
+   sres = VG_(am_mmap_file_float_valgrind)
+             ( (UWord)(ULong)n_imageLL, VKI_PROT_READ, sr_Res(fd), 0 );
+   VG_(close)(sr_Res(fd));
+   if (sr_isError(sres)) {
+      ML_(symerr)(di, True, "mmap failed; deferred debug info not read");
+      return False;
+   }
+   *image   = sr_Res(sres);
+   *n_image = (UWord)(ULong)n_imageLL;
+
+   if (di->buildid) {
+      Char* buildid = find_buildid(*image, *n_image);
+      Bool  same    = buildid == NULL
+                      || 0 == VG_(strcmp)(buildid, di->buildid);
+      if (buildid)
+         ML_(dinfo_free)(buildid);
+      if (!same) {
+         ML_(symerr)(di, True, "File has changed since it was mapped; "
+                               "deferred debug info not read");
+         unmap_deferred_file(*image, *n_image);
+         return False;
+      }
+   }
+   return True;
+}
+
+/* Forget about the deferred DWARF info, once it has all been read or
+   can't be. */
+static void drop_deferred_dinfo ( struct _DebugInfo* di )
+{
+   di->deferred_dwarf = False;
+   ML_(dinfo_free)(di->deferred_path);
+   di->deferred_path = NULL;
+   if (di->deferred_cu_ranges) {
+      VG_(deleteXA)(di->deferred_cu_ranges);
+      di->deferred_cu_ranges = NULL;
+   }
+   if (di->deferred_cus_read) {
+      VG_(deleteXA)(di->deferred_cus_read);
+      di->deferred_cus_read = NULL;
+   }
+}
+
+#define SECT_IMG(_image, _loc) \
+   ((_loc).present ? (UChar*)((_image) + (_loc).foff) : NULL)
+
+/* Read the DWARF line number and variable info whose whereabouts
+   ML_(read_elf_debug_info) noted in di->deferred_*, less the line
+   info of any units ML_(read_elf_deferred_cu_lines) has read
+   already.  The file is mapped aboard again just for as long as it
+   takes. */
+Bool ML_(read_elf_deferred_debug_info) ( struct _DebugInfo* di )
+{
+   Addr  image   = 0;
+   UWord n_image = 0;
+
+   vg_assert(di->have_dinfo);
+   vg_assert(di->deferred_dwarf);
+   vg_assert(di->deferred_path);
+
+   if (VG_(clo_verbosity) > 1 || VG_(clo_trace_redir))
+      VG_(message)(Vg_DebugMsg, "Reading deferred debug info for %s\n",
+                                di->filename);
+
+   /* Whatever happens, only try once. */
+   if (!map_deferred_file(di, &image, &n_image)) {
+      drop_deferred_dinfo(di);
+      return False;
+   }
+
+   /* These were checked against the file when they were noted, and
+      the file is the same size, so they are still inside it. */
+   vg_assert(di->deferred_info.present && di->deferred_abbv.present
+             && di->deferred_line.present);
+
+   read_dwarf_line_and_var_info( di,
+                                 SECT_IMG(image, di->deferred_info),
+                                 di->deferred_info.size,
+                                 SECT_IMG(image, di->deferred_abbv),
+                                 di->deferred_abbv.size,
+                                 SECT_IMG(image, di->deferred_line),
+                                 di->deferred_line.size,
+                                 SECT_IMG(image, di->deferred_str),
+                                 di->deferred_str.size,
+                                 SECT_IMG(image, di->deferred_ranges),
+                                 di->deferred_ranges.size,
+                                 SECT_IMG(image, di->deferred_loc),
+                                 di->deferred_loc.size );
+
+   unmap_deferred_file(image, n_image);
+   drop_deferred_dinfo(di);
+   return True;
+}
+
+/* Read the line info of the compilation unit whose code, according to
+   .debug_aranges, includes avma, unless that has been done already.
+   Returns False if .debug_aranges doesn't say which unit that is, in
+   which case the caller must fall back to reading everything with
+   ML_(read_elf_deferred_debug_info).  True otherwise, even if the
+   unit couldn't be read. */
+Bool ML_(read_elf_deferred_cu_lines) ( struct _DebugInfo* di, Addr avma )
+{
+   Addr       image   = 0;
+   UWord      n_image = 0;
+   Word       lo, hi, mid;
+   DiCuRange* r;
+
+   vg_assert(di->deferred_dwarf);
+   if (di->deferred_cu_ranges == NULL)
+      return False;
+
+   /* Find the last range starting at or below avma. */
+   lo = 0;
+   hi = VG_(sizeXA)(di->deferred_cu_ranges) - 1;
+   r  = NULL;
+   while (lo <= hi) {
+      mid = (lo + hi) / 2;
+      if (((DiCuRange*)VG_(indexXA)(di->deferred_cu_ranges, mid))->avma_lo
+          <= avma) {
+         r  = VG_(indexXA)(di->deferred_cu_ranges, mid);
+         lo = mid + 1;
+      } else {
+         hi = mid - 1;
+      }
+   }
+   if (r == NULL || avma > r->avma_hi)
+      return False;
+
+   if (di->deferred_cus_read
+       && VG_(lookupXA)(di->deferred_cus_read, &r->cu_off, NULL, NULL))
+      return True;
+
+   if (VG_(clo_verbosity) > 1 || VG_(clo_trace_redir))
+      VG_(message)(Vg_DebugMsg, "Reading deferred line info for %s, "
+                                "unit at 0x%llx\n", di->filename, r->cu_off);
+
+   if (!map_deferred_file(di, &image, &n_image)) {
+      drop_deferred_dinfo(di);
+      return True;
+   }
+   ML_(read_debuginfo_dwarf3_unit)( di, r->cu_off,
+                                    SECT_IMG(image, di->deferred_info),
+                                    di->deferred_info.size,
+                                    SECT_IMG(image, di->deferred_abbv),
+                                    di->deferred_abbv.size,
+                                    SECT_IMG(image, di->deferred_line),
+                                    di->deferred_line.size,
+                                    SECT_IMG(image, di->deferred_str),
+                                    di->deferred_str.size );
+   unmap_deferred_file(image, n_image);
+   return True;
+}
+
+#undef SECT_IMG
+
 #endif // defined(VGO_linux)
 
 /*--------------------------------------------------------------------*/
@@ -1584,6 +1584,17 @@ void ML_(canonicaliseTables) ( struct _DebugInfo* di )
    canonicaliseVarInfo ( di );
 }
 
+void ML_(canonicaliseDeferredTables) ( struct _DebugInfo* di )
+{
+   canonicaliseLoctab ( di );
+   canonicaliseVarInfo ( di );
+}
+
+void ML_(canonicaliseDeferredLoctab) ( struct _DebugInfo* di )
+{
+   canonicaliseLoctab ( di );
+}
+
 
 /*------------------------------------------------------------*/
 /*--- Searching the tables                                 ---*/
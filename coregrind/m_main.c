@@ -65,6 +65,7 @@
 #include "pub_core_translate.h"     // For VG_(translate)
 #include "pub_core_trampoline.h"
 #include "pub_core_transtab.h"
+#include "pub_core_transcache.h"    // For VG_(transcache_flush)
 
 
 /*====================================================================*/
@@ -75,6 +76,7 @@ static void print_all_stats ( void )
 {
    VG_(print_translation_stats)();
    VG_(print_tt_tc_stats)();
+   VG_(print_transcache_stats)();
    VG_(print_scheduler_stats)();
    VG_(print_ExeContext_stats)();
    VG_(print_errormgr_stats)();
@@ -168,10 +170,23 @@ static void usage_NORETURN ( Bool debug_help )
 "                              checks for self-modifying code: none, only for\n"
 "                              code found in stacks, for all code, or for all\n"
 "                              code except that from file-backed mappings\n"
+"    --translation-cache=<dir> save translations in <dir> and reuse them in\n"
+"                              later runs of the same program and options\n"
+"                              (some tools only) [none]\n"
+"    --num-transtab-sectors=<number> number of sectors of translated code\n"
+"                              to keep; more may speed up large programs,\n"
+"                              at the cost of memory [8]\n"
+"    --avg-transtab-entry-size=<number> average size in bytes of a translated\n"
+"                              block, to size the sectors for [0, meaning\n"
+"                              use the tool's default]\n"
+"    --keep-hot-translations=no|yes  when a sector of translated code is\n"
+"                              reused, keep its most used translations [no]\n"
 "    --read-var-info=yes|no    read debug info on stack and global variables\n"
 "                              and use it to print better error messages in\n"
 "                              tools that make use of it (Memcheck, Helgrind,\n"
 "                              DRD) [no]\n"
+"    --lazy-debuginfo=no|yes   read DWARF line number and variable info for an\n"
+"                              object only when it is first needed [no]\n"
 "    --vgdb-poll=<number>      gdbserver poll max every <number> basic blocks [%d] \n"
 "    --vgdb-shadow-registers=no|yes   let gdb see the shadow registers [no]\n"
 "    --vgdb-prefix=<prefix>    prefix for vgdb FIFOs [%s]\n"
@@ -501,6 +516,7 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
       else if VG_STR_CLO (arg, "--sim-hints",        VG_(clo_sim_hints)) {}
       else if VG_BOOL_CLO(arg, "--sym-offsets",      VG_(clo_sym_offsets)) {}
       else if VG_BOOL_CLO(arg, "--read-var-info",    VG_(clo_read_var_info)) {}
+      else if VG_BOOL_CLO(arg, "--lazy-debuginfo",   VG_(clo_lazy_debuginfo)) {}
 
       else if VG_INT_CLO (arg, "--dump-error",       VG_(clo_dump_error))   {}
       else if VG_INT_CLO (arg, "--input-fd",         VG_(clo_input_fd))     {}
@@ -518,6 +534,17 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
                                                     VG_(clo_smc_check),
                                                     Vg_SmcAllNonFile);
 
+      else if VG_STR_CLO (arg, "--translation-cache",
+                                                    VG_(clo_translation_cache)) {}
+      else if VG_BINT_CLO(arg, "--num-transtab-sectors",
+                                                    VG_(clo_num_transtab_sectors),
+                                                    MIN_N_SECTORS, MAX_N_SECTORS) {}
+      else if VG_BINT_CLO(arg, "--avg-transtab-entry-size",
+                                                    VG_(clo_avg_transtab_entry_size),
+                                                    0, MAX_AVG_TRANSTAB_ENTRY_SZB) {}
+      else if VG_BOOL_CLO(arg, "--keep-hot-translations",
+                                                    VG_(clo_keep_hot_translations)) {}
+
       else if VG_STR_CLO (arg, "--kernel-variant",  VG_(clo_kernel_variant)) {}
 
       else if VG_BOOL_CLO(arg, "--dsymutil",        VG_(clo_dsymutil)) {}
@@ -2291,6 +2318,9 @@ void shutdown_actions_NORETURN( ThreadId tid,
       the error management machinery. */
    VG_TDICT_CALL(tool_fini, 0/*exitcode*/);
 
+   /* Save any translations that --translation-cache hasn't yet. */
+   VG_(transcache_flush)();
+
    /* Show the error counts. */
    if (VG_(clo_xml)
        && (VG_(needs).core_errors || VG_(needs).tool_errors)) {
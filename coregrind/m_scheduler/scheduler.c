@@ -111,6 +111,10 @@ Bool VG_(in_generated_code) = False;
 /* Counts downwards in VG_(run_innerloop). */
 UInt VG_(dispatch_ctr);
 
+/* Set by VG_(run_innerloop) when it returns VG_TRC_INNER_CHAINME: the
+   address of the exit to be chained. */
+Addr VG_(dispatch_chain_from);
+
 /* 64-bit counter for the number of basic blocks done. */
 static ULong bbs_done = 0;
 
@@ -195,6 +199,7 @@ HChar* name_of_sched_event ( UInt event )
       case VG_TRC_INVARIANT_FAILED:   return "INVFAILED";
       case VG_TRC_INNER_COUNTERZERO:  return "COUNTERZERO";
       case VG_TRC_INNER_FASTMISS:     return "FASTMISS";
+      case VG_TRC_INNER_CHAINME:      return "CHAINME";
       case VG_TRC_FAULT_SIGNAL:       return "FAULTSIGNAL";
       default:                        return "??UNKNOWN??";
   }
@@ -760,11 +765,16 @@ static UInt run_thread_for_a_while ( ThreadId tid )
    vg_assert(VG_(in_generated_code) == False);
    VG_(in_generated_code) = True;
 
+   /* The counting dispatcher is needed for profiling, and for
+      m_transtab to tell which translations to keep when it recycles a
+      sector with --keep-hot-translations=yes. */
    SCHEDSETJMP(
       tid, 
       jumped, 
       trc = (UInt)VG_(run_innerloop)( (void*)&tst->arch.vex,
-                                      VG_(clo_profile_flags) > 0 ? 1 : 0 )
+                                      VG_(clo_profile_flags) > 0
+                                      || VG_(clo_keep_hot_translations)
+                                         ? 1 : 0 )
    );
 
    vg_assert(VG_(in_generated_code) == True);
@@ -911,6 +921,18 @@ static void handle_tt_miss ( ThreadId tid )
    }
 }
 
+/* A direct exit from the block just run is not yet chained to its
+   destination.  Chain it if the destination has been translated;
+   otherwise translate it, as for a fast-cache miss, and leave the
+   chaining until the exit is next taken. */
+static void handle_chain_me ( ThreadId tid, void* place_to_chain )
+{
+   Addr ip = VG_(get_IP)(tid);
+
+   if (!VG_(tt_tc_do_chaining)( place_to_chain, ip ))
+      handle_tt_miss(tid);
+}
+
 static void handle_syscall(ThreadId tid, UInt trc)
 {
    ThreadState * volatile tst = VG_(get_ThreadState)(tid);
@@ -1137,6 +1159,11 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 	 vg_assert(VG_(dispatch_ctr) > 1);
 	 handle_tt_miss(tid);
 	 break;
+
+      case VG_TRC_INNER_CHAINME:
+	 vg_assert(VG_(dispatch_ctr) > 1);
+	 handle_chain_me(tid, (void*)VG_(dispatch_chain_from));
+	 break;
 	    
       case VEX_TRC_JMP_CLIENTREQ:
 	 do_client_request(tid);
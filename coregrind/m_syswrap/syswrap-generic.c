@@ -39,6 +39,7 @@
 #include "pub_core_debuginfo.h"     // VG_(di_notify_*)
 #include "pub_core_aspacemgr.h"
 #include "pub_core_transtab.h"      // VG_(discard_translations)
+#include "pub_core_transcache.h"    // VG_(transcache_flush)
 #include "pub_core_xarray.h"
 #include "pub_core_clientstate.h"   // VG_(brk_base), VG_(brk_limit)
 #include "pub_core_debuglog.h"
@@ -2603,6 +2604,11 @@ PRE(sys_execve)
    /* After this point, we can't recover if the execve fails. */
    VG_(debugLog)(1, "syswrap", "Exec of %s\n", (Char*)ARG1);
 
+   /* This process won't get to exit, so write out translations the
+      translation cache hasn't saved yet now; a traced child running
+      the same program can then reuse them. */
+   VG_(transcache_flush)();
+
    
    // Terminate gdbserver if it is active.
    if (VG_(clo_vgdb)  != Vg_VgdbNo) {
@@ -94,7 +94,8 @@ VgNeeds VG_(needs) = {
    .var_info	         = False,
    .malloc_replacement   = False,
    .xml_output           = False,
-   .final_IR_tidy_pass   = False
+   .final_IR_tidy_pass   = False,
+   .persistent_translations = False
 };
 
 /* static */
@@ -322,6 +323,11 @@ void VG_(needs_xml_output)( void )
    VG_(needs).xml_output = True;
 }
 
+void VG_(needs_persistent_translations)( void )
+{
+   VG_(needs).persistent_translations = True;
+}
+
 void VG_(needs_final_IR_tidy_pass)( 
    IRSB*(*final_tidy)(IRSB*)
 )
@@ -0,0 +1,617 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Persistent translation cache.                 m_transcache.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_hashtable.h"
+#include "pub_core_xarray.h"
+#include "pub_core_clientstate.h"  // VG_(args_for_valgrind)
+#include "pub_core_debuginfo.h"    // VG_(DebugInfo_get_buildid)
+#include "pub_core_machine.h"      // VG_(machine_get_VexArchInfo)
+#include "pub_core_tooliface.h"
+#include "pub_core_gdbserver.h"    // VG_(gdbserver_instrumentation_needed)
+#include "pub_core_transcache.h"
+
+
+/*------------------------------------------------------------*/
+/*--- Overview                                             ---*/
+/*------------------------------------------------------------*/
+
+/* Host code made by Vex is only valid in the process it was made for.
+   It refers to the guest code by absolute address, and calls helpers
+   in the tool, and the dispatcher, by absolute address.  There is no
+   relocation information, so a translation can only be reused when
+   all of those addresses are the same:
+
+   - the guest code comes from the same object (same build-id) loaded
+     at the same address.  The address space manager places objects
+     deterministically, so for a given program, environment and set
+     of options this is normally so.
+
+   - the tool executable is the same one (same inode, size and mtime
+     of /proc/self/exe), so its helpers and the dispatcher haven't
+     moved.
+
+   - the tool, its options and the CPU are the same, so the
+     instrumentation would be the same.
+
+   Translations are saved per object, in
+   <dir>/<tool>-<build-id>-<text address>-<key>.vgtc, where key is a
+   hash of the last two points.  Each record carries a hash of the
+   guest bytes it was made from, so code which changed anyway (say, a
+   file rewritten in place) is translated again.
+
+   Only the records are kept in memory.  The host code of a saved
+   translation is already in the translation table, and stays in the
+   pending buffer only until it is written out; after that, and for
+   translations loaded from earlier runs, it is read back from the
+   file when it is looked up.
+
+   Translations made by a tool are only reusable if its instrumentation
+   depends on nothing but the guest code and its options: no pointers
+   into its heap, and no bookkeeping at instrumentation time.  Tools
+   say so with VG_(needs_persistent_translations).  Neither holds for
+   the origin tags which m_translate plants for tools tracking stack
+   allocations with ECUs, nor for blocks instrumented for gdbserver, so
+   those are never saved or reused either. */
+
+
+/*------------------------------------------------------------*/
+/*--- Types and state                                      ---*/
+/*------------------------------------------------------------*/
+
+/* Write out an object's new translations once this many bytes of them
+   are pending, and at exit. */
+#define PENDING_FLUSH_SZB  (64 * 1024)
+
+/* A saved translation, as stored on disk.  The host code follows. */
+typedef
+   struct {
+      ULong  key;           /* tc_key, so stale files are ignored */
+      ULong  nraddr;
+      ULong  addr;
+      ULong  base[3];
+      ULong  guest_hash;    /* hash of the guest bytes in base/len */
+      ULong  host_hash;     /* hash of the host code */
+      UShort len[3];
+      UShort n_used;
+      UShort n_sc_extents;
+      UShort host_len;
+   }
+   TCRecord;
+
+/* Where a translation's host code is: at .off in the object's file,
+   or, if .pending, at .off in its pending buffer. */
+typedef
+   struct _TCEntry {
+      struct _TCEntry* next;
+      UWord            nraddr;    /* key */
+      TCRecord         rec;
+      Long             off;
+      Bool             pending;
+   }
+   TCEntry;
+
+/* The translations for one object at one load address. */
+typedef
+   struct _TCObj {
+      struct _TCObj* next;
+      HChar*         buildid;
+      Addr           text_avma;
+      SizeT          text_size;
+      HChar*         path;
+      Int            fd;          /* path, for reading; -1 if not open */
+      VgHashTable    entries;     /* of TCEntry, by nraddr */
+      XArray*        pending;     /* UChar: records not yet written */
+      XArray*        pending_es;  /* TCEntry*: the entries they are for */
+   }
+   TCObj;
+
+static enum { TC_Uninit, TC_Off, TC_On } tc_state = TC_Uninit;
+static ULong   tc_key;
+static TCObj*  tc_objs    = NULL;
+static TCObj*  tc_last    = NULL;
+static Bool    tc_warned  = False;
+
+static ULong n_tc_hits   = 0;
+static ULong n_tc_misses = 0;
+static ULong n_tc_stale  = 0;
+static ULong n_tc_loaded = 0;
+static ULong n_tc_saved  = 0;
+static UInt  n_tc_objs   = 0;
+
+
+/*------------------------------------------------------------*/
+/*--- Hashing                                              ---*/
+/*------------------------------------------------------------*/
+
+/* 64-bit FNV-1a. */
+#define FNV_INIT  0xcbf29ce484222325ULL
+
+static ULong hash_bytes ( ULong h, const void* p, SizeT n )
+{
+   const UChar* b = p;
+   SizeT i;
+   for (i = 0; i < n; i++) {
+      h ^= b[i];
+      h *= 0x100000001b3ULL;
+   }
+   return h;
+}
+
+static ULong hash_word ( ULong h, ULong w )
+{
+   return hash_bytes( h, &w, sizeof(w) );
+}
+
+static ULong hash_str ( ULong h, const HChar* s )
+{
+   return hash_bytes( h, s, VG_(strlen)(s) + 1 );
+}
+
+static ULong hash_guest ( VexGuestExtents* vge )
+{
+   ULong h = FNV_INIT;
+   Int   i;
+   for (i = 0; i < vge->n_used; i++)
+      h = hash_bytes( h, (void*)(Addr)vge->base[i], vge->len[i] );
+   return h;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Setup                                                ---*/
+/*------------------------------------------------------------*/
+
+static void tc_disable ( const HChar* why )
+{
+   VG_(umsg)("Warning: --translation-cache ignored: %s\n", why);
+   tc_state = TC_Off;
+}
+
+/* Done at the first translation, once the tool's post_clo_init has
+   had its say. */
+static void tc_init ( void )
+{
+   struct vg_stat st;
+   VexArch        arch;
+   VexArchInfo    archinfo;
+   ULong          h;
+   Word           i;
+
+   tc_state = TC_Off;
+   if (VG_(clo_translation_cache) == NULL)
+      return;
+
+   if (!VG_(needs).persistent_translations) {
+      tc_disable( "the tool's translations can't be reused" );
+      return;
+   }
+   if (VG_(clo_profile_flags) > 0) {
+      tc_disable( "profiled translations can't be reused" );
+      return;
+   }
+   if (VG_(tdict).track_new_mem_stack_w_ECU) {
+      tc_disable( "the tool's translations refer to origin tags" );
+      return;
+   }
+   if (!VG_(is_dir)( VG_(clo_translation_cache) )) {
+      tc_disable( "not a directory" );
+      return;
+   }
+   if (sr_isError( VG_(stat)( "/proc/self/exe", &st ) )) {
+      tc_disable( "can't identify the tool executable" );
+      return;
+   }
+
+   h = hash_str( FNV_INIT, VG_(details).name );
+   h = hash_word( h, st.dev );
+   h = hash_word( h, st.ino );
+   h = hash_word( h, st.size );
+   h = hash_word( h, st.mtime );
+   h = hash_word( h, st.mtime_nsec );
+
+   VG_(machine_get_VexArchInfo)( &arch, &archinfo );
+   h = hash_word( h, arch );
+   h = hash_word( h, archinfo.hwcaps );
+   h = hash_word( h, archinfo.ppc_cache_line_szB );
+   h = hash_word( h, archinfo.ppc_dcbz_szB );
+   h = hash_word( h, archinfo.ppc_dcbzl_szB );
+
+   /* Tools may adjust these in post_clo_init, so they aren't
+      necessarily implied by the options. */
+   h = hash_word( h, VG_(clo_vex_control).iropt_level );
+   h = hash_word( h, VG_(clo_vex_control).iropt_precise_memory_exns );
+   h = hash_word( h, VG_(clo_vex_control).iropt_unroll_thresh );
+   h = hash_word( h, VG_(clo_vex_control).guest_max_insns );
+   h = hash_word( h, VG_(clo_vex_control).guest_chase_thresh );
+   h = hash_word( h, VG_(clo_vex_control).guest_chase_cond );
+
+   for (i = 0; i < VG_(sizeXA)( VG_(args_for_valgrind) ); i++)
+      h = hash_str( h, *(HChar**)VG_(indexXA)( VG_(args_for_valgrind), i ) );
+
+   tc_key   = h;
+   tc_state = TC_On;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Objects                                              ---*/
+/*------------------------------------------------------------*/
+
+static Bool in_text ( TCObj* o, ULong base, UInt len )
+{
+   return base >= o->text_avma
+          && base + len <= (ULong)o->text_avma + o->text_size;
+}
+
+static Bool record_ok ( TCObj* o, TCRecord* rec )
+{
+   Int i;
+   if (rec->key != tc_key
+       || rec->n_used < 1 || rec->n_used > 3
+       || rec->n_sc_extents > 3
+       || rec->host_len == 0)
+      return False;
+   for (i = 0; i < rec->n_used; i++)
+      if (!in_text( o, rec->base[i], rec->len[i] ))
+         return False;
+   return True;
+}
+
+/* Add a translation, replacing any older one for the same address.
+   The entry for a pending one is noted in o->pending_es, once. */
+static void add_entry ( TCObj* o, TCRecord* rec, Long off, Bool pending )
+{
+   TCEntry* e = VG_(HT_lookup)( o->entries, (UWord)rec->nraddr );
+   if (e == NULL) {
+      e = VG_(malloc)( "transcache.entry", sizeof(TCEntry) );
+      e->nraddr  = (UWord)rec->nraddr;
+      e->pending = False;
+      VG_(HT_add_node)( o->entries, e );
+   }
+   if (pending && !e->pending)
+      VG_(addToXA)( o->pending_es, &e );
+   e->rec     = *rec;
+   e->off     = off;
+   e->pending = pending;
+}
+
+/* Copy e's host code to host, which has room for it.  False if it
+   can't be read back or has been damaged in the file since. */
+static Bool read_host ( TCObj* o, TCEntry* e, UChar* host )
+{
+   SysRes sres;
+
+   if (e->pending) {
+      VG_(memcpy)( host, VG_(indexXA)( o->pending, e->off ),
+                   e->rec.host_len );
+      return True;
+   }
+   if (o->fd < 0) {
+      sres = VG_(open)( o->path, VKI_O_RDONLY, 0 );
+      if (sr_isError(sres))
+         return False;
+      o->fd = VG_(safe_fd)( sr_Res(sres) );
+      if (o->fd < 0)
+         return False;
+   }
+   sres = VG_(pread)( o->fd, host, e->rec.host_len, e->off );
+   return !sr_isError(sres)
+          && sr_Res(sres) == e->rec.host_len
+          && hash_bytes( FNV_INIT, host, e->rec.host_len )
+             == e->rec.host_hash;
+}
+
+/* Read in the translations saved by earlier runs.  A damaged or
+   truncated file is read up to the first bad record. */
+static void load_obj ( TCObj* o )
+{
+   SysRes   sres;
+   Int      fd, n;
+   Long     size, done, off;
+   UChar*   buf;
+   TCRecord rec;
+
+   sres = VG_(open)( o->path, VKI_O_RDONLY, 0 );
+   if (sr_isError(sres))
+      return;
+   fd   = sr_Res(sres);
+   size = VG_(fsize)( fd );
+   if (size <= 0) {
+      VG_(close)( fd );
+      return;
+   }
+
+   buf  = VG_(malloc)( "transcache.load", size );
+   done = 0;
+   while (done < size) {
+      n = VG_(read)( fd, buf + done, size - done );
+      if (n <= 0)
+         break;
+      done += n;
+   }
+   VG_(close)( fd );
+
+   off = 0;
+   while (off + (Long)sizeof(TCRecord) <= done) {
+      VG_(memcpy)( &rec, buf + off, sizeof(TCRecord) );
+      if (!record_ok( o, &rec )
+          || off + (Long)sizeof(TCRecord) + rec.host_len > done
+          || hash_bytes( FNV_INIT, buf + off + sizeof(TCRecord),
+                         rec.host_len ) != rec.host_hash)
+         break;
+      add_entry( o, &rec, off + sizeof(TCRecord), False );
+      n_tc_loaded++;
+      off += sizeof(TCRecord) + rec.host_len;
+   }
+   VG_(free)( buf );
+}
+
+/* The saved translations for the object holding the guest code at
+   addr, or NULL if it can't have any. */
+static TCObj* find_obj ( Addr64 addr )
+{
+   DebugInfo*   di = VG_(find_DebugInfo)( (Addr)addr );
+   const UChar* buildid;
+   Addr         avma;
+   SizeT        size;
+   TCObj*       o;
+
+   if (di == NULL)
+      return NULL;
+   buildid = VG_(DebugInfo_get_buildid)( di );
+   if (buildid == NULL)
+      return NULL;
+   avma = VG_(DebugInfo_get_text_avma)( di );
+   size = VG_(DebugInfo_get_text_size)( di );
+
+#  define MATCHES(o)  ((o)->text_avma == avma && (o)->text_size == size \
+                       && VG_(strcmp)( (o)->buildid, (HChar*)buildid ) == 0)
+
+   if (tc_last != NULL && MATCHES(tc_last))
+      return tc_last;
+   for (o = tc_objs; o != NULL; o = o->next) {
+      if (MATCHES(o)) {
+         tc_last = o;
+         return o;
+      }
+   }
+
+#  undef MATCHES
+
+   o = VG_(malloc)( "transcache.obj", sizeof(TCObj) );
+   o->buildid   = VG_(strdup)( "transcache.buildid", (HChar*)buildid );
+   o->text_avma = avma;
+   o->text_size = size;
+   o->path      = VG_(malloc)( "transcache.path",
+                               VG_(strlen)( VG_(clo_translation_cache) )
+                               + VG_(strlen)( VG_(details).name )
+                               + VG_(strlen)( buildid ) + 64 );
+   VG_(sprintf)( o->path, "%s/%s-%s-%lx-%016llx.vgtc",
+                 VG_(clo_translation_cache), VG_(details).name,
+                 buildid, avma, tc_key );
+   o->fd        = -1;
+   o->entries   = VG_(HT_construct)( "transcache.entries" );
+   o->pending   = VG_(newXA)( VG_(malloc), "transcache.pending",
+                              VG_(free), sizeof(UChar) );
+   o->pending_es = VG_(newXA)( VG_(malloc), "transcache.pending_es",
+                               VG_(free), sizeof(TCEntry*) );
+   o->next      = tc_objs;
+   tc_objs      = o;
+   tc_last      = o;
+   n_tc_objs++;
+
+   load_obj( o );
+   return o;
+}
+
+/* Write out o's pending records, and point their entries at the
+   file.  If they can't all be written, their entries are dropped. */
+static void flush_obj ( TCObj* o )
+{
+   Word     n = VG_(sizeXA)( o->pending );
+   Word     done = 0, i;
+   Long     base = -1;
+   Int      fd, w;
+   SysRes   sres;
+   TCEntry* e;
+
+   if (n == 0)
+      return;
+
+   /* O_APPEND keeps records whole if several runs save at once; a
+      record torn by a full disk just ends the file for load_obj. */
+   sres = VG_(open)( o->path, VKI_O_WRONLY | VKI_O_CREAT | VKI_O_APPEND,
+                     VKI_S_IRUSR | VKI_S_IWUSR | VKI_S_IRGRP | VKI_S_IROTH );
+   if (sr_isError(sres)) {
+      if (!tc_warned) {
+         VG_(umsg)("Warning: can't write translation cache file %s\n",
+                   o->path);
+         tc_warned = True;
+      }
+   } else {
+      fd   = sr_Res(sres);
+      while (done < n) {
+         w = VG_(write)( fd, (UChar*)VG_(indexXA)( o->pending, 0 ) + done,
+                         n - done );
+         if (w <= 0)
+            break;
+         done += w;
+      }
+      /* With O_APPEND, the file offset is now just past what we
+         wrote.  Should another run's records have got in between,
+         read_host's check of the host hash catches it. */
+      if (done == n)
+         base = VG_(lseek)( fd, 0, VKI_SEEK_CUR ) - n;
+      VG_(close)( fd );
+   }
+
+   for (i = 0; i < VG_(sizeXA)( o->pending_es ); i++) {
+      e = *(TCEntry**)VG_(indexXA)( o->pending_es, i );
+      vg_assert(e->pending);
+      if (base >= 0) {
+         e->off    += base;
+         e->pending = False;
+      } else {
+         e = VG_(HT_remove)( o->entries, e->nraddr );
+         VG_(free)( e );
+      }
+   }
+   VG_(dropTailXA)( o->pending_es, VG_(sizeXA)( o->pending_es ) );
+   VG_(dropTailXA)( o->pending, n );
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Top level                                            ---*/
+/*------------------------------------------------------------*/
+
+static Bool gdbserver_instruments ( VexGuestExtents* vge )
+{
+   return VG_(clo_vgdb) != Vg_VgdbNo
+          && VG_(gdbserver_instrumentation_needed)( vge ) != Vg_VgdbNo;
+}
+
+Bool VG_(transcache_lookup) ( Addr64 nraddr, Addr64 addr,
+                              /*OUT*/VexGuestExtents* vge,
+                              /*OUT*/UChar* host, Int host_size,
+                              /*OUT*/Int* host_used,
+                              /*OUT*/Int* n_sc_extents )
+{
+   TCObj*   o;
+   TCEntry* e;
+   Int      i;
+
+   if (tc_state == TC_Uninit)
+      tc_init();
+   if (tc_state != TC_On)
+      return False;
+
+   o = find_obj( addr );
+   if (o == NULL)
+      return False;
+
+   e = VG_(HT_lookup)( o->entries, (UWord)nraddr );
+   if (e == NULL || e->rec.addr != addr || e->rec.host_len > host_size) {
+      n_tc_misses++;
+      return False;
+   }
+
+   vge->n_used = e->rec.n_used;
+   for (i = 0; i < 3; i++) {
+      vge->base[i] = e->rec.base[i];
+      vge->len[i]  = e->rec.len[i];
+   }
+   if (gdbserver_instruments( vge ) || hash_guest( vge ) != e->rec.guest_hash) {
+      n_tc_stale++;
+      return False;
+   }
+
+   if (!read_host( o, e, host )) {
+      n_tc_stale++;
+      return False;
+   }
+   *host_used    = e->rec.host_len;
+   *n_sc_extents = e->rec.n_sc_extents;
+   n_tc_hits++;
+   return True;
+}
+
+void VG_(transcache_add) ( Addr64 nraddr, Addr64 addr,
+                           VexGuestExtents* vge,
+                           UChar* host, Int host_used,
+                           Int n_sc_extents )
+{
+   TCObj*   o;
+   TCRecord rec;
+   Int      i;
+
+   if (tc_state != TC_On)
+      return;
+   o = find_obj( addr );
+   if (o == NULL || host_used <= 0 || host_used > 0xFFFF)
+      return;
+   /* The blocks chased into must be in the same object, or its key
+      says nothing about them. */
+   for (i = 0; i < vge->n_used; i++)
+      if (!in_text( o, vge->base[i], vge->len[i] ))
+         return;
+   if (gdbserver_instruments( vge ))
+      return;
+
+   VG_(memset)( &rec, 0, sizeof(rec) );
+   rec.key          = tc_key;
+   rec.nraddr       = nraddr;
+   rec.addr         = addr;
+   rec.n_used       = vge->n_used;
+   for (i = 0; i < vge->n_used; i++) {
+      rec.base[i] = vge->base[i];
+      rec.len[i]  = vge->len[i];
+   }
+   rec.n_sc_extents = n_sc_extents;
+   rec.host_len     = host_used;
+   rec.guest_hash   = hash_guest( vge );
+   rec.host_hash    = hash_bytes( FNV_INIT, host, host_used );
+
+   VG_(addBytesToXA)( o->pending, &rec, sizeof(rec) );
+   add_entry( o, &rec, VG_(sizeXA)( o->pending ), True );
+   VG_(addBytesToXA)( o->pending, host, host_used );
+   n_tc_saved++;
+
+   if (VG_(sizeXA)( o->pending ) >= PENDING_FLUSH_SZB)
+      flush_obj( o );
+}
+
+void VG_(transcache_flush) ( void )
+{
+   TCObj* o;
+   for (o = tc_objs; o != NULL; o = o->next)
+      flush_obj( o );
+}
+
+void VG_(print_transcache_stats) ( void )
+{
+   if (tc_state != TC_On)
+      return;
+   VG_(message)(Vg_DebugMsg,
+      "transcache: %'llu loaded from %'u objects, %'llu saved\n",
+      n_tc_loaded, n_tc_objs, n_tc_saved);
+   VG_(message)(Vg_DebugMsg,
+      "transcache: %'llu hits, %'llu misses, %'llu stale\n",
+      n_tc_hits, n_tc_misses, n_tc_stale);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
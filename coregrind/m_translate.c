@@ -50,6 +50,7 @@
 
 #include "pub_core_translate.h"
 #include "pub_core_transtab.h"
+#include "pub_core_transcache.h"  // VG_(transcache_lookup)
 #include "pub_core_dispatch.h" // VG_(run_innerloop__dispatch_{un}profiled)
                                // VG_(run_a_noredir_translation__return_point)
 
@@ -1270,7 +1271,8 @@ Bool VG_(translate) ( ThreadId tid,
 {
    Addr64             addr;
    T_Kind             kind;
-   Int                tmpbuf_used, verbosity, i;
+   Int                tmpbuf_used, n_sc_extents, verbosity, i;
+   Bool               use_transcache;
    Bool (*preamble_fn)(void*,IRSB*);
    VexArch            vex_arch;
    VexArchInfo        vex_archinfo;
@@ -1504,15 +1506,16 @@ Bool VG_(translate) ( ThreadId tid,
          = vta.dispatch_assisted;
    }
    else
-   if (VG_(clo_profile_flags) > 0) {
-      /* normal translation; although we're profiling. */
+   if (VG_(clo_profile_flags) > 0 || VG_(clo_keep_hot_translations)) {
+      /* normal translation; although we're counting entries, for
+         profiling or so that m_transtab can keep hot translations. */
       vta.dispatch_assisted
          = (void*) &VG_(run_innerloop__dispatch_assisted_profiled);
       vta.dispatch_unassisted
          = (void*) &VG_(run_innerloop__dispatch_unassisted_profiled);
    }
    else {
-      /* normal translation and we're not profiling (the normal case) */
+      /* normal translation and we're not counting (the normal case) */
       vta.dispatch_assisted
          = (void*) &VG_(run_innerloop__dispatch_assisted_unprofiled);
       vta.dispatch_unassisted
@@ -1531,6 +1534,36 @@ Bool VG_(translate) ( ThreadId tid,
 #    error "Unknown arch"
 #  endif
 
+   /* Direct exits from normal translations can be chained to their
+      destinations (see VG_(tt_tc_do_chaining)), except when profiling,
+      since then every block must go through the dispatcher to be
+      counted.  Only amd64-linux has a chain-me stub in its
+      dispatcher, so far. */
+#  if defined(VGP_amd64_linux)
+   vta.dispatch_chain_me
+      = allow_redirection && VG_(clo_profile_flags) == 0
+           ? (void*) &VG_(run_innerloop__chain_me)
+           : NULL;
+#  else
+   vta.dispatch_chain_me = NULL;
+#  endif
+
+   /* With --translation-cache, an earlier run may already have made
+      this translation.  Debugging and traced translations are always
+      done afresh, for the sake of their output. */
+   use_transcache = VG_(clo_translation_cache) != NULL
+                    && !debugging_translation
+                    && verbosity == 0
+                    && kind != T_NoRedir;
+
+   if (use_transcache
+       && VG_(transcache_lookup)( nraddr, addr, &vge,
+                                  tmpbuf, N_TMPBUF, &tmpbuf_used,
+                                  &n_sc_extents )) {
+      vg_assert(tmpbuf_used <= N_TMPBUF);
+      vg_assert(tmpbuf_used > 0);
+   } else { /* BEGIN translation by Vex */
+
    /* Sheesh.  Finally, actually _do_ the translation! */
    tres = LibVEX_Translate ( &vta );
 
@@ -1539,6 +1572,12 @@ Bool VG_(translate) ( ThreadId tid,
    vg_assert(tmpbuf_used <= N_TMPBUF);
    vg_assert(tmpbuf_used > 0);
 
+   n_sc_extents = tres.n_sc_extents;
+   if (use_transcache)
+      VG_(transcache_add)( nraddr, addr, &vge,
+                           tmpbuf, tmpbuf_used, n_sc_extents );
+   } /* END translation by Vex */
+
    /* Tell aspacem of all segments that have had translations taken
       from them.  Optimisation: don't re-look up vge.base[0] since seg
       should already point to it. */
@@ -1572,7 +1611,7 @@ Bool VG_(translate) ( ThreadId tid,
                                 nraddr,
                                 (Addr)(&tmpbuf[0]), 
                                 tmpbuf_used,
-                                tres.n_sc_extents > 0 );
+                                n_sc_extents > 0 );
       } else {
           VG_(add_to_unredir_transtab)( &vge,
                                         nraddr,
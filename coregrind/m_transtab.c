@@ -40,6 +40,8 @@
 #include "pub_core_transtab.h"
 #include "pub_core_aspacemgr.h"
 #include "pub_core_mallocfree.h" // VG_(out_of_memory_NORETURN)
+#include "pub_core_xarray.h"
+#include "pub_core_dispatch.h"   // VG_(run_innerloop__chain_me)
 
 // JRS FIXME get rid of this somehow
 #if defined(VGP_arm_linux)
@@ -57,9 +59,10 @@
 
 /*------------------ CONSTANTS ------------------*/
 
-/* Number of sectors the TC is divided into.  If you need a larger
-   overall translation cache, increase this value. */
-#define N_SECTORS 8
+/* The number of sectors the TC is divided into is given by
+   --num-transtab-sectors, up to MAX_N_SECTORS (see
+   pub_core_options.h).  If you need a larger overall translation
+   cache, increase that. */
 
 /* Number of TC entries in each sector.  This needs to be a prime
    number to work properly, it must be <= 65535 (so that a TT index
@@ -88,23 +91,75 @@
 
 #define EC2TTE_DELETED  0xFFFF /* 16-bit special value */
 
+/* With --keep-hot-translations=yes, when a sector is recycled,
+   translations in it which have been entered at least HOT_MIN_COUNT
+   times (see TTEntry.count) are kept, rather than being thrown away
+   only to be made again straight after.  At most RETAIN_LIMIT_PERCENT of the sector's tt and tc is
+   given over to them, the hottest first.  Their counts are halved
+   each time they are kept, so a translation must stay in use to stay
+   in the cache. */
+#define HOT_MIN_COUNT         4
+#define RETAIN_LIMIT_PERCENT  25
+
+
+/* The dispatcher's chain-me stub, which unchained direct exits call;
+   see VG_(tt_tc_do_chaining).  Only amd64-linux has one so far, and
+   elsewhere no exit is ever chained. */
+#if defined(VGP_amd64_linux)
+#  define CHAIN_ME  ((void*)&VG_(run_innerloop__chain_me))
+#else
+#  define CHAIN_ME  NULL
+#endif
+
 
 /*------------------ TYPES ------------------*/
 
+/* A direct exit from one translation which has been patched to jump
+   straight to another.  Each such exit is recorded twice: as an
+   InEdge of the translation it jumps to, so that it can be unchained
+   when that translation goes away, and as an OutEdge of the
+   translation it is in, so that the InEdge can be removed when that
+   one goes away.  .from_place, the address of the exit's patchable
+   code, identifies the exit. */
+typedef
+   struct {
+      UChar* from_place;
+      UInt   from_sNo;      /* sector and tt index of the */
+      UInt   from_tteNo;    /* translation holding the exit */
+   }
+   InEdge;
+
+typedef
+   struct {
+      UChar* from_place;
+      UInt   to_sNo;        /* sector and tt index of the */
+      UInt   to_tteNo;      /* translation jumped to */
+   }
+   OutEdge;
+
 /* A translation-table entry.  This indicates precisely which areas of
    guest code are included in the translation, and contains all other
    auxiliary info too.  */
 typedef
    struct {
-      /* Profiling only: the count and weight (arbitrary meaning) for
-         this translation.  Weight is a property of the translation
-         itself and computed once when the translation is created.
-         Count is an entry count for the translation and is
-         incremented by 1 every time the translation is used, if we
-         are profiling. */
+      /* The count and weight (arbitrary meaning) for this
+         translation.  Weight is a property of the translation itself
+         and computed once when the translation is created, and is only
+         used for profiling.  Count is an entry count for the
+         translation, kept when profiling or with
+         --keep-hot-translations=yes (see entries_counted): the
+         counting dispatcher increments it, via VG_(tt_fastN), every
+         time it jumps to the translation, and exits chained to the
+         translation increment it themselves, since they bypass the
+         dispatcher (see VG_(tt_tc_do_chaining)).  Count is used for
+         profiling and, when a sector is recycled, to decide which
+         translations are hot enough to keep. */
       UInt     count;
       UShort   weight;
 
+      /* The number of ULongs of host code at .tcptr. */
+      UShort   tcszQ;
+
       /* Status of the slot.  Note, we need to be able to do lazy
          deletion, hence the Deleted state. */
       enum { InUse, Deleted, Empty } status;
@@ -143,6 +198,12 @@ typedef
       //    sec->ec2tte[ tte2ec_ec[i] ][ tte2ec_ix[i] ] 
       // should be the index 
       // of this TTEntry in the containing Sector's tt array.
+
+      /* Exits which have been chained to this translation (XArray of
+         InEdge), and exits in it which have been chained to others
+         (XArray of OutEdge).  NULL if there are none. */
+      XArray* in_edges;
+      XArray* out_edges;
    }
    TTEntry;
 
@@ -151,11 +212,20 @@ typedef
    TCEntries, which hold code, and an array of TTEntries, containing
    all required administrative info.  Profiling is supported using the
    TTEntry .count and .weight fields, if required.  Each sector is
-   independent in that no cross-sector references are allowed.
+   independent in that no cross-sector references are allowed, other
+   than by chained exits, which are recorded in the TTEntries at both
+   ends.
 
    If the sector is not in use, all three pointers are NULL and
    tt_n_inuse is zero.  
 */
+typedef
+   struct {
+      UInt   offQ;          /* offset of the code in tc, in ULongs */
+      UShort tteNo;
+   }
+   HostExtent;
+
 typedef
    struct {
       /* The TCEntry area.  Size of this depends on the average
@@ -174,6 +244,14 @@ typedef
       /* The count of tt entries with state InUse. */
       Int tt_n_inuse;
 
+      /* XArray of HostExtent: the tt index of each translation added
+         to tc since the sector was last (re)initialised, in order of
+         the address of its code, which is the order they were added
+         in, since tc is only ever appended to.  Entries of
+         translations since deleted, or whose tt slot has been reused,
+         are left in place; find_TTEntry_from_hcode skips them. */
+      XArray* host_extents;
+
       /* Expandable arrays of tt indices for each of the ECLASS_N
          address range equivalence classes.  These hold indices into
          the containing sector's tt array, which in turn should point
@@ -199,9 +277,13 @@ typedef
    N_TC_SECTORS.  The initial -1 value indicates the TT/TC system is
    not yet initialised. 
 */
-static Sector sectors[N_SECTORS];
+static Sector sectors[MAX_N_SECTORS];
 static Int    youngest_sector = -1;
 
+/* The number of sectors in use, VG_(clo_num_transtab_sectors).  This
+   is fixed at startup. */
+static Int    n_sectors = 0;
+
 /* The number of ULongs in each TCEntry area.  This is computed once
    at startup and does not change. */
 static Int    tc_sector_szQ;
@@ -211,7 +293,7 @@ static Int    tc_sector_szQ;
    searched to find translations.  This is an optimisation to be used
    when searching for translations and should not affect
    correctness.  -1 denotes "no entry". */
-static Int sector_search_order[N_SECTORS];
+static Int sector_search_order[MAX_N_SECTORS];
 
 
 /* Fast helper for the TC.  A direct-mapped cache which holds a set of
@@ -242,20 +324,16 @@ typedef
 #define TRANSTAB_BOGUS_GUEST_ADDR ((Addr)1)
 */
 
-/* For profiling, we have a parallel array of pointers to .count
-   fields in TT entries.  Again, these pointers must be invalidated
-   when translations disappear.  A NULL pointer suffices to indicate
-   an unused slot.
+/* We have a parallel array of pointers to .count fields in TT
+   entries, through which the dispatcher counts each entry to a
+   translation it finds in tt_fast.  Again, these pointers must be
+   invalidated when translations disappear.  A NULL pointer suffices
+   to indicate an unused slot.
 
-   When not profiling (the normal case, VG_(clo_profile_flags) == 0),
-   all tt_fastN entries are set to NULL at startup and never read nor
-   written after that.
-
-   When profiling (VG_(clo_profile_flags) > 0), tt_fast and tt_fastN
-   change together: if tt_fast[i].guest is TRANSTAB_BOGUS_GUEST_ADDR
-   then the corresponding tt_fastN[i] must be null.  If
-   tt_fast[i].guest is any other value, then tt_fastN[i] *must* point
-   to the .count field of the corresponding TT entry.
+   tt_fast and tt_fastN change together: if tt_fast[i].guest is
+   TRANSTAB_BOGUS_GUEST_ADDR then the corresponding tt_fastN[i] must
+   be null.  If tt_fast[i].guest is any other value, then tt_fastN[i]
+   *must* point to the .count field of the corresponding TT entry.
 
    tt_fast and tt_fastN are referred to from assembly code
    (dispatch.S).
@@ -288,10 +366,18 @@ ULong n_in_sc_count = 0;
 ULong n_dump_count = 0;
 ULong n_dump_osize = 0;
 
+/* Number of translations kept, for being hot, when their sector was
+   recycled. */
+ULong n_kept_count = 0;
+
 /* Number/osize of translations discarded due to requests to do so. */
 ULong n_disc_count = 0;
 ULong n_disc_osize = 0;
 
+/* Number of direct exits chained and unchained. */
+ULong n_chainings   = 0;
+ULong n_unchainings = 0;
+
 
 /*-------------------------------------------------------------*/
 /*--- Address-range equivalence class stuff                 ---*/
@@ -580,33 +666,33 @@ static Bool sanity_check_fastcache ( void );
 static Bool sanity_check_sector_search_order ( void )
 {
    Int i, j, nListed;
-   /* assert the array is the right size */
-   vg_assert(N_SECTORS == (sizeof(sector_search_order) 
+   /* assert the array is big enough */
+   vg_assert(n_sectors <= (sizeof(sector_search_order) 
                            / sizeof(sector_search_order[0])));
    /* Check it's of the form  valid_sector_numbers ++ [-1, -1, ..] */
-   for (i = 0; i < N_SECTORS; i++) {
-      if (sector_search_order[i] < 0 || sector_search_order[i] >= N_SECTORS)
+   for (i = 0; i < n_sectors; i++) {
+      if (sector_search_order[i] < 0 || sector_search_order[i] >= n_sectors)
          break;
    }
    nListed = i;
-   for (/* */; i < N_SECTORS; i++) {
+   for (/* */; i < n_sectors; i++) {
       if (sector_search_order[i] != -1)
          break;
    }
-   if (i != N_SECTORS)
+   if (i != n_sectors)
       return False;
    /* Check each sector number only appears once */
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < n_sectors; i++) {
       if (sector_search_order[i] == -1)
          continue;
-      for (j = i+1; j < N_SECTORS; j++) {
+      for (j = i+1; j < n_sectors; j++) {
          if (sector_search_order[j] == sector_search_order[i])
             return False;
       }
    }
    /* Check that the number of listed sectors equals the number
       in use, by counting nListed back down. */
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < n_sectors; i++) {
       if (sectors[i].tc != NULL)
          nListed--;
    }
@@ -620,7 +706,7 @@ static Bool sanity_check_all_sectors ( void )
    Int     sno;
    Bool    sane;
    Sector* sec;
-   for (sno = 0; sno < N_SECTORS; sno++) {
+   for (sno = 0; sno < n_sectors; sno++) {
       sec = &sectors[sno];
       if (sec->tc == NULL)
          continue;
@@ -653,7 +739,7 @@ static UInt vge_osize ( VexGuestExtents* vge )
 
 static Bool isValidSector ( Int sector )
 {
-   if (sector < 0 || sector >= N_SECTORS)
+   if (sector < 0 || sector >= n_sectors)
       return False;
    return True;
 }
@@ -674,8 +760,7 @@ static void setFastCacheEntry ( Addr64 key, ULong* tcptr, UInt* count )
    UInt cno = (UInt)VG_TT_FAST_HASH(key);
    VG_(tt_fast)[cno].guest = (Addr)key;
    VG_(tt_fast)[cno].host  = (Addr)tcptr;
-   if (VG_(clo_profile_flags) > 0)
-      VG_(tt_fastN)[cno] = count;
+   VG_(tt_fastN)[cno]      = count;
    n_fast_updates++;
    /* This shouldn't fail.  It should be assured by m_translate
       which should reject any attempt to make translation of code
@@ -697,9 +782,8 @@ static void invalidateFastNCache ( void )
    vg_assert(j == VG_TT_FAST_SIZE);
 }
 
-/* Invalidate the fast cache VG_(tt_fast).  If profiling, also
-   invalidate the fast cache's counter array VG_(tt_fastN), otherwise
-   don't touch it. */
+/* Invalidate the fast cache VG_(tt_fast), and with it the fast
+   cache's counter array VG_(tt_fastN). */
 static void invalidateFastCache ( void )
 {
    UInt j;
@@ -713,8 +797,7 @@ static void invalidateFastCache ( void )
       VG_(tt_fast)[j+3].guest = TRANSTAB_BOGUS_GUEST_ADDR;
    }
 
-   if (VG_(clo_profile_flags) > 0)
-      invalidateFastNCache();
+   invalidateFastNCache();
 
    vg_assert(j == VG_TT_FAST_SIZE);
    n_fast_flushes++;
@@ -724,31 +807,97 @@ static Bool sanity_check_fastcache ( void )
 {
    UInt j;
    if (0) VG_(printf)("sanity check fastcache\n");
-   if (VG_(clo_profile_flags) > 0) {
-      /* profiling */
-      for (j = 0; j < VG_TT_FAST_SIZE; j++) {
-         if (VG_(tt_fastN)[j] == NULL 
-             && VG_(tt_fast)[j].guest != TRANSTAB_BOGUS_GUEST_ADDR)
-            return False;
-         if (VG_(tt_fastN)[j] != NULL 
-             && VG_(tt_fast)[j].guest == TRANSTAB_BOGUS_GUEST_ADDR)
-            return False;
-      }
-   } else {
-      /* not profiling */
-      for (j = 0; j < VG_TT_FAST_SIZE; j++) {
-         if (VG_(tt_fastN)[j] != NULL)
-            return False;
-      }
+   for (j = 0; j < VG_TT_FAST_SIZE; j++) {
+      if (VG_(tt_fastN)[j] == NULL 
+          && VG_(tt_fast)[j].guest != TRANSTAB_BOGUS_GUEST_ADDR)
+         return False;
+      if (VG_(tt_fastN)[j] != NULL 
+          && VG_(tt_fast)[j].guest == TRANSTAB_BOGUS_GUEST_ADDR)
+         return False;
    }
    return True;
 }
 
+/* forward */
+static TTEntry* add_tte ( Int sno, VexGuestExtents* vge, Addr64 entry,
+                          UChar* code, UInt code_len );
+static void unchain_tte ( Int sNo, Int tteNo );
+static void* ttaux_malloc ( HChar* cc, SizeT nbytes );
+static void ttaux_free ( void* p );
+
+/* A translation set aside while its sector is recycled. */
+typedef
+   struct {
+      Addr64          entry;
+      VexGuestExtents vge;
+      UInt            count;
+      UShort          weight;
+      UShort          tcszQ;
+      ULong*          code;
+   }
+   HotTTEntry;
+
+/* Are entries to translations being counted in TTEntry.count?  The
+   scheduler and VG_(translate) only use the counting dispatcher then,
+   as it costs an extra increment on every block run. */
+static Bool entries_counted ( void )
+{
+   return VG_(clo_profile_flags) > 0 || VG_(clo_keep_hot_translations);
+}
+
+/* The least count a translation in sec must have to be kept when sec
+   is recycled, or 0 if none is to be kept.  Counts are bucketed by
+   their log2, and buckets taken from the hottest down for as long as
+   they fit in RETAIN_LIMIT_PERCENT of the sector. */
+static UInt hot_threshold ( Sector* sec )
+{
+   ULong n[32], szQ[32], sumN = 0, sumQ = 0;
+   ULong limN = (N_TTES_PER_SECTOR_USABLE * RETAIN_LIMIT_PERCENT) / 100;
+   ULong limQ = ((ULong)tc_sector_szQ * RETAIN_LIMIT_PERCENT) / 100;
+   UInt  c;
+   Int   i, b, lowest = -1;
+
+   if (!VG_(clo_keep_hot_translations))
+      return 0;
+   for (b = 0; b < 32; b++)
+      n[b] = szQ[b] = 0;
+   for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+      if (sec->tt[i].status != InUse || sec->tt[i].count < HOT_MIN_COUNT)
+         continue;
+      for (b = 0, c = sec->tt[i].count; c > 1; c >>= 1)
+         b++;
+      n[b]++;
+      szQ[b] += sec->tt[i].tcszQ;
+   }
+   for (b = 31; b >= 0; b--) {
+      if (n[b] == 0)
+         continue;
+      if (sumN + n[b] > limN || sumQ + szQ[b] > limQ)
+         break;
+      sumN += n[b];
+      sumQ += szQ[b];
+      lowest = b;
+   }
+   if (lowest == -1)
+      return 0;
+   return (1U << lowest) < HOT_MIN_COUNT ? HOT_MIN_COUNT : (1U << lowest);
+}
+
+static inline Bool is_hot ( TTEntry* tte, UInt hot_min )
+{
+   return hot_min > 0 && tte->count >= hot_min;
+}
+
 static void initialiseSector ( Int sno )
 {
-   Int    i;
-   SysRes sres;
-   Sector* sec;
+   Int         i, n_hot = 0;
+   UInt        hot_min;
+   SysRes      sres;
+   Sector*     sec;
+   HotTTEntry* hot = NULL;
+   ULong*      hot_code = NULL;
+   ULong*      hot_next;
+   TTEntry*    tte;
    vg_assert(isValidSector(sno));
 
    { Bool sane = sanity_check_sector_search_order();
@@ -789,16 +938,18 @@ static void initialiseSector ( Int sno )
       sec->tt = (TTEntry*)(AddrH)sr_Res(sres);
 
       for (i = 0; i < N_TTES_PER_SECTOR; i++) {
-         sec->tt[i].status   = Empty;
-         sec->tt[i].n_tte2ec = 0;
+         sec->tt[i].status    = Empty;
+         sec->tt[i].n_tte2ec  = 0;
+         sec->tt[i].in_edges  = NULL;
+         sec->tt[i].out_edges = NULL;
       }
 
       /* Add an entry in the sector_search_order */
-      for (i = 0; i < N_SECTORS; i++) {
+      for (i = 0; i < n_sectors; i++) {
          if (sector_search_order[i] == -1)
             break;
       }
-      vg_assert(i >= 0 && i < N_SECTORS);
+      vg_assert(i >= 0 && i < n_sectors);
       sector_search_order[i] = sno;
 
       if (VG_(clo_verbosity) > 2)
@@ -810,19 +961,66 @@ static void initialiseSector ( Int sno )
       VG_(debugLog)(1,"transtab", "recycle sector %d\n", sno);
       vg_assert(sec->tt != NULL);
       vg_assert(sec->tc_next != NULL);
-      n_dump_count += sec->tt_n_inuse;
 
-      /* Visit each just-about-to-be-abandoned translation. */
+      /* Undo all chaining to and from the sector, so that nothing
+         jumps into it any more, and the code of the hot translations
+         set aside below is as Vex made it. */
+      for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+         if (sec->tt[i].status == InUse)
+            unchain_tte( sno, i );
+      }
+
+      /* Set aside copies of the hot translations, to be put back
+         once the sector is empty. */
+      hot_min = hot_threshold( sec );
+      if (hot_min > 0) {
+         Long hot_szQ = 0;
+         for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+            if (sec->tt[i].status == InUse && is_hot(&sec->tt[i], hot_min)) {
+               n_hot++;
+               hot_szQ += sec->tt[i].tcszQ;
+            }
+         }
+         hot      = VG_(arena_malloc)(VG_AR_TTAUX, "transtab.iS.1",
+                                      n_hot * sizeof(HotTTEntry));
+         hot_code = VG_(arena_malloc)(VG_AR_TTAUX, "transtab.iS.2",
+                                      hot_szQ * sizeof(ULong));
+         hot_next = hot_code;
+         n_hot    = 0;
+         for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+            tte = &sec->tt[i];
+            if (tte->status != InUse || !is_hot(tte, hot_min))
+               continue;
+            hot[n_hot].entry  = tte->entry;
+            hot[n_hot].vge    = tte->vge;
+            hot[n_hot].count  = tte->count;
+            hot[n_hot].weight = tte->weight;
+            hot[n_hot].tcszQ  = tte->tcszQ;
+            hot[n_hot].code   = hot_next;
+            VG_(memcpy)(hot_next, tte->tcptr, tte->tcszQ * sizeof(ULong));
+            hot_next += tte->tcszQ;
+            n_hot++;
+         }
+         vg_assert(hot_next == hot_code + hot_szQ);
+      }
+      n_dump_count += sec->tt_n_inuse - n_hot;
+      n_kept_count += n_hot;
+
+      /* Visit each just-about-to-be-abandoned translation.  Those
+         being kept aren't really abandoned, so the tool needn't
+         hear about them. */
       for (i = 0; i < N_TTES_PER_SECTOR; i++) {
          if (sec->tt[i].status == InUse) {
             vg_assert(sec->tt[i].n_tte2ec >= 1);
             vg_assert(sec->tt[i].n_tte2ec <= 3);
-            n_dump_osize += vge_osize(&sec->tt[i].vge);
-            /* Tell the tool too. */
-            if (VG_(needs).superblock_discards) {
-               VG_TDICT_CALL( tool_discard_superblock_info,
-                              sec->tt[i].entry,
-                              sec->tt[i].vge );
+            if (!is_hot(&sec->tt[i], hot_min)) {
+               n_dump_osize += vge_osize(&sec->tt[i].vge);
+               /* Tell the tool too. */
+               if (VG_(needs).superblock_discards) {
+                  VG_TDICT_CALL( tool_discard_superblock_info,
+                                 sec->tt[i].entry,
+                                 sec->tt[i].vge );
+               }
             }
          } else {
             vg_assert(sec->tt[i].n_tte2ec == 0);
@@ -847,11 +1045,11 @@ static void initialiseSector ( Int sno )
 
       /* Sanity check: ensure it is already in
          sector_search_order[]. */
-      for (i = 0; i < N_SECTORS; i++) {
+      for (i = 0; i < n_sectors; i++) {
          if (sector_search_order[i] == sno)
             break;
       }
-      vg_assert(i >= 0 && i < N_SECTORS);
+      vg_assert(i >= 0 && i < n_sectors);
 
       if (VG_(clo_verbosity) > 2)
          VG_(message)(Vg_DebugMsg, "TT/TC: recycle sector %d\n", sno);
@@ -859,9 +1057,27 @@ static void initialiseSector ( Int sno )
 
    sec->tc_next = sec->tc;
    sec->tt_n_inuse = 0;
+   if (sec->host_extents == NULL)
+      sec->host_extents = VG_(newXA)( ttaux_malloc, "transtab.iS.3",
+                                      ttaux_free, sizeof(HostExtent) );
+   else
+      VG_(dropTailXA)( sec->host_extents,
+                       VG_(sizeXA)( sec->host_extents ) );
 
    invalidateFastCache();
 
+   /* Put back the hot translations, at half their old counts. */
+   for (i = 0; i < n_hot; i++) {
+      tte = add_tte( sno, &hot[i].vge, hot[i].entry,
+                     (UChar*)hot[i].code, hot[i].tcszQ * sizeof(ULong) );
+      tte->count  = hot[i].count / 2;
+      tte->weight = hot[i].weight;
+   }
+   if (hot != NULL) {
+      VG_(arena_free)(VG_AR_TTAUX, hot);
+      VG_(arena_free)(VG_AR_TTAUX, hot_code);
+   }
+
    { Bool sane = sanity_check_sector_search_order();
      vg_assert(sane);
    }
@@ -916,6 +1132,72 @@ static void invalidate_icache ( void *ptr, Int nbytes )
 }
 
 
+/* Copy a translation into sector sno, which must have room for it in
+   both tt and tc, and return its tt entry. */
+static TTEntry* add_tte ( Int sno, VexGuestExtents* vge, Addr64 entry,
+                          UChar* code, UInt code_len )
+{
+   Sector* sec   = &sectors[sno];
+   Int     reqdQ = (code_len + 7) >> 3;
+   ULong   *tcptr, *tcptr2;
+   UChar*  dstP;
+   Int     i;
+   HostExtent he;
+
+   /* Copy into tc. */
+   tcptr = sec->tc_next;
+   vg_assert(tcptr >= &sec->tc[0]);
+   vg_assert(tcptr <= &sec->tc[tc_sector_szQ]);
+
+   dstP = (UChar*)tcptr;
+   for (i = 0; i < code_len; i++)
+      dstP[i] = code[i];
+   sec->tc_next += reqdQ;
+   sec->tt_n_inuse++;
+
+   invalidate_icache( dstP, code_len );
+
+   /* more paranoia */
+   tcptr2 = sec->tc_next;
+   vg_assert(tcptr2 >= &sec->tc[0]);
+   vg_assert(tcptr2 <= &sec->tc[tc_sector_szQ]);
+
+   /* Find an empty tt slot, and use it.  There must be such a slot
+      since tt is never allowed to get completely full. */
+   i = HASH_TT(entry);
+   vg_assert(i >= 0 && i < N_TTES_PER_SECTOR);
+   while (True) {
+      if (sec->tt[i].status == Empty
+          || sec->tt[i].status == Deleted)
+         break;
+      i++;
+      if (i >= N_TTES_PER_SECTOR)
+         i = 0;
+   }
+
+   sec->tt[i].status = InUse;
+   sec->tt[i].tcptr  = tcptr;
+   sec->tt[i].count  = 0;
+   sec->tt[i].weight = 1;
+   sec->tt[i].tcszQ  = reqdQ;
+   sec->tt[i].vge    = *vge;
+   sec->tt[i].entry  = entry;
+   sec->tt[i].in_edges  = NULL;
+   sec->tt[i].out_edges = NULL;
+
+   he.offQ  = tcptr - sec->tc;
+   he.tteNo = i;
+   VG_(addToXA)( sec->host_extents, &he );
+
+   /* Update the fast-cache. */
+   setFastCacheEntry( entry, tcptr, &sec->tt[i].count );
+
+   /* Note the eclass numbers for this translation. */
+   upd_eclasses_after_add( sec, i );
+   return &sec->tt[i];
+}
+
+
 /* Add a translation of vge to TT/TC.  The translation is temporarily
    in code[0 .. code_len-1].
 
@@ -928,10 +1210,7 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
                            UInt             code_len,
                            Bool             is_self_checking )
 {
-   Int    tcAvailQ, reqdQ, y, i;
-   ULong  *tcptr, *tcptr2;
-   UChar* srcP;
-   UChar* dstP;
+   Int    tcAvailQ, reqdQ, y;
 
    vg_assert(init_done);
    vg_assert(vge->n_used >= 1 && vge->n_used <= 3);
@@ -980,7 +1259,7 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
                       (100 * (tc_sector_szQ - tcAvailQ)) 
                          / tc_sector_szQ);
       youngest_sector++;
-      if (youngest_sector >= N_SECTORS)
+      if (youngest_sector >= n_sectors)
          youngest_sector = 0;
       y = youngest_sector;
       initialiseSector(y);
@@ -995,74 +1274,28 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
    vg_assert(sectors[y].tt_n_inuse < N_TTES_PER_SECTOR_USABLE);
    vg_assert(sectors[y].tt_n_inuse >= 0);
  
-   /* Copy into tc. */
-   tcptr = sectors[y].tc_next;
-   vg_assert(tcptr >= &sectors[y].tc[0]);
-   vg_assert(tcptr <= &sectors[y].tc[tc_sector_szQ]);
-
-   dstP = (UChar*)tcptr;
-   srcP = (UChar*)code;
-   for (i = 0; i < code_len; i++)
-      dstP[i] = srcP[i];
-   sectors[y].tc_next += reqdQ;
-   sectors[y].tt_n_inuse++;
-
-   invalidate_icache( dstP, code_len );
-
-   /* more paranoia */
-   tcptr2 = sectors[y].tc_next;
-   vg_assert(tcptr2 >= &sectors[y].tc[0]);
-   vg_assert(tcptr2 <= &sectors[y].tc[tc_sector_szQ]);
-
-   /* Find an empty tt slot, and use it.  There must be such a slot
-      since tt is never allowed to get completely full. */
-   i = HASH_TT(entry);
-   vg_assert(i >= 0 && i < N_TTES_PER_SECTOR);
-   while (True) {
-      if (sectors[y].tt[i].status == Empty
-          || sectors[y].tt[i].status == Deleted)
-         break;
-      i++;
-      if (i >= N_TTES_PER_SECTOR)
-         i = 0;
-   }
-
-   sectors[y].tt[i].status = InUse;
-   sectors[y].tt[i].tcptr  = tcptr;
-   sectors[y].tt[i].count  = 0;
-   sectors[y].tt[i].weight = 1;
-   sectors[y].tt[i].vge    = *vge;
-   sectors[y].tt[i].entry  = entry;
-
-   /* Update the fast-cache. */
-   setFastCacheEntry( entry, tcptr, &sectors[y].tt[i].count );
-
-   /* Note the eclass numbers for this translation. */
-   upd_eclasses_after_add( &sectors[y], i );
+   add_tte( y, vge, entry, (UChar*)code, code_len );
 }
 
 
-/* Search for the translation of the given guest address.  If
-   requested, a successful search can also cause the fast-caches to be
-   updated.  
+/* Find the tt entry for the translation of the given guest address.
+   If found, returns True and sets *sNo and *tteNo to its sector and
+   index, and *orderIx to the sector's index in sector_search_order.
 */
-Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
-                            Addr64        guest_addr, 
-                            Bool          upd_cache )
+static Bool find_tte ( /*OUT*/Int* sNo, /*OUT*/Int* tteNo,
+                       /*OUT*/Int* orderIx, Addr64 guest_addr )
 {
    Int i, j, k, kstart, sno;
 
-   vg_assert(init_done);
    /* Find the initial probe point just once.  It will be the same in
       all sectors and avoids multiple expensive % operations. */
-   n_full_lookups++;
    k      = -1;
    kstart = HASH_TT(guest_addr);
    vg_assert(kstart >= 0 && kstart < N_TTES_PER_SECTOR);
 
    /* Search in all the sectors,using sector_search_order[] as a
       heuristic guide as to what order to visit the sectors. */
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < n_sectors; i++) {
 
       sno = sector_search_order[i];
       if (UNLIKELY(sno == -1))
@@ -1074,20 +1307,9 @@ Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
          if (sectors[sno].tt[k].status == InUse
              && sectors[sno].tt[k].entry == guest_addr) {
             /* found it */
-            if (upd_cache)
-               setFastCacheEntry( 
-                  guest_addr, sectors[sno].tt[k].tcptr, 
-                              &sectors[sno].tt[k].count );
-            if (result)
-               *result = (AddrH)sectors[sno].tt[k].tcptr;
-            /* pull this one one step closer to the front.  For large
-               apps this more or less halves the number of required
-               probes. */
-            if (i > 0) {
-               Int tmp = sector_search_order[i-1];
-               sector_search_order[i-1] = sector_search_order[i];
-               sector_search_order[i] = tmp;
-            }
+            *sNo     = sno;
+            *tteNo   = k;
+            *orderIx = i;
             return True;
          }
          if (sectors[sno].tt[k].status == Empty)
@@ -1107,6 +1329,246 @@ Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
 }
 
 
+/* Search for the translation of the given guest address.  If
+   requested, a successful search can also cause the fast-caches to be
+   updated.  
+*/
+Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
+                            Addr64        guest_addr, 
+                            Bool          upd_cache )
+{
+   Int      i, k, sno;
+   TTEntry* tte;
+
+   vg_assert(init_done);
+   n_full_lookups++;
+
+   if (!find_tte( &sno, &k, &i, guest_addr ))
+      return False;
+
+   tte = &sectors[sno].tt[k];
+   if (upd_cache)
+      setFastCacheEntry( guest_addr, tte->tcptr, &tte->count );
+   if (result)
+      *result = (AddrH)tte->tcptr;
+   /* pull this one one step closer to the front.  For large
+      apps this more or less halves the number of required
+      probes. */
+   if (i > 0) {
+      Int tmp = sector_search_order[i-1];
+      sector_search_order[i-1] = sector_search_order[i];
+      sector_search_order[i] = tmp;
+   }
+   return True;
+}
+
+
+/*-------------------------------------------------------------*/
+/*--- Chaining.                                             ---*/
+/*-------------------------------------------------------------*/
+
+/* Direct exits from translations (on platforms which support it, so
+   far only amd64-linux) are made to call the dispatcher's chain-me
+   stub, which hands the exit back to the scheduler.  The scheduler
+   then asks VG_(tt_tc_do_chaining) to patch the exit so that in
+   future it jumps straight to its destination's translation, without
+   going through the dispatcher at all.  Whenever a translation is
+   deleted, or its sector recycled, exits chained to it are put back
+   as they were, and those in it forgotten; hence the edge lists in
+   TTEntry. */
+
+static void* ttaux_malloc ( HChar* cc, SizeT nbytes )
+{
+   return VG_(arena_malloc)(VG_AR_TTAUX, cc, nbytes);
+}
+
+static void ttaux_free ( void* p )
+{
+   VG_(arena_free)(VG_AR_TTAUX, p);
+}
+
+/* Find the tt entry whose code contains hcode. */
+static Bool find_TTEntry_from_hcode ( /*OUT*/Int* sNo, /*OUT*/Int* tteNo,
+                                      UChar* hcode )
+{
+   Int         sno;
+   Word        lo, hi, mid;
+   UInt        offQ;
+   Sector*     sec;
+   TTEntry*    tte;
+   HostExtent* he;
+
+   for (sno = 0; sno < n_sectors; sno++) {
+      sec = &sectors[sno];
+      if (sec->tc == NULL
+          || hcode < (UChar*)sec->tc || hcode >= (UChar*)sec->tc_next)
+         continue;
+      /* Sectors' tcs don't overlap, so it's this one or none.  Find
+         the last translation added whose code starts at or below
+         hcode; the code containing hcode, if still there, is its. */
+      offQ = ((UChar*)hcode - (UChar*)sec->tc) / sizeof(ULong);
+      he   = NULL;
+      lo   = 0;
+      hi   = VG_(sizeXA)( sec->host_extents ) - 1;
+      while (lo <= hi) {
+         mid = (lo + hi) / 2;
+         if (((HostExtent*)VG_(indexXA)( sec->host_extents, mid ))->offQ
+             <= offQ) {
+            he = VG_(indexXA)( sec->host_extents, mid );
+            lo = mid + 1;
+         } else {
+            hi = mid - 1;
+         }
+      }
+      if (he == NULL)
+         return False;
+      tte = &sec->tt[he->tteNo];
+      if (tte->status != InUse || tte->tcptr != sec->tc + he->offQ
+          || hcode >= (UChar*)(tte->tcptr + tte->tcszQ))
+         return False;
+      *sNo   = sno;
+      *tteNo = he->tteNo;
+      return True;
+   }
+   return False;
+}
+
+static void del_in_edge ( TTEntry* tte, UChar* from_place )
+{
+   Word i, n;
+   vg_assert(tte->in_edges != NULL);
+   n = VG_(sizeXA)( tte->in_edges );
+   for (i = 0; i < n; i++) {
+      InEdge* ie = VG_(indexXA)( tte->in_edges, i );
+      if (ie->from_place == from_place) {
+         *ie = *(InEdge*)VG_(indexXA)( tte->in_edges, n-1 );
+         VG_(dropTailXA)( tte->in_edges, 1 );
+         return;
+      }
+   }
+   vg_assert(0);
+}
+
+static void del_out_edge ( TTEntry* tte, UChar* from_place )
+{
+   Word i, n;
+   vg_assert(tte->out_edges != NULL);
+   n = VG_(sizeXA)( tte->out_edges );
+   for (i = 0; i < n; i++) {
+      OutEdge* oe = VG_(indexXA)( tte->out_edges, i );
+      if (oe->from_place == from_place) {
+         *oe = *(OutEdge*)VG_(indexXA)( tte->out_edges, n-1 );
+         VG_(dropTailXA)( tte->out_edges, 1 );
+         return;
+      }
+   }
+   vg_assert(0);
+}
+
+/* Put the exit at from_place, which currently jumps to to_hcode, back
+   to calling the chain-me stub. */
+static void unchain_place ( UChar* from_place, ULong* to_hcode )
+{
+   VexArch       arch;
+   VexInvalRange vir;
+
+   VG_(machine_get_VexArchInfo)( &arch, NULL );
+   vir = LibVEX_UnChain( arch, from_place, to_hcode, CHAIN_ME );
+   invalidate_icache( (void*)vir.start, vir.len );
+   n_unchainings++;
+}
+
+/* Undo all chaining to and from tt entry tteNo of sector sNo, which is
+   about to be deleted or moved. */
+static void unchain_tte ( Int sNo, Int tteNo )
+{
+   TTEntry* tte = &sectors[sNo].tt[tteNo];
+   TTEntry* other;
+   Word     i;
+
+   vg_assert(tte->status == InUse);
+
+   if (tte->in_edges != NULL) {
+      for (i = 0; i < VG_(sizeXA)( tte->in_edges ); i++) {
+         InEdge* ie = VG_(indexXA)( tte->in_edges, i );
+         other = &sectors[ie->from_sNo].tt[ie->from_tteNo];
+         vg_assert(other->status == InUse);
+         unchain_place( ie->from_place, tte->tcptr );
+         del_out_edge( other, ie->from_place );
+      }
+      VG_(deleteXA)( tte->in_edges );
+      tte->in_edges = NULL;
+   }
+
+   /* The exits in this translation are unchained too, since if it is
+      being moved, the copy must not jump anywhere unrecorded. */
+   if (tte->out_edges != NULL) {
+      for (i = 0; i < VG_(sizeXA)( tte->out_edges ); i++) {
+         OutEdge* oe = VG_(indexXA)( tte->out_edges, i );
+         other = &sectors[oe->to_sNo].tt[oe->to_tteNo];
+         vg_assert(other->status == InUse);
+         unchain_place( oe->from_place, other->tcptr );
+         del_in_edge( other, oe->from_place );
+      }
+      VG_(deleteXA)( tte->out_edges );
+      tte->out_edges = NULL;
+   }
+}
+
+Bool VG_(tt_tc_do_chaining) ( void* from_place, Addr64 to_guest )
+{
+   Int           from_sNo, from_tteNo, to_sNo, to_tteNo, ix;
+   TTEntry       *from, *to;
+   InEdge        ie;
+   OutEdge       oe;
+   VexArch       arch;
+   VexInvalRange vir;
+
+   vg_assert(init_done);
+   vg_assert(CHAIN_ME != NULL);
+
+   if (!find_tte( &to_sNo, &to_tteNo, &ix, to_guest ))
+      return False;
+   to = &sectors[to_sNo].tt[to_tteNo];
+
+   /* The translation holding the exit may have been discarded since
+      the exit was taken (by gdbserver, for example), in which case
+      there is nothing to do. */
+   if (!find_TTEntry_from_hcode( &from_sNo, &from_tteNo,
+                                 (UChar*)from_place ))
+      return True;
+   from = &sectors[from_sNo].tt[from_tteNo];
+
+   /* Entries along the chained exit no longer go through the counting
+      dispatcher, so have the exit count them in its place.  Vex may
+      not manage that if to->count is too far from the exit; such
+      entries then go uncounted. */
+   VG_(machine_get_VexArchInfo)( &arch, NULL );
+   vir = LibVEX_Chain( arch, from_place, CHAIN_ME, to->tcptr,
+                       entries_counted() ? &to->count : NULL );
+   invalidate_icache( (void*)vir.start, vir.len );
+   n_chainings++;
+
+   ie.from_place = (UChar*)from_place;
+   ie.from_sNo   = from_sNo;
+   ie.from_tteNo = from_tteNo;
+   if (to->in_edges == NULL)
+      to->in_edges = VG_(newXA)( ttaux_malloc, "transtab.chain.1",
+                                 ttaux_free, sizeof(InEdge) );
+   VG_(addToXA)( to->in_edges, &ie );
+
+   oe.from_place = (UChar*)from_place;
+   oe.to_sNo     = to_sNo;
+   oe.to_tteNo   = to_tteNo;
+   if (from->out_edges == NULL)
+      from->out_edges = VG_(newXA)( ttaux_malloc, "transtab.chain.2",
+                                    ttaux_free, sizeof(OutEdge) );
+   VG_(addToXA)( from->out_edges, &oe );
+
+   return True;
+}
+
+
 /*-------------------------------------------------------------*/
 /*--- Delete translations.                                  ---*/
 /*-------------------------------------------------------------*/
@@ -1157,6 +1619,9 @@ static void delete_tte ( /*MOD*/Sector* sec, Int tteno )
    vg_assert(tte->status == InUse);
    vg_assert(tte->n_tte2ec >= 1 && tte->n_tte2ec <= 3);
 
+   /* Nothing may jump here any more. */
+   unchain_tte( sec - &sectors[0], tteno );
+
    /* Deal with the ec-to-tte links first. */
    for (i = 0; i < tte->n_tte2ec; i++) {
       ec_num = (Int)tte->tte2ec_ec[i];
@@ -1305,7 +1770,7 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
       /* Fast scheme */
       vg_assert(ec >= 0 && ec < ECLASS_MISC);
 
-      for (sno = 0; sno < N_SECTORS; sno++) {
+      for (sno = 0; sno < n_sectors; sno++) {
          sec = &sectors[sno];
          if (sec->tc == NULL)
             continue;
@@ -1322,7 +1787,7 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
       VG_(debugLog)(2, "transtab",
                        "                    SLOW, ec = %d\n", ec);
 
-      for (sno = 0; sno < N_SECTORS; sno++) {
+      for (sno = 0; sno < n_sectors; sno++) {
          sec = &sectors[sno];
          if (sec->tc == NULL)
             continue;
@@ -1346,7 +1811,7 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
       vg_assert(sane);
       /* But now, also check the requested address range isn't
          present anywhere. */
-      for (sno = 0; sno < N_SECTORS; sno++) {
+      for (sno = 0; sno < n_sectors; sno++) {
          sec = &sectors[sno];
          if (sec->tc == NULL)
             continue;
@@ -1553,21 +2018,30 @@ void VG_(init_tt_tc) ( void )
                    "TT/TC: VG_(init_tt_tc) "
                    "(startup of code management)\n");
 
+   n_sectors = VG_(clo_num_transtab_sectors);
+   vg_assert(n_sectors >= MIN_N_SECTORS && n_sectors <= MAX_N_SECTORS);
+
    /* Figure out how big each tc area should be.  */
-   avg_codeszQ   = (VG_(details).avg_translation_sizeB + 7) / 8;
+   if (VG_(clo_avg_transtab_entry_size) > 0)
+      avg_codeszQ = (VG_(clo_avg_transtab_entry_size) + 7) / 8;
+   else
+      avg_codeszQ = (VG_(details).avg_translation_sizeB + 7) / 8;
    tc_sector_szQ = N_TTES_PER_SECTOR_USABLE * (1 + avg_codeszQ);
 
    /* Ensure the calculated value is not way crazy. */
    vg_assert(tc_sector_szQ >= 2 * N_TTES_PER_SECTOR_USABLE);
-   vg_assert(tc_sector_szQ <= 100 * N_TTES_PER_SECTOR_USABLE);
+   vg_assert(tc_sector_szQ
+             <= (1 + (MAX_AVG_TRANSTAB_ENTRY_SZB + 7) / 8)
+                * N_TTES_PER_SECTOR_USABLE);
 
    /* Initialise the sectors */
    youngest_sector = 0;
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < MAX_N_SECTORS; i++) {
       sectors[i].tc = NULL;
       sectors[i].tt = NULL;
       sectors[i].tc_next = NULL;
       sectors[i].tt_n_inuse = 0;
+      sectors[i].host_extents = NULL;
       for (j = 0; j < ECLASS_N; j++) {
          sectors[i].ec2tte_size[j] = 0;
          sectors[i].ec2tte_used[j] = 0;
@@ -1576,39 +2050,35 @@ void VG_(init_tt_tc) ( void )
    }
 
    /* Initialise the sector_search_order hint table. */
-   for (i = 0; i < N_SECTORS; i++)
+   for (i = 0; i < MAX_N_SECTORS; i++)
       sector_search_order[i] = -1;
 
-   /* Initialise the fast caches.  If not profiling (the usual case),
-      we have to explicitly invalidate the fastN cache as
-      invalidateFastCache() won't do that for us. */
+   /* Initialise the fast caches. */
    invalidateFastCache();
-   if (VG_(clo_profile_flags) == 0)
-      invalidateFastNCache();
 
    /* and the unredir tt/tc */
    init_unredir_tt_tc();
 
    if (VG_(clo_verbosity) > 2) {
       VG_(message)(Vg_DebugMsg,
-         "TT/TC: cache: %d sectors of %d bytes each = %d total\n", 
-          N_SECTORS, 8 * tc_sector_szQ,
-          N_SECTORS * 8 * tc_sector_szQ );
+         "TT/TC: cache: %d sectors of %d bytes each = %llu total\n", 
+          n_sectors, 8 * tc_sector_szQ,
+          n_sectors * 8ULL * tc_sector_szQ );
       VG_(message)(Vg_DebugMsg,
          "TT/TC: table: %d total entries, max occupancy %d (%d%%)\n",
-         N_SECTORS * N_TTES_PER_SECTOR,
-         N_SECTORS * N_TTES_PER_SECTOR_USABLE, 
+         n_sectors * N_TTES_PER_SECTOR,
+         n_sectors * N_TTES_PER_SECTOR_USABLE, 
          SECTOR_TT_LIMIT_PERCENT );
    }
 
    VG_(debugLog)(2, "transtab",
-      "cache: %d sectors of %d bytes each = %d total\n", 
-       N_SECTORS, 8 * tc_sector_szQ,
-       N_SECTORS * 8 * tc_sector_szQ );
+      "cache: %d sectors of %d bytes each = %llu total\n", 
+       n_sectors, 8 * tc_sector_szQ,
+       n_sectors * 8ULL * tc_sector_szQ );
    VG_(debugLog)(2, "transtab",
       "table: %d total entries, max occupancy %d (%d%%)\n",
-      N_SECTORS * N_TTES_PER_SECTOR,
-      N_SECTORS * N_TTES_PER_SECTOR_USABLE, 
+      n_sectors * N_TTES_PER_SECTOR,
+      n_sectors * N_TTES_PER_SECTOR_USABLE, 
       SECTOR_TT_LIMIT_PERCENT );
 }
 
@@ -1648,6 +2118,12 @@ void VG_(print_tt_tc_stats) ( void )
    VG_(message)(Vg_DebugMsg,
                 " transtab: discarded  %'llu (%'llu -> ?" "?)\n",
                 n_disc_count, n_disc_osize );
+   VG_(message)(Vg_DebugMsg,
+                " transtab: kept hot   %'llu\n",
+                n_kept_count );
+   VG_(message)(Vg_DebugMsg,
+                " transtab: chained    %'llu (%'llu unchained)\n",
+                n_chainings, n_unchainings );
 
    if (0) {
       Int i;
@@ -1685,7 +2161,7 @@ ULong VG_(get_BB_profile) ( BBProfEntry tops[], UInt n_tops )
 
    score_total = 0;
 
-   for (sno = 0; sno < N_SECTORS; sno++) {
+   for (sno = 0; sno < n_sectors; sno++) {
       if (sectors[sno].tc == NULL)
          continue;
       for (i = 0; i < N_TTES_PER_SECTOR; i++) {
@@ -136,6 +136,11 @@ extern Addr VG_(get_tocptr) ( Addr guest_code_addr );
 extern
 Bool VG_(lookup_symbol_SLOW)(UChar* sopatt, UChar* name, Addr* pEnt, Addr* pToc);
 
+/* The object's GNU build-id as a string of hex digits, or NULL if it
+   has none (or its debug info hasn't been read).  Used by
+   m_transcache to recognise an object across runs. */
+extern const UChar* VG_(DebugInfo_get_buildid) ( const DebugInfo *di );
+
 #endif   // __PUB_CORE_DEBUGINFO_H
 
 /*--------------------------------------------------------------------*/
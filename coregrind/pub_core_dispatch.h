@@ -73,6 +73,12 @@ extern Addr VG_(run_innerloop__dispatch_assisted_unprofiled);
 extern Addr VG_(run_innerloop__dispatch_unassisted_profiled);
 extern Addr VG_(run_innerloop__dispatch_assisted_profiled);
 #endif
+#if defined(VGP_amd64_linux)
+/* Direct exits from translations which have not yet been chained to
+   their destinations call this, which returns VG_TRC_INNER_CHAINME,
+   with the exit's patchable address in VG_(dispatch_chain_from). */
+extern Addr VG_(run_innerloop__chain_me);
+#endif
 
 
 /* Run a no-redir translation.  argblock points to 4 UWords, 2 to carry args
@@ -53,6 +53,7 @@
 #define VG_TRC_INNER_COUNTERZERO  41 /* TRC only; means bb ctr == 0 */
 #define VG_TRC_FAULT_SIGNAL       43 /* TRC only; got sigsegv/sigbus */
 #define VG_TRC_INVARIANT_FAILED   47 /* TRC only; invariant violation */
+#define VG_TRC_INNER_CHAINME      49 /* TRC only; means chain an exit */
 
 #endif   // __PUB_CORE_DISPATCH_ASM_H
 
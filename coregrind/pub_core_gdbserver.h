@@ -31,6 +31,7 @@
 #define __PUB_CORE_GDBSERVER_H
 
 #include "pub_tool_gdbserver.h"
+#include "pub_core_options.h"      // VgVgdb
 
 
 // After a fork or after an exec, call the below to (possibly) terminate
@@ -115,6 +116,11 @@ extern IRSB* VG_(instrument_for_gdbserver_if_needed)
       VexGuestExtents* vge,
       IRType gWordTy, IRType hWordTy);
 
+/* Returns Vg_VgdbNo if VG_(instrument_for_gdbserver_if_needed) would
+   leave a block with extents vge unchanged, otherwise the kind of
+   instrumentation it would add. */
+extern VgVgdb VG_(gdbserver_instrumentation_needed) (VexGuestExtents* vge);
+
 /* reason for which gdbserver connection must be finished */
 typedef
    enum {
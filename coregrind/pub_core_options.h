@@ -160,6 +160,9 @@ extern Char* VG_(clo_sim_hints);
 extern Bool VG_(clo_sym_offsets);
 /* Read DWARF3 variable info even if tool doesn't ask for it? */
 extern Bool VG_(clo_read_var_info);
+/* Leave an object's DWARF line number and variable info unread until
+   something asks about an address in it?  Default: NO */
+extern Bool VG_(clo_lazy_debuginfo);
 /* Which prefix to strip from full source file paths, if any. */
 extern Char* VG_(clo_prefix_to_strip);
 
@@ -238,6 +241,27 @@ typedef
    auto-detected. */
 extern VgSmc VG_(clo_smc_check);
 
+/* Directory in which to save translations for reuse by later runs, or
+   NULL.  See m_transcache.c. */
+extern HChar* VG_(clo_translation_cache);
+
+/* Number of sectors the translation cache is divided into.  Each
+   holds up to about 42000 translations; when all are full, the oldest
+   is recycled. */
+#define MIN_N_SECTORS 2
+#define MAX_N_SECTORS 24
+#define N_SECTORS_DEFAULT 8
+extern Int VG_(clo_num_transtab_sectors);
+
+/* Average size of a translation, in bytes, to size the sectors for.
+   0 means use the tool's VG_(details).avg_translation_sizeB. */
+#define MAX_AVG_TRANSTAB_ENTRY_SZB 4000
+extern Int VG_(clo_avg_transtab_entry_size);
+
+/* Keep the most used translations of a sector when it is recycled?
+   Costs an entry count on every block run. */
+extern Bool VG_(clo_keep_hot_translations);
+
 /* String containing comma-separated names of minor kernel variants,
    so they can be properly handled by m_syswrap. */
 extern HChar* VG_(clo_kernel_variant);
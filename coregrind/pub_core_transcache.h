@@ -0,0 +1,65 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Persistent translation cache.          pub_core_transcache.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_TRANSCACHE_H
+#define __PUB_CORE_TRANSCACHE_H
+
+//--------------------------------------------------------------------
+// PURPOSE: This module saves translations made for code in ELF objects
+// with a build-id to the directory given by --translation-cache, and
+// hands them back to m_translate in later runs so that it needn't
+// call Vex again.  A saved translation is only reused if the object,
+// its load address, the tool and its options are all the same as when
+// it was made, and the guest code it was made from is unchanged.
+//--------------------------------------------------------------------
+
+/* Find a saved translation of the block at NRADDR (redirected to
+   ADDR).  If there is one, copies its host code to HOST (of HOST_SIZE
+   bytes) and returns True, with *VGE, *HOST_USED and *N_SC_EXTENTS
+   set as LibVEX_Translate would have set them. */
+extern Bool VG_(transcache_lookup) ( Addr64 nraddr, Addr64 addr,
+                                     /*OUT*/VexGuestExtents* vge,
+                                     /*OUT*/UChar* host, Int host_size,
+                                     /*OUT*/Int* host_used,
+                                     /*OUT*/Int* n_sc_extents );
+
+/* Offer a translation just made by Vex for saving. */
+extern void VG_(transcache_add) ( Addr64 nraddr, Addr64 addr,
+                                  VexGuestExtents* vge,
+                                  UChar* host, Int host_used,
+                                  Int n_sc_extents );
+
+/* Write out any translations not yet saved.  Called at exit. */
+extern void VG_(transcache_flush) ( void );
+
+extern void VG_(print_transcache_stats) ( void );
+
+#endif   // __PUB_CORE_TRANSCACHE_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -37,6 +37,7 @@
 // enabling fast look-ups of them.
 //--------------------------------------------------------------------
 
+#include "pub_tool_transtab.h"
 #include "pub_core_transtab_asm.h"
 
 /* The fast-cache for tt-lookup, and for finding counters.  Unused
@@ -69,8 +70,13 @@ extern Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
                                    Addr64        guest_addr, 
                                    Bool          upd_cache );
 
-extern void VG_(discard_translations) ( Addr64 start, ULong range,
-                                        HChar* who );
+/* A direct exit, whose patchable code is at from_place, has just
+   called the dispatcher's chain-me stub on its way to guest address
+   to_guest.  If to_guest has been translated, make the exit jump
+   straight there from now on, and return True.  Else return False, in
+   which case it must be translated; the exit will be chained when it
+   is next taken. */
+extern Bool VG_(tt_tc_do_chaining) ( void* from_place, Addr64 to_guest );
 
 extern void VG_(print_tt_tc_stats) ( void );
 
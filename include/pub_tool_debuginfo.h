@@ -184,6 +184,10 @@ typedef  struct _DebugInfo  DebugInfo;
    debug info is present or not. */
 DebugInfo* VG_(find_DebugInfo) ( Addr a );
 
+/* Returns NULL if there is no DebugInfo with the given handle, as passed
+   to the new_mem_mmap and new_mem_startup trackers. */
+DebugInfo* VG_(find_DebugInfo_by_handle) ( ULong di_handle );
+
 /* Fish bits out of DebugInfos. */
 Addr          VG_(DebugInfo_get_text_avma)   ( const DebugInfo *di );
 SizeT         VG_(DebugInfo_get_text_size)   ( const DebugInfo *di );
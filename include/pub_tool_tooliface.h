@@ -468,6 +468,13 @@ extern void VG_(needs_xml_output) ( void );
    function here. */
 extern void VG_(needs_final_IR_tidy_pass) ( IRSB*(*final_tidy)(IRSB*) );
 
+/* Can translations made with this tool's instrumentation be saved and
+   reused by later runs (--translation-cache)?  Only say so if the
+   instrumentation of a block depends on nothing but its guest code and
+   the tool's options: it mustn't refer to anything in the tool's heap,
+   nor record anything about the block at instrumentation time. */
+extern void VG_(needs_persistent_translations) ( void );
+
 
 /* ------------------------------------------------------------------ */
 /* Core events to track */
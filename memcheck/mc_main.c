@@ -6048,6 +6048,9 @@ static void mc_pre_clo_init(void)
                                    mc_fini);
 
    VG_(needs_final_IR_tidy_pass)  ( MC_(final_tidy) );
+   /* Origin tracking's stack tags stop the core reusing translations
+      when they're in use; see m_transcache.c. */
+   VG_(needs_persistent_translations) ();
 
 
    VG_(needs_core_errors)         ();
@@ -0,0 +1,60 @@
+/* Check that a fault on the first insn of a block reports the right
+   RIP when the block was entered along a chained direct exit, which
+   bypasses the dispatcher and so its update of the guest RIP. */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <ucontext.h>
+
+typedef unsigned long long int ULong;
+
+extern ULong load_first ( ULong* p );
+__asm__(
+   ".text\n"
+   ".globl load_first\n"
+   "load_first:\n"
+   "\tmovq (%rdi), %rax\n"
+   "\tret\n"
+);
+
+static sigjmp_buf env;
+static ULong fault_rip;
+static ULong x = 1, sum = 0;
+
+static void handler ( int sig, siginfo_t* si, void* uc_v )
+{
+   ucontext_t* uc = (ucontext_t*)uc_v;
+   fault_rip = (ULong)uc->uc_mcontext.gregs[REG_RIP];
+   siglongjmp(env, 1);
+}
+
+int main ( void )
+{
+   struct sigaction sa;
+   ULong* volatile ptrs[2];
+   int i;
+
+   sa.sa_sigaction = handler;
+   sa.sa_flags = SA_SIGINFO;
+   sigemptyset(&sa.sa_mask);
+   sigaction(SIGSEGV, &sa, NULL);
+
+   ptrs[0] = &x;
+   ptrs[1] = NULL;
+
+   /* The same call site runs many times, so its direct exit to
+      load_first is chained long before the last, faulting, call. */
+   if (sigsetjmp(env, 1) == 0) {
+      for (i = 0; i < 10000; i++)
+         sum += load_first(ptrs[i == 9999]);
+      printf("no fault\n");
+      return 1;
+   }
+
+   printf("sum = %llu\n", sum);
+   printf("fault at load_first: %s\n",
+          fault_rip == (ULong)&load_first ? "yes" : "no");
+   return 0;
+}
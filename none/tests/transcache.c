@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Run with --trace-children=yes and --translation-cache, this execs
+   itself once, so that the second run can reuse the translations
+   which the first one saved.  Both runs must print the same. */
+
+static int cmp ( const void* a, const void* b )
+{
+   return *(const int*)a - *(const int*)b;
+}
+
+int main ( int argc, char** argv )
+{
+   int          a[1000];
+   int          i;
+   unsigned int h = 0;
+
+   for (i = 0; i < 1000; i++)
+      a[i] = (i * 7919) % 1000;
+   qsort(a, 1000, sizeof(int), cmp);
+   for (i = 0; i < 1000; i++)
+      h = h * 31 + a[i];
+   printf("sorted, hash %08x\n", h);
+   fflush(stdout);
+
+   if (argc == 1) {
+      execl(argv[0], argv[0], "again", (char*)NULL);
+      perror("execl");
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,52 @@
+// Stresses the lookup of the heap block containing an accessed address,
+// which Privgrind does on every load and store.  The argument gives the
+// (approximate) number of live heap blocks packed into each 4KB page.  The
+// number of blocks and the number of accesses are the same for every
+// setting, so the run times can be compared directly to see how the lookup
+// cost grows with the number of objects per page.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NOBJS   16384
+
+#define NITERS  1000
+
+// Per-block overhead (allocator header plus tool redzones) assumed when
+// sizing the blocks.
+#define OVERHEAD 32
+
+long* arr[NOBJS];
+
+int main ( int argc, char* argv[] )
+{
+   int i, j, per_page, nbytes;
+   long sum = 0;
+
+   per_page = ( argc > 1 ? atoi(argv[1]) : 1 );
+   if (per_page < 1)
+      per_page = 1;
+   nbytes = 4096 / per_page - OVERHEAD;
+   if (nbytes < (int)sizeof(long))
+      nbytes = sizeof(long);
+
+   printf("allocating %d blocks of %d bytes\n", NOBJS, nbytes);
+   for (i = 0; i < NOBJS; i++) {
+      arr[i] = malloc(nbytes);
+      arr[i][0] = i;
+   }
+
+   printf("running\n");
+   for (j = 0; j < NITERS; j++) {
+      for (i = 0; i < NOBJS; i++) {
+         arr[i][0] += j;
+         sum += arr[i][0];
+      }
+   }
+
+   for (i = 0; i < NOBJS; i++)
+      free(arr[i]);
+
+   printf("done (%ld)\n", sum);
+   return 0;
+}
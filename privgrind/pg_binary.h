@@ -0,0 +1,58 @@
+/*--------------------------------------------------------------------*/
+/*--- Privgrind: The Priv-seperation Valgrind tool.    pg_binary.h ---*/
+/*--------------------------------------------------------------------*/
+
+/* Layout of the --output-format=binary dump, shared by the tool and by
+ * auxprogs/pg_convert.c, which turns it back into the JSON dump.
+ *
+ * All integers are LEB128 varints: 'u' ones unsigned, 's' ones zigzag
+ * signed.  Fields marked 'delta' hold the difference from the same field
+ * of the previous record in that section (starting from 0).
+ *
+ *   header:     PG_BIN_MAGIC, u version, u flags
+ *   strings:    u count, then count times { u len, len bytes };
+ *               string 0 is always "" and stands for a missing name
+ *   functions:  { u PG_BIN_RECORD, u id, u fnname, u filename, then
+ *                   without PG_BIN_FOLDED: u base, u n
+ *                                          (iterations base+n..base+1)
+ *                   with PG_BIN_FOLDED:    u n,
+ *                                          n times { u iteration, u count }
+ *               } ... u PG_BIN_END
+ *   calls:      { u PG_BIN_RECORD, u source_id, s source_iteration delta,
+ *                 u target_id, s target_iteration delta, u thread }
+ *               ... u PG_BIN_END
+ *   locations:  { u PG_BIN_RECORD, s id (the address) delta }
+ *               ... u PG_BIN_END
+ *   sites:      { u PG_BIN_RECORD, u id (the allocation site), u size }
+ *               ... u PG_BIN_END
+ *   accesses:   { u PG_BIN_RECORD, u source_id, s source_iteration delta,
+ *                 s target_id delta, u bytes_read, u bytes_written,
+ *                 u thread
+ *               | u PG_BIN_SITE_RECORD, u source_id,
+ *                 s source_iteration delta, u target_site, u bytes_read,
+ *                 u bytes_written, u thread }
+ *               ... u PG_BIN_END
+ *
+ * Record ids in the calls and accesses sections are implicit: they count
+ * up from 0 in file order, as in the JSON dump.  Sections are terminated
+ * rather than counted so that calls, and the locations and accesses of
+ * objects, can be written out as they are done with.
+ */
+
+#ifndef __PG_BINARY_H
+#define __PG_BINARY_H
+
+#define PG_BIN_MAGIC        "PGB\n"
+#define PG_BIN_MAGIC_LEN    4
+#define PG_BIN_VERSION      4
+
+/* Header flags */
+#define PG_BIN_FOLDED       1   /* written with --fold-iterations=yes */
+#define PG_BIN_ALLOC_SITES  2   /* written with --aggregate-by=alloc-site */
+
+/* Section markers */
+#define PG_BIN_END          0
+#define PG_BIN_RECORD       1
+#define PG_BIN_SITE_RECORD  2   /* an access to an allocation site */
+
+#endif /* __PG_BINARY_H */
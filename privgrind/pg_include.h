@@ -15,9 +15,10 @@
 #include "pub_tool_machine.h"
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_hashtable.h"
+#include "pub_tool_xarray.h"
 #include "valgrind.h"
 
-#define FN_LENGTH   100
+#define FN_LENGTH   1024
 #define FILENAME_LENGTH 100
 #define DIRNAME_LENGTH  512
 #define UNKNOWN_FUNC_ID 0
@@ -27,16 +28,20 @@
 /* This is set the same as memcheck, but might not need be as large */
 #define PG_MALLOC_REDZONE_SZB    16
 
-/* This describes a function. Nb: first two fields must match core's
- * VgHashNode. */
-typedef 
-    struct _PG_Calls {
-       struct _PG_Calls * next;
-       UWord              target_id;
-	   unsigned int		  iteration;
-       struct _PG_Calls * ll_next;
-    }
-    PG_Calls;
+/* This describes a run of calls made by a function in thread tid.  Call
+ * 'k' of the run (0 <= k < run) was made during iteration caller_iter+k of
+ * the caller and started iteration target_iter+k of target_id.  A caller
+ * calling the same target once per iteration thus needs only one
+ * PG_CallEdge. */
+typedef
+   struct {
+      UWord             target_id;
+      UInt              caller_iter;
+      UInt              target_iter;
+      UInt              run;
+      ThreadId          tid;
+   }
+   PG_CallEdge;
 
 /* This describes a function. Nb: first two fields must match core's
  * VgHashNode. */
@@ -49,65 +54,97 @@ typedef
       Char *            dirname;
       UWord             id;
       unsigned int		iteration;
-      struct _PG_CallHistory* call_history;		
+      unsigned int      epoch_iter;     /* iteration at the last boundary */
+      Bool              instrumented;   /* see PG_(instrument_func) */
+      XArray*           calls;          /* of PG_CallEdge, in call order */
+      /* Only used with --fold-iterations: */
+      struct _PG_Access* iter_accesses; /* made in the current iteration */
+      VgHashTable       iter_classes;   /* of PG_IterClass */
+      XArray*           iter_map;       /* of PG_IterRun */
    }
    PG_Func;
-   
-/* This describes call history. */
+
+/* This describes a class of iterations of a function with the same
+ * signature (callees, objects accessed and bytes read and written).  Only
+ * the records of the first iteration of the class, 'rep', are kept.  The
+ * classes whose signatures hash alike are linked in a ring through
+ * same_key.  Nb: first two fields must match core's VgHashNode. */
 typedef
-	struct _PG_CallHistory {
-		struct _PG_CallHistory* 	next;
-		VgHashTable					calls_ht;
-	}
-	PG_CallHistory;
+   struct _PG_IterClass {
+      struct _PG_IterClass* next;
+      UWord             key;            /* hash of the signature */
+      UInt              rep;
+      ULong             count;
+      struct _PG_IterClass* same_key;
+      UWord             sig_len;
+      UWord*            sig;            /* allocated along with the class */
+   }
+   PG_IterClass;
 
-/* This describes access to a data object. Nb: first two fields must match 
- * core's VgHashNode. */
+/* This maps iterations first .. first+n-1 of a function onto iteration
+ * 'rep' of the same class, or onto themselves if rep is zero. */
 typedef
-   struct _PG_PageRange {
-      struct _PG_PageRecord*  next;
-      Addr page_addr;
-      struct _PG_DataObj*  first;
+   struct {
+      UInt              first;
+      UInt              n;
+      UInt              rep;
    }
-   PG_PageRange;
+   PG_IterRun;
 
-/* This describes access to a data object */
+/* This describes a data object.  Live objects are kept in an interval
+ * tree keyed on [addr, addr+size); 'next' links objects once they have
+ * been freed. */
 typedef
    struct _PG_DataObj {
       struct _PG_DataObj*  next;
-      struct _PG_DataObj*  prev;
       Addr              addr;  
       SizeT             size;  
+      UInt              id;             /* in the shadow map */
+      UWord             ecu;            /* allocation site of a heap block
+                                           when folding, else 0 */
       VgHashTable       access_ht;
+      struct _PG_DataObj*  site;        /* see PG_(dataobj_alloc_site) */
    }
    PG_DataObj;
 
+/* The accesses made to a data object by one function in one thread, most
+ * recent iteration first along ll_next.  Nb: first two fields must match
+ * core's VgHashNode. */
 typedef
    struct _PG_Access {
       struct _PG_Access*  next;
+      UWord               key;        /* func_id * VG_N_THREADS + tid */
       UWord               func_id;
       unsigned int		  iteration;
+      ThreadId            tid;
       UWord               bytes_read;
       UWord               bytes_written;
       struct _PG_Access*  ll_next;
+      struct _PG_DataObj* obj;        /* only with --fold-iterations */
+      struct _PG_Access*  iter_next;  /* ditto */
    }
    PG_Access;
 
-static inline UWord hash_sdbm(Char *str)
-{
-  HWord hash = 0;
-  int c;
-
-  while ((c = *str++) != 0)
-    hash = c + (hash << 6) + (hash << 16) - hash;
-  
-  return hash;
-}
-
 /* pg_main.c */
 PG_DataObj * PG_(dataobj_node_malloced)( Addr addr, SizeT size );
+void PG_(dataobj_alloc_site)( PG_DataObj * obj, ThreadId tid );
 void PG_(dataobj_node_freed)( Addr addr );
+void PG_(dataobj_node_moved)( PG_DataObj * obj, Addr addr, SizeT size );
 PG_DataObj * PG_(dataobj_get_node)( Addr addr );
+void PG_(drain_events)( void );
+Bool PG_(instrument_func)( Char* fnname, Addr addr );
+
+/* pg_shadow.c */
+/* Shadow map chunks are 2^PG_SHADOW_CHUNK_BITS bytes. */
+#define PG_SHADOW_CHUNK_BITS   16
+#define PG_SHADOW_CHUNK_SLOTS  (1 << 16)
+extern UInt PG_(shadow_chunk_live)[PG_SHADOW_CHUNK_SLOTS];
+void        PG_(shadow_init)        ( void );
+void        PG_(shadow_insert)      ( PG_DataObj* obj );
+void        PG_(shadow_remove)      ( PG_DataObj* obj );
+PG_DataObj* PG_(shadow_lookup)      ( Addr a, Bool* shared );
+void        PG_(shadow_print_stats) ( void );
+void        PG_(shadow_destroy)     ( void );
 
 /* pg_malloc_wrappers.c */
 void* PG_(malloc) (ThreadId tid, SizeT size);
@@ -121,9 +158,33 @@ void PG_(__builtin_vec_delete) (ThreadId tid, void* addr);
 void* PG_(realloc) (ThreadId tid, void* addr, SizeT new_size);
 SizeT PG_(malloc_usable_size) (ThreadId tid, void* addr);
 
+/* pg_pool.c */
+typedef struct _PG_Pool PG_Pool;
+extern PG_Pool* PG_(access_pool);
+extern PG_Pool* PG_(dataobj_pool);
+void  PG_(init_pools) ( void );
+void  PG_(print_pool_stats) ( void );
+void  PG_(destroy_pools) ( void );
+void* PG_(pool_alloc) ( PG_Pool* pool );
+void  PG_(pool_free) ( PG_Pool* pool, void* elem );
+void  PG_(destroy_pooled_ht) ( VgHashTable ht );
+
+/* pg_output.c */
+typedef struct _PG_Writer PG_Writer;
+PG_Writer* PG_(writer_open) ( Char* filename );
+void PG_(writer_write) ( PG_Writer* w, const void* p, SizeT n );
+void PG_(writer_printf) ( PG_Writer* w, const HChar* format, ... );
+void PG_(writer_uvarint) ( PG_Writer* w, ULong v );
+void PG_(writer_svarint) ( PG_Writer* w, Long v );
+void PG_(writer_append_file) ( PG_Writer* w, Char* filename );
+void PG_(writer_close) ( PG_Writer* w );
+void PG_(writer_abandon) ( PG_Writer* w );
+
 /* pg_util.c */
 void initUnknownFunc(VgHashTable func_ht);
 UWord getFuncId( Addr addr, VgHashTable func_ht);
+void discardFuncRanges( Addr addr, SizeT len );
+void destroyFuncIndex( void );
 Addr irConstToAddr(IRConst * con);
 PG_Func * getFunc(UWord func_id);
 
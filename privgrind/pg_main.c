@@ -8,34 +8,112 @@
 #include "pub_tool_vki.h"
 #include "pub_tool_libcfile.h"
 #include "pub_tool_libcprint.h"
+#include "pub_tool_libcproc.h"
+#include "pub_tool_threadstate.h"
 
 #include <string.h>
 #include "pg_include.h"
+#include "pg_binary.h"
+#include "privgrind.h"
 #include "pub_tool_xarray.h"    
 #include "pub_tool_debuginfo.h"    
+#include "pub_tool_wordfm.h"
+#include "pub_tool_seqmatch.h"
+#include "pub_tool_stacktrace.h"
+#include "pub_tool_execontext.h"
+#include "pub_tool_transtab.h"
 
 static Bool clo_json       = True;
+static Bool clo_binary     = False;
 static Char* clo_json_file = "data.json";
 static Char* clo_boundary_fun = 0;
 static Bool clo_trace_mem       = True;
 static Bool clo_trace_calls     = True;
+static Bool clo_trace_at_start  = True;
+static Long clo_batch_events    = 0;
+static Bool clo_fold_iterations = False;
+static Bool clo_by_site         = False;
+static Long clo_site_depth      = 4;
+#define PG_MAX_SITE_DEPTH  50     /* as the core's VG_DEEPEST_BACKTRACE */
+static UInt clo_sample_mem      = 1;
+static UInt clo_sample_blocks   = 1;
+
+/* Glob patterns (of Char*) from --instrument-objs and friends, or NULL */
+static XArray* clo_instrument_objs = NULL;
+static XArray* clo_instrument_fns  = NULL;
+static XArray* clo_exclude_objs    = NULL;
+static XArray* clo_exclude_fns     = NULL;
+
+/* Add the comma-separated patterns in 'list' to *pats. */
+static void add_patterns ( XArray** pats, Char* list )
+{
+   Char *pat, *save;
+   list = VG_(strdup)( "pg.patterns", list );
+   if (*pats == NULL) {
+      *pats = VG_(newXA)( VG_(malloc), "pg.patterns", VG_(free),
+                          sizeof(Char*) );
+   }
+   for (pat = VG_(strtok_r)( list, ",", &save ); pat != NULL;
+        pat = VG_(strtok_r)( NULL, ",", &save )) {
+      VG_(addToXA)( *pats, &pat );
+   }
+}
 
+/* Parse a sampling rate given as "1/<n>" (or just "<n>"). */
+static Bool parse_sample_rate ( Char* s, UInt* period )
+{
+   Char* end;
+   Long  n;
+   if (VG_(strncmp)(s, "1/", 2) == 0) s += 2;
+   n = VG_(strtoll10)(s, &end);
+   if (end == s || *end != '\0' || n < 1 || n > 1000000000) return False;
+   *period = (UInt)n;
+   return True;
+}
 
-static VgHashTable func_ht;
-static VgHashTable live_ht;
-static PG_PageRange   freed_objs;
 
-/* Assume 4 KB pages */
-#define PAGE_SIZE 4096
-#define PAGE_MASK (~0xFFF)
+static VgHashTable func_ht;
+static WordFM*     live_objs;
+static PG_DataObj* freed_objs = NULL;
 
 static Bool pg_process_cmd_line_option(Char* arg)
 {
+   Char* tmp_str;
+
    if 	   VG_BOOL_CLO(arg, "--trace-mem", clo_trace_mem) {}
    else if VG_BOOL_CLO(arg, "--trace-calls", clo_trace_calls) {}
+   else if VG_BOOL_CLO(arg, "--trace-at-start", clo_trace_at_start) {}
+   else if VG_BINT_CLO(arg, "--batch-events", clo_batch_events, 0, 1000000) {}
+   else if VG_BOOL_CLO(arg, "--fold-iterations", clo_fold_iterations) {}
    else if VG_BOOL_CLO(arg, "--json", clo_json) {}
    else if VG_STR_CLO( arg, "--boundary-function", clo_boundary_fun) {}
    else if VG_STR_CLO( arg, "--json-file", clo_json_file) {}
+   else if VG_XACT_CLO(arg, "--output-format=json", clo_binary, False) {}
+   else if VG_XACT_CLO(arg, "--output-format=binary", clo_binary, True) {}
+   else if VG_XACT_CLO(arg, "--aggregate-by=address", clo_by_site, False) {}
+   else if VG_XACT_CLO(arg, "--aggregate-by=alloc-site", clo_by_site, True) {}
+   else if VG_BINT_CLO(arg, "--alloc-site-depth", clo_site_depth,
+                       1, PG_MAX_SITE_DEPTH) {}
+   else if VG_STR_CLO( arg, "--instrument-objs", tmp_str) {
+      add_patterns(&clo_instrument_objs, tmp_str);
+   }
+   else if VG_STR_CLO( arg, "--instrument-fns", tmp_str) {
+      add_patterns(&clo_instrument_fns, tmp_str);
+   }
+   else if VG_STR_CLO( arg, "--exclude-objs", tmp_str) {
+      add_patterns(&clo_exclude_objs, tmp_str);
+   }
+   else if VG_STR_CLO( arg, "--exclude-fns", tmp_str) {
+      add_patterns(&clo_exclude_fns, tmp_str);
+   }
+   else if VG_STR_CLO( arg, "--sample-mem", tmp_str) {
+      if (!parse_sample_rate(tmp_str, &clo_sample_mem))
+         VG_(fmsg_bad_option)(arg, "expected a rate of the form 1/<n>\n");
+   }
+   else if VG_STR_CLO( arg, "--sample-blocks", tmp_str) {
+      if (!parse_sample_rate(tmp_str, &clo_sample_blocks))
+         VG_(fmsg_bad_option)(arg, "expected a rate of the form 1/<n>\n");
+   }
    else return False;
    
    tl_assert(clo_trace_mem || clo_trace_calls);
@@ -45,11 +123,42 @@ static Bool pg_process_cmd_line_option(Char* arg)
 static void pg_print_usage(void)
 {  
    VG_(printf)(
-"    --json=no|yes             emit output in JSON [yes]\n"
+"    --json=no|yes             emit output in JSON [yes]; unless\n"
+"                              --fold-iterations=yes, the summary otherwise\n"
+"                              printed at exit is then left out\n"
 "    --json-file=<file>        JSON output to <file> [data.json]\n"
-"    --boundary-function=<f>   Dump information when entering boundary function\n"
+"    --output-format=json|binary\n"
+"                              write that output as JSON, or in the compact\n"
+"                              binary form read by pg_convert [json]\n"
+"    --aggregate-by=address|alloc-site\n"
+"                              record the accesses to each heap block, or\n"
+"                              to all blocks allocated from the same stack\n"
+"                              together [address]\n"
+"    --alloc-site-depth=<n>    stack frames telling allocation sites apart [4]\n"
+"    --boundary-function=<f>   on each call to <f>, write what was recorded since\n"
+"                              the previous call to <json-file>.<n> and forget it\n"
 "    --trace-mem=no|yes        Trace all memory accesses by function [yes]\n"
 "    --trace-calls=no|yes      Trace all calls made by the calling function [yes]\n"
+"    --trace-at-start=no|yes   Trace from the start, rather than from the first\n"
+"                              PRIVGRIND_START_TRACING client request [yes]\n"
+"    --batch-events=<n>        Buffer up to <n> memory events before recording\n"
+"                              them; 0 records each event immediately [0]\n"
+"    --fold-iterations=no|yes  Merge function iterations with the same calls\n"
+"                              and data accesses into one counted record;\n"
+"                              stops when a second thread starts [no]\n"
+"    --instrument-objs=<glob,...>  only instrument code in objects whose path\n"
+"                              or file name matches one of the globs [all]\n"
+"    --instrument-fns=<glob,...>   only instrument functions matching one of\n"
+"                              the globs [all]\n"
+"    --exclude-objs=<glob,...>     don't instrument code in matching objects\n"
+"    --exclude-fns=<glob,...>      don't instrument matching functions\n"
+"                              Accesses made by code not instrumented are\n"
+"                              put down to the function that called into it\n"
+"    --sample-mem=1/<n>        Record one in <n> memory accesses of each thread,\n"
+"                              scaling their byte counts up by <n> [1/1]\n"
+"    --sample-blocks=1/<n>     Record the memory accesses of one in <n>\n"
+"                              superblock executions of each thread, scaling\n"
+"                              their byte counts up by <n> [1/1]\n"
    );
 }
 
@@ -60,10 +169,219 @@ static void pg_print_debug_usage(void)
    );
 }
 
+static Word cmp_intervals_DataObj ( UWord key1, UWord key2 );
+
+/* One buffered memory event.  'info' packs the function id, the access
+   size and the EventKind; see mkBatchInfo. */
+typedef
+   struct {
+      Addr   addr;
+      UWord  info;
+   }
+   BatchRec;
+
+#define BATCH_KIND_BITS   2
+#define BATCH_SIZE_BITS   10
+#define BATCH_FUNC_SHIFT  (BATCH_KIND_BITS + BATCH_SIZE_BITS)
+
+static BatchRec* batch_buf  = NULL;
+static UWord     batch_used = 0;
+
+static void pg_json_location( PG_Writer* w, PG_DataObj* addr );
+static void pg_json_call( PG_Writer* w, PG_Func* func, PG_CallEdge* call );
+static void pg_json_accesses( PG_Writer* w, PG_DataObj* addr, Bool site );
+static void pg_json_stream_discard( void );
+static void pg_write_json( UInt epoch );
+static void init_sampling( void );
+
+/* Whether code is being instrumented; see PRIVGRIND_START_TRACING.
+   Translations made before a change are discarded, so code runs
+   uninstrumented while tracing is off.  Heap blocks and globals are
+   still tracked then, as later accesses need them. */
+static Bool tracing = True;
+
+/* Whether iterations are still being folded; see finish_iteration */
+static Bool folding = False;
+
+/* With --json=yes, an object's locations and accesses records are
+   written out as soon as it is freed, and a function's calls records as
+   soon as its call log can no longer extend them (see record_call), to
+   temporary files next to the JSON file which pg_write_json copies in at
+   exit.  The object and the call edge are then released, so a long run
+   no longer holds every freed object and every call in memory; functions
+   only keep counters of their iterations.  --fold-iterations rewrites
+   iterations when an iteration finishes, so it keeps everything until
+   exit as before. */
+static Bool       stream_objs       = False;
+static PG_Writer* stream_locs       = NULL;
+static PG_Writer* stream_accs       = NULL;
+static PG_Writer* stream_calls      = NULL;
+static Char*      stream_locs_file  = NULL;
+static Char*      stream_accs_file  = NULL;
+static Char*      stream_calls_file = NULL;
+static UInt       json_access_id    = 0;
+static UInt       json_call_id      = 0;
+
+static Char* pg_json_stream_name( const Char* suffix )
+{
+  Char* json_file = VG_(expand_file_name)("--json-file", clo_json_file);
+  Char* name = VG_(malloc)("pg.stream_name",
+                           VG_(strlen)(json_file) + VG_(strlen)(suffix) + 1);
+  VG_(sprintf)(name, "%s%s", json_file, suffix);
+  VG_(free)(json_file);
+  return name;
+}
+
+static void pg_json_stream_open( void )
+{
+  stream_locs_file  = pg_json_stream_name(".locations.tmp");
+  stream_accs_file  = pg_json_stream_name(".accesses.tmp");
+  stream_calls_file = pg_json_stream_name(".calls.tmp");
+  stream_locs  = PG_(writer_open)(stream_locs_file);
+  stream_accs  = PG_(writer_open)(stream_accs_file);
+  stream_calls = PG_(writer_open)(stream_calls_file);
+  if (stream_locs == NULL || stream_accs == NULL || stream_calls == NULL) {
+    VG_(umsg)("warning: can't open temporary JSON file '%s'\n",
+              stream_locs == NULL ? stream_locs_file
+              : stream_accs == NULL ? stream_accs_file : stream_calls_file);
+    VG_(umsg)("         ... so freed objects and calls will be kept "
+              "until exit.\n");
+    pg_json_stream_discard();
+    stream_objs = False;
+  }
+}
+
+/* Drop the temporary files, e.g. after they have been copied in. */
+static void pg_json_stream_discard( void )
+{
+  if (stream_locs) PG_(writer_close)(stream_locs);
+  if (stream_accs) PG_(writer_close)(stream_accs);
+  if (stream_calls) PG_(writer_close)(stream_calls);
+  stream_locs = stream_accs = stream_calls = NULL;
+  if (stream_locs_file) {
+    VG_(unlink)(stream_locs_file);
+    VG_(free)(stream_locs_file);
+  }
+  if (stream_accs_file) {
+    VG_(unlink)(stream_accs_file);
+    VG_(free)(stream_accs_file);
+  }
+  if (stream_calls_file) {
+    VG_(unlink)(stream_calls_file);
+    VG_(free)(stream_calls_file);
+  }
+  stream_locs_file = stream_accs_file = stream_calls_file = NULL;
+}
+
+/* A forked child starts with its own --json-file name (if it contains
+   %p), so it must not flush or delete the parent's temporary files. */
+static void pg_json_stream_atfork_child( ThreadId tid )
+{
+  if (stream_locs) PG_(writer_abandon)(stream_locs);
+  if (stream_accs) PG_(writer_abandon)(stream_accs);
+  if (stream_calls) PG_(writer_abandon)(stream_calls);
+  stream_locs = stream_accs = stream_calls = NULL;
+  if (stream_locs_file) VG_(free)(stream_locs_file);
+  if (stream_accs_file) VG_(free)(stream_accs_file);
+  if (stream_calls_file) VG_(free)(stream_calls_file);
+  stream_locs_file = stream_accs_file = stream_calls_file = NULL;
+}
+
+/* Return an object's access nodes to their pool. */
+static void release_accesses( PG_DataObj* obj )
+{
+  VgHashNode** heads;
+  PG_Access *access, *next;
+  UInt i, n;
+
+  if (obj->access_ht == NULL) return;
+  heads = VG_(HT_to_array)(obj->access_ht, &n);
+  for (i = 0; i < n; i++) {
+    access = (PG_Access*)heads[i];
+    VG_(HT_remove)(obj->access_ht, access->key);
+    while (access != NULL) {
+      next = access->ll_next;
+      PG_(pool_free)(PG_(access_pool), access);
+      access = next;
+    }
+  }
+  if (heads) VG_(free)(heads);
+  VG_(HT_destruct)(obj->access_ht);
+  obj->access_ht = NULL;
+}
+
+/* Return an object and its access nodes to their pools. */
+static void release_obj( PG_DataObj* obj )
+{
+  release_accesses(obj);
+  PG_(pool_free)(PG_(dataobj_pool), obj);
+}
+
+/* Write out and release a freed object if streaming.  Returns False if
+   the object must be kept for output at exit. */
+static Bool pg_json_stream_obj( PG_DataObj* obj )
+{
+  if (!stream_objs) return False;
+  if (stream_locs == NULL) pg_json_stream_open();
+  if (!stream_objs) return False;
+
+  pg_json_location(stream_locs, obj);
+  pg_json_accesses(stream_accs, obj, False);
+  release_obj(obj);
+  return True;
+}
+
+/* Write out a call edge of func that its call log is done with, if
+   streaming.  Returns False if the edge must be kept for output at
+   exit. */
+static Bool pg_json_stream_call( PG_Func* func, PG_CallEdge* call )
+{
+  if (!stream_objs) return False;
+  if (stream_locs == NULL) pg_json_stream_open();
+  if (!stream_objs) return False;
+
+  pg_json_call(stream_calls, func, call);
+  return True;
+}
+
 static void pg_post_clo_init(void)
 {
+   PG_(init_pools)();
+   PG_(shadow_init)();
+
    func_ht = VG_(HT_construct) ( "func_hash" );
-   live_ht = VG_(HT_construct) ( "data_addr_hash" );
+   live_objs = VG_(newFM) ( VG_(malloc), "pg.live_objs", VG_(free),
+                            cmp_intervals_DataObj );
+
+   if (clo_batch_events > 0) {
+      /* One spare slot, for the second record of a span; see
+         addBatchedRecs */
+      batch_buf = VG_(malloc) ( "pg.batch_buf",
+                                (clo_batch_events + 1) * sizeof(BatchRec) );
+   }
+
+   if (clo_boundary_fun != NULL && clo_fold_iterations) {
+      VG_(fmsg_bad_option)("--boundary-function",
+                           "can't be combined with --fold-iterations\n");
+   }
+
+   if ((clo_sample_mem > 1 || clo_sample_blocks > 1) && clo_batch_events > 0) {
+      VG_(fmsg_bad_option)("--sample-mem/--sample-blocks",
+                           "can't be combined with --batch-events\n");
+   }
+   init_sampling();
+
+   /* Stream calls and freed objects out to the JSON file as they go */
+   stream_objs = clo_json && !clo_fold_iterations;
+   folding = clo_fold_iterations;
+   VG_(atfork)(NULL, NULL, pg_json_stream_atfork_child);
+
+   tracing = clo_trace_at_start;
+
+   /* Every call must end a superblock, to be seen; see stack_push */
+   if (clo_trace_calls) {
+      VG_(clo_vex_control).guest_chase_thresh = 0;
+   }
 
    /* Add a node for unknown functions */
    initUnknownFunc(func_ht);
@@ -74,129 +392,426 @@ static void pg_post_clo_init(void)
 /*--- Stuff for --trace-mem                                ---*/
 /*------------------------------------------------------------*/
 
-static void insertNode( PG_PageRange* page_node, PG_DataObj * insert_node ) 
-{
-  PG_DataObj *curr, *prev;
-  insert_node->prev = NULL;
-  insert_node->next = NULL;
-  /* TODO: replace this with a binary search */
-  curr = page_node->first;
-  prev = NULL;
-  for (;;) {
-    if (curr == NULL || curr->addr >= insert_node->addr) {
-      if (curr == page_node->first) {
-	/* insert at front */
-	insert_node->next = page_node->first;
-	page_node->first = insert_node;
-	break;
-      } else if (curr == NULL) {
-	/* insert at the end */
-	tl_assert(prev != NULL); // should have been inserted at the front
-	prev->next = insert_node;
-	insert_node->prev = prev;
-	break;
-      } else {
-	/* insert inbetween prev and curr */
-	insert_node->prev = prev;
-	insert_node->next = curr;
-	curr->prev = insert_node;
-	prev->next = insert_node;
-	break;
-      }
+/* Live data objects are held in an AVL tree (WordFM) ordered by address
+   range.  Objects never overlap, so a lookup with the one-byte interval
+   [a,a+1) finds the object containing 'a', if any, in O(log n).  Lookups
+   go to the shadow map (pg_shadow.c) first, which answers in O(1) unless
+   several objects share the 8-byte granule holding 'a'. */
+
+/* Zero-sized objects still occupy one byte of the index, so that they can
+   be found and removed again. */
+static inline SizeT obj_extent ( SizeT size )
+{
+  return size == 0 ? 1 : size;
+}
+
+/* Compare the intervals [a1,a1+n1) and [a2,a2+n2).  Return -1 if the
+   first interval is lower, 1 if the first interval is higher, and 0
+   if there is any overlap. */
+static Word cmp_intervals_DataObj ( UWord key1, UWord key2 )
+{
+  PG_DataObj * obj1 = (PG_DataObj *) key1;
+  PG_DataObj * obj2 = (PG_DataObj *) key2;
+  UWord a1w = (UWord)obj1->addr;
+  UWord n1w = (UWord)obj_extent(obj1->size);
+  UWord a2w = (UWord)obj2->addr;
+  UWord n2w = (UWord)obj_extent(obj2->size);
+  if (a1w + n1w <= a2w) return -1L;
+  if (a2w + n2w <= a1w) return 1L;
+  return 0;
+}
+
+/* Find the live object holding 'addr', if any. */
+static PG_DataObj * lookupNode ( Addr addr )
+{
+  UWord keyW, valW;
+  PG_DataObj key;
+  Bool shared;
+  PG_DataObj * obj = PG_(shadow_lookup)( addr, &shared );
+  if (!shared) return obj;
+
+  key.addr = addr;
+  key.size = 1;
+  if (VG_(lookupFM)( live_objs, &keyW, &valW, (UWord)&key )) {
+    tl_assert(keyW != (UWord)&key);
+    return (PG_DataObj *) keyW;
+  }
+  return NULL;
+}
+
+static void insertNode ( PG_DataObj * obj )
+{
+  Bool already_present = VG_(addToFM)( live_objs, (UWord)obj, 0 );
+  tl_assert(!already_present);
+  PG_(shadow_insert)( obj );
+}
+
+static void removeNode ( PG_DataObj * obj )
+{
+  UWord oldK, oldV;
+  Bool found = VG_(delFromFM)( live_objs, &oldK, &oldV, (UWord)obj );
+  tl_assert(found);
+  tl_assert(oldK == (UWord)obj);
+  PG_(shadow_remove)( obj );
+}
+
+/*------------------------------------------------------------*/
+/*--- Per-thread state                                     ---*/
+/*------------------------------------------------------------*/
+
+/* Each thread has its own current iteration of every function, so that
+   the calls and accesses of threads running the same function at once
+   are not mixed into one iteration.  Iteration numbers are still handed
+   out by the counter in PG_Func, so they stay unique across threads.
+   Each object's accesses are sharded by function and thread, and the
+   shards are merged when the object is written out. */
+typedef
+   struct {
+      UInt*  cur_iter;       /* indexed by function id */
+      UWord  n_cur_iter;
+      UInt   mem_left;       /* saved sample_mem_left */
+      UInt   blocks_left;    /* saved sample_blocks_left */
+      XArray* stack;         /* of UWord function ids; see stack_push */
+   }
+   ThreadState;
+
+/* The function id the memory events of code that is not instrumented
+   carry, as it has no call helpers to tell which function ran it.
+   update_access puts their accesses down to the nearest instrumented
+   caller, as found by attrib_func.  It is the largest function id a
+   BatchRec can hold. */
+#define ATTRIB_FUNC_ID  (~(UWord)0 >> BATCH_FUNC_SHIFT)
+
+static ThreadState  threads[VG_N_THREADS];
+static ThreadId     cur_tid    = 1;
+static ThreadState* cur_thread = &threads[1];
+
+/* Sampling countdowns of the running thread, which instrumented code
+   reads and writes directly; see mkSampleGuard.  They are swapped in
+   and out of its ThreadState when another thread is scheduled. */
+static UInt sample_mem_left    = 1;
+static UInt sample_blocks_left = 1;
+
+/* How much each sampled access stands for */
+static UWord sample_scale = 1;
+
+static void init_thread_state ( ThreadState* ts )
+{
+  ts->mem_left    = clo_sample_mem;
+  ts->blocks_left = clo_sample_blocks;
+  if (ts->stack != NULL) VG_(dropTailXA)( ts->stack, VG_(sizeXA)( ts->stack ) );
+}
+
+static void init_sampling ( void )
+{
+  ThreadId tid;
+  for (tid = 0; tid < VG_N_THREADS; tid++) {
+    init_thread_state( &threads[tid] );
+  }
+  sample_mem_left    = clo_sample_mem;
+  sample_blocks_left = clo_sample_blocks;
+  sample_scale       = (UWord)clo_sample_mem * clo_sample_blocks;
+}
+
+static void pg_start_client_code ( ThreadId tid, ULong blocks_done )
+{
+  if (tid != cur_tid) {
+    /* Buffered events belong to the thread that made them */
+    PG_(drain_events)();
+    cur_thread->mem_left    = sample_mem_left;
+    cur_thread->blocks_left = sample_blocks_left;
+    cur_tid    = tid;
+    cur_thread = &threads[tid];
+    sample_mem_left    = cur_thread->mem_left;
+    sample_blocks_left = cur_thread->blocks_left;
+  }
+}
+
+static void pg_pre_thread_ll_create ( ThreadId parent, ThreadId child )
+{
+  ThreadState* ts = &threads[child];
+
+  /* Folding finishes an iteration of a function when the next one
+     starts, whichever thread starts it, and relies on the iterations of
+     a function finishing in order; neither holds once a second thread
+     runs.  Keep what has been folded so far and stop folding. */
+  if (folding && parent != VG_INVALID_THREADID) {
+    VG_(umsg)("Warning: thread %d is creating thread %d; "
+              "--fold-iterations=yes only\n", (Int)parent, (Int)child);
+    VG_(umsg)("works for single-threaded clients, "
+              "so later iterations are not folded.\n");
+    folding = False;
+  }
+  if (ts->cur_iter != NULL) {
+    VG_(memset)( ts->cur_iter, 0, ts->n_cur_iter * sizeof(UInt) );
+  }
+  init_thread_state( ts );
+}
+
+static inline UInt thread_iteration ( UWord func_id )
+{
+  return func_id < cur_thread->n_cur_iter ? cur_thread->cur_iter[func_id] : 0;
+}
+
+static void set_thread_iteration ( UWord func_id, UInt iter )
+{
+  ThreadState* ts = cur_thread;
+  if (func_id >= ts->n_cur_iter) {
+    UWord n = ts->n_cur_iter == 0 ? 128 : ts->n_cur_iter;
+    while (n <= func_id) n <<= 1;
+    ts->cur_iter = VG_(realloc)( "pg.cur_iter", ts->cur_iter,
+                                 n * sizeof(UInt) );
+    VG_(memset)( ts->cur_iter + ts->n_cur_iter, 0,
+                 (n - ts->n_cur_iter) * sizeof(UInt) );
+    ts->n_cur_iter = n;
+  }
+  ts->cur_iter[func_id] = iter;
+}
+
+static inline UWord access_key ( UWord func_id, ThreadId tid )
+{
+  return func_id * VG_N_THREADS + tid;
+}
+
+/* Whether more than one function accessed obj; its access_ht holds one
+   chain per function and thread. */
+static Bool obj_shared ( PG_DataObj* obj )
+{
+  PG_Access * access;
+  PG_Access * first = NULL;
+
+  if (obj->access_ht == NULL
+      || VG_(HT_count_nodes) (obj->access_ht) <= 1) return False;
+  VG_(HT_ResetIter)(obj->access_ht);
+  while ( (access = VG_(HT_Next)(obj->access_ht)) ) {
+    if (first == NULL) {
+      first = access;
+    } else if (access->func_id != first->func_id) {
+      return True;
     }
-    prev = curr;
-    curr = curr->next;
   }
+  return False;
 }
 
-static void removeNode ( PG_PageRange* page_node, PG_DataObj * addr_node ) 
+/* A small direct-mapped cache of recent (object, function) hits in
+   update_access.  A hit lets repeated accesses to the same object by the
+   same iteration of a function just bump the counters of the cached access
+   node, skipping the tree lookup and the access_ht lookup.  Entries are
+   indexed on the function id and the address' 256-byte line, and must be
+   invalidated whenever their object is freed or moved. */
+#define ACCESS_CACHE_BITS  6
+#define ACCESS_CACHE_SIZE  (1 << ACCESS_CACHE_BITS)
+
+typedef
+   struct {
+      PG_DataObj*   obj;          /* NULL if the entry is empty */
+      PG_Access*    access;
+      PG_Func*      func;
+      UWord         func_id;
+   }
+   AccessCacheEnt;
+
+static AccessCacheEnt access_cache[ACCESS_CACHE_SIZE];
+
+static inline AccessCacheEnt* access_cache_ent ( Addr addr, UWord func_id )
+{
+  UWord ix = ((addr >> 8) ^ (func_id * 0x9E3779B1UL)) & (ACCESS_CACHE_SIZE-1);
+  return &access_cache[ix];
+}
+
+static void access_cache_invalidate_func ( PG_Func * func )
 {
-  if (addr_node == page_node->first) {
-    page_node->first = addr_node->next;
-  } else if (addr_node->prev != NULL) {
-    addr_node->prev->next = addr_node->next;
+  Int i;
+  for (i = 0; i < ACCESS_CACHE_SIZE; i++) {
+    if (access_cache[i].obj != NULL && access_cache[i].func == func) {
+      access_cache[i].obj = NULL;
+    }
   }
-  if (addr_node->next != NULL) {
-    addr_node->next->prev = addr_node->prev;
+}
+
+static void access_cache_clear ( void )
+{
+  Int i;
+  for (i = 0; i < ACCESS_CACHE_SIZE; i++) {
+    access_cache[i].obj = NULL;
   }
-  addr_node->next = NULL;
-  addr_node->prev = NULL;
 }
 
-static PG_DataObj * getNode ( PG_PageRange* page_node, Addr addr ) 
+static void access_cache_invalidate ( PG_DataObj * obj )
 {
-  PG_DataObj * ret = NULL;
-  /* TODO: replace this with a binary search */
-  ret = page_node->first;
-  while(ret != NULL) {
-    if (addr >= ret->addr && addr < (ret->addr + ret->size)) {
-      return ret;
+  Int i;
+  for (i = 0; i < ACCESS_CACHE_SIZE; i++) {
+    if (access_cache[i].obj == obj) {
+      access_cache[i].obj = NULL;
     }
-    ret = ret->next;
   }
-  return ret;
 }
 
 PG_DataObj * PG_(dataobj_node_malloced)( Addr addr, SizeT size )
 {
-  PG_PageRange* page_node = NULL;
-  PG_DataObj *  addr_node = NULL;
-  /* Lookup page list */
-  Addr page_addr = addr & PAGE_MASK;
-  do {
-    /* create address node */
-    addr_node = VG_(malloc) ("trace_load.addr_node", sizeof(PG_DataObj) );
-    memset(addr_node, 0, sizeof(PG_DataObj));
-    addr_node->addr = addr;
-    addr_node->size = size;
-    addr_node->access_ht = VG_(HT_construct) ( "access_hash" );
-    
-    page_node = VG_(HT_lookup) ( live_ht, page_addr );
-    if (!page_node) {
-      page_node = VG_(malloc) ("trace_load.page_node", sizeof(PG_PageRange) );
-      memset(page_node, 0, sizeof(PG_PageRange));
-      page_node->page_addr = page_addr;
-      VG_(HT_add_node) (live_ht, page_node);
-    }
-    /* Insert node into list */
-    insertNode( page_node, addr_node );
-    
-    page_addr += PAGE_SIZE;
-  } while (page_addr < addr + size);
+  PG_DataObj * addr_node;
+  PG_DataObj   key;
+  UWord        keyW, valW;
+
+  /* Don't let a new object overlap one which is already live; just hand
+     back the existing one instead. */
+  key.addr = addr;
+  key.size = size;
+  if (VG_(lookupFM)( live_objs, &keyW, &valW, (UWord)&key )) {
+    return (PG_DataObj *) keyW;
+  }
+
+  /* create address node */
+  addr_node = PG_(pool_alloc) ( PG_(dataobj_pool) );
+  memset(addr_node, 0, sizeof(PG_DataObj));
+  addr_node->addr = addr;
+  addr_node->size = size;
+  /* access_ht is made on the first access, as many globals never are */
+  addr_node->access_ht = NULL;
+  insertNode( addr_node );
   return addr_node;
 }
 
 void PG_(dataobj_node_freed)( Addr addr )
 {
-  PG_PageRange* page_node = NULL;
-  PG_DataObj *  addr_node = NULL;
-  /* Lookup page list */
-  Addr page_addr = addr & PAGE_MASK;
-
-  do {
-    page_node = VG_(HT_lookup) ( live_ht, page_addr );
-    if (page_node == NULL) return;
-    addr_node = getNode(page_node, addr);
-    if (addr_node == NULL) return;
-    /* Remove node from list */
-    removeNode( page_node, addr_node );
-    /* Save in freed_objs for later output */
-    insertNode( &freed_objs, addr_node);
+  PG_DataObj * addr_node = lookupNode( addr );
+  if (addr_node == NULL) return;
+
+  removeNode( addr_node );
+  access_cache_invalidate( addr_node );
+  /* Its accesses are its site's */
+  if (addr_node->site != NULL) {
+    PG_(pool_free)(PG_(dataobj_pool), addr_node);
+    return;
+  }
+  if (pg_json_stream_obj( addr_node )) return;
+  /* Save in freed_objs for later output */
+  addr_node->next = freed_objs;
+  freed_objs = addr_node;
+}
 
-    page_addr += PAGE_SIZE;
-  } while (page_addr < addr + addr_node->size);
+void PG_(dataobj_node_moved)( PG_DataObj * obj, Addr addr, SizeT size )
+{
+  removeNode( obj );
+  access_cache_invalidate( obj );
+  obj->addr = addr;
+  obj->size = size;
+  insertNode( obj );
+  if (obj->site != NULL && size > obj->site->size) obj->site->size = size;
 }
 
 PG_DataObj * PG_(dataobj_get_node)( Addr addr )
 {
-  /* Lookup page list */
-  Addr page_addr = addr & PAGE_MASK;
+  return lookupNode( addr );
+}
 
-  PG_PageRange* page_node = VG_(HT_lookup) ( live_ht, page_addr );
-  if (page_node) {
-    return (getNode(page_node, addr));
-  } else {
-    return NULL;
+/* With --aggregate-by=alloc-site, the heap blocks allocated from the
+   same stack, up to --alloc-site-depth frames deep, share one site
+   object, against which all their accesses are recorded.  The site
+   object's 'addr' is the ECU of the stack, and so is its id in the
+   output's "sites" section; its size is that of the largest block
+   allocated (or reallocated) there.  pg_out_obj lists the stacks.
+   Blocks stay in the object index, to find their site from an address,
+   and are released when freed.
+   With --fold-iterations the ECU is also noted in each block, to tell
+   iterations accessing blocks allocated alike from each other.
+   Nb: a PG_DataObj's first two fields match core's VgHashNode. */
+static VgHashTable site_ht = NULL;
+
+void PG_(dataobj_alloc_site)( PG_DataObj * obj, ThreadId tid )
+{
+  Addr         ips[PG_MAX_SITE_DEPTH];
+  UInt         n_ips;
+  UWord        ecu;
+  PG_DataObj * site;
+
+  if (!clo_by_site && !clo_fold_iterations) return;
+  /* Leave alone an object that was already there */
+  if (obj->site != NULL || obj->ecu != 0 || obj->access_ht != NULL) return;
+
+  n_ips = VG_(get_StackTrace)( tid, ips, clo_site_depth, NULL, NULL, 0 );
+  ecu   = VG_(get_ECU_from_ExeContext)(
+             VG_(make_ExeContext_from_StackTrace)( ips, n_ips ) );
+  if (clo_fold_iterations) obj->ecu = ecu;
+  if (!clo_by_site) return;
+
+  if (site_ht == NULL) site_ht = VG_(HT_construct) ( "site_hash" );
+  site = VG_(HT_lookup) ( site_ht, ecu );
+  if (site == NULL) {
+    site = PG_(pool_alloc) ( PG_(dataobj_pool) );
+    memset(site, 0, sizeof(PG_DataObj));
+    site->addr = ecu;
+    VG_(HT_add_node) ( site_ht, site );
+  }
+  if (obj->size > site->size) site->size = obj->size;
+  obj->site = site;
+}
+
+/* Global variables are registered as data objects as soon as the
+   debuginfo of their object has been read, so update_access never has
+   to search the debuginfo itself.  As exp-sgcheck does, they are taken
+   from the variable info of the new DebugInfo (with --read-var-info=yes),
+   which has the size of every global; without that, or if the object has
+   none, from its sized data symbols instead. */
+static void register_global_syms ( const DebugInfo* di )
+{
+  Int i, n = VG_(DebugInfo_syms_howmany)( di );
+  for (i = 0; i < n; i++) {
+    Addr   avma, tocptr;
+    UInt   size;
+    HChar* name;
+    Bool   isText, isIFunc;
+    VG_(DebugInfo_syms_getidx)( di, i, &avma, &tocptr, &size, &name,
+                                &isText, &isIFunc );
+    if (isText || size == 0) continue;
+    PG_(dataobj_node_malloced)( avma, size );
+  }
+}
+
+static void acquire_globals ( ULong di_handle )
+{
+  XArray* /* of GlobalBlock */ gbs;
+  const DebugInfo* di;
+  Word i, n;
+
+  gbs = VG_(di_get_global_blocks_from_dihandle)( di_handle,
+                                                 False/*arrays only*/ );
+  n = VG_(sizeXA)( gbs );
+  for (i = 0; i < n; i++) {
+    GlobalBlock* gb = VG_(indexXA)( gbs, i );
+    if (gb->szB == 0) continue;
+    PG_(dataobj_node_malloced)( gb->addr, gb->szB );
+  }
+  VG_(deleteXA)( gbs );
+
+  if (n == 0 && (di = VG_(find_DebugInfo_by_handle)( di_handle )) != NULL)
+    register_global_syms( di );
+}
+
+static void pg_new_mem_mmap ( Addr a, SizeT len, Bool rr, Bool ww, Bool xx,
+                              ULong di_handle )
+{
+  /* Function lookups made in the range before are stale */
+  discardFuncRanges( a, len );
+  if (di_handle > 0 && clo_trace_mem) acquire_globals( di_handle );
+}
+
+/* Objects in unmapped memory are gone, globals and all. */
+static void pg_die_mem_munmap ( Addr a, SizeT len )
+{
+  PG_DataObj   key;
+  PG_DataObj * obj;
+  UWord        keyW, valW;
+
+  discardFuncRanges( a, len );
+  if (len == 0) return;
+
+  PG_(drain_events)();
+  key.addr = a;
+  key.size = len;
+  while (VG_(lookupFM)( live_objs, &keyW, &valW, (UWord)&key )) {
+    obj = (PG_DataObj *) keyW;
+    PG_(dataobj_node_freed)( obj->addr );
   }
 }
 
@@ -207,15 +822,22 @@ typedef
    IRAtom;
 
 typedef 
-   enum { Event_Ir, Event_Dr, Event_Dw, Event_Dm }
+   enum { Event_Ir, Event_Dr, Event_Dw, Event_Dm, Event_Dspan }
    EventKind;
 
+/* An Event_Dspan is several accesses, at constant offsets from the same
+   base temp, coalesced into one: it covers [base+offset, base+offset+size)
+   and carries the total bytes read and written. */
 typedef
    struct {
       EventKind  ekind;
       IRAtom*    addr;
       Int        size;
       UWord      func_id;
+      IRTemp     base;            /* IRTemp_INVALID if not known */
+      Long       offset;
+      Int        bytes_read;
+      Int        bytes_written;
    }
    Event;
 
@@ -238,182 +860,1134 @@ typedef
    it makes just one memory reference (a modify), rather than two (a
    read followed by a write at the same address).
 
+   In addition, an access at a constant offset from the same base temp
+   as a pending access by the same function (p->a, p->b, p->c) is folded
+   into that pending event, which then becomes an Event_Dspan; see
+   coalesceEvent.  So struct-heavy code needs one helper call per base
+   rather than one per field.
+
    At various points the list will need to be flushed, that is, IR
    generated from it.  That must happen before any possible exit from
    the block (the end, or an IRStmt_Exit).  Flushing also takes place
    when there is no space to add a new event.
 
-   If we require the simulation statistics to be up to date with
-   respect to possible memory exceptions, then the list would have to
-   be flushed before each memory reference.  That's a pain so we don't
-   bother.
+   If we require the simulation statistics to be up to date with
+   respect to possible memory exceptions, then the list would have to
+   be flushed before each memory reference.  That's a pain so we don't
+   bother.
+
+   Flushing the list consists of walking it start to end and emitting
+   instrumentation IR for each event, in the order in which they
+   appear. */
+
+static Event events[N_EVENTS];
+static Int events_used = 0;
+
+/* For each temp in the SB being instrumented, the temp it is a constant
+   offset from (possibly itself) and that offset.  Filled in by
+   findAddrBases before instrumentation starts, so that accesses through
+   p, p+8 and p+16 can be recognised as sharing the base p. */
+typedef
+   struct {
+      IRTemp  base;
+      Long    offset;
+   }
+   AddrBase;
+
+static AddrBase* addr_bases      = NULL;
+static Int       addr_bases_size = 0;
+
+/* The nearest instrumented caller of the running code: the topmost
+   instrumented function on the thread's shadow stack (see stack_push).
+   Stale frames of code that is not instrumented are cut away at the
+   next call or jump from instrumented code, so there are seldom more
+   than one or two frames to skip. */
+static UWord attrib_func ( void )
+{
+  Word i = cur_thread->stack == NULL ? 0 : VG_(sizeXA)( cur_thread->stack );
+  while (--i >= 0) {
+    UWord func_id = *(UWord*)VG_(indexXA)( cur_thread->stack, i );
+    if (getFunc(func_id)->instrumented) return func_id;
+  }
+  return UNKNOWN_FUNC_ID;
+}
+
+static void update_access(Addr addr, UWord func_id,  SizeT bytes_read, 
+			  SizeT bytes_written)
+{
+  PG_DataObj *     addr_node;
+  PG_Access *      access_node;
+  PG_Func *        func;
+  AccessCacheEnt * ent;
+
+  if (func_id == ATTRIB_FUNC_ID) func_id = attrib_func();
+  ent = access_cache_ent( addr, func_id );
+
+  /* Each sampled access stands for sample_scale of them */
+  bytes_read    *= sample_scale;
+  bytes_written *= sample_scale;
+
+  /* Fast path: same object, same function iteration as last time */
+  if (ent->obj != NULL && ent->func_id == func_id
+      && addr - ent->obj->addr < obj_extent(ent->obj->size)
+      && ent->access->tid == cur_tid
+      && ent->access->iteration == thread_iteration(func_id)) {
+    ent->access->bytes_read += bytes_read;
+    ent->access->bytes_written += bytes_written;
+    return;
+  }
+
+  /* look up address in malloced list; globals are already in it */
+  addr_node = PG_(dataobj_get_node)( addr );
+  if (addr_node != NULL) {
+    UWord key  = access_key(func_id, cur_tid);
+    UInt  iter = thread_iteration(func_id);
+    /* Heap blocks' accesses may be recorded against their alloc site */
+    PG_DataObj * target = addr_node->site != NULL ? addr_node->site
+                                                  : addr_node;
+    func = getFunc(func_id);
+    if (target->access_ht == NULL) {
+      target->access_ht = VG_(HT_construct) ( "access_hash" );
+    }
+    access_node = VG_(HT_lookup) ( target->access_ht, key );
+    if (access_node == NULL || access_node->iteration < iter) {
+		/* First access in this function iteration, so create new node
+		   in front of those for earlier iterations */
+		PG_Access* new_access_node = PG_(pool_alloc) ( PG_(access_pool) );
+		new_access_node->key = key;
+		new_access_node->func_id = func_id;
+		new_access_node->tid = cur_tid;
+		/* Lookup iteration */
+		new_access_node->iteration = iter;
+		new_access_node->bytes_read = 0;
+		new_access_node->bytes_written = 0;
+		/* Insert into node list */
+		new_access_node->ll_next = access_node;
+		if (access_node != NULL) {
+			VG_(HT_remove) ( target->access_ht, key );
+		}
+		VG_(HT_add_node) (target->access_ht, new_access_node);
+		if (clo_fold_iterations) {
+			new_access_node->obj = target;
+			new_access_node->iter_next = func->iter_accesses;
+			func->iter_accesses = new_access_node;
+		}
+		access_node = new_access_node;
+    }
+    access_node->bytes_read += bytes_read;
+    access_node->bytes_written += bytes_written;
+
+    ent->obj     = addr_node;
+    ent->access  = access_node;
+    ent->func    = func;
+    ent->func_id = func_id;
+  }
+
+}
+
+static VG_REGPARM(3) void trace_load(Addr addr, SizeT size, UWord func_id)
+{
+  if (size > 0) {
+    update_access(addr, func_id, size, 0);
+  }
+}
+
+static VG_REGPARM(3) void trace_store(Addr addr, SizeT size, UWord func_id)
+{
+  if (size > 0) {
+    update_access(addr, func_id, 0, size);
+  }
+}
+
+static VG_REGPARM(3) void trace_modify(Addr addr, SizeT size, UWord func_id)
+{
+  if (size > 0) {
+    update_access(addr, func_id, size, size);
+  }
+}
+
+/* The part of 'total' bytes, accessed somewhere in [span, span+len), that
+   is put down to [lo, hi).  Shares of adjacent pieces add up exactly. */
+static inline SizeT span_share ( SizeT total, Addr span, SizeT len,
+                                 Addr lo, Addr hi )
+{
+  return total * (hi - span) / len - total * (lo - span) / len;
+}
+
+/* Credit the pieces of [a, end), a part of the span [span, span+len), to
+   the live objects holding them. */
+static void update_span_pieces(Addr a, Addr end, Addr span, SizeT len,
+                               UWord func_id, SizeT bytes_read,
+                               SizeT bytes_written)
+{
+  UWord        keyW, valW;
+  PG_DataObj   key;
+  PG_DataObj * obj;
+  Addr         lo, hi;
+  SizeT        rd, wr;
+
+  while (a < end) {
+    key.addr = a;
+    key.size = end - a;
+    if (!VG_(lookupFM)( live_objs, &keyW, &valW, (UWord)&key ))
+      return;
+    /* Any object overlapping [a, end); those below it are done first */
+    obj = (PG_DataObj *) keyW;
+    lo  = obj->addr > a ? obj->addr : a;
+    hi  = obj->addr + obj_extent(obj->size);
+    if (hi > end) hi = end;
+    if (lo > a)
+      update_span_pieces(a, lo, span, len, func_id, bytes_read, bytes_written);
+    rd = span_share(bytes_read, span, len, lo, hi);
+    wr = span_share(bytes_written, span, len, lo, hi);
+    if (rd > 0 || wr > 0)
+      update_access(lo, func_id, rd, wr);
+    a = hi;
+  }
+}
+
+/* A coalesced access (Event_Dspan): bytes_read and bytes_written bytes
+   somewhere in [addr, addr+len).  Which bytes is not known, so when the
+   span covers several objects, each gets a share in proportion to how
+   much of the span it holds.  Parts of the span in no object are
+   dropped, as accesses there would be. */
+static void update_span_access(Addr addr, SizeT len, UWord func_id,
+                               SizeT bytes_read, SizeT bytes_written)
+{
+  PG_DataObj * obj;
+
+  tl_assert(len > 0);
+  if (func_id == ATTRIB_FUNC_ID) func_id = attrib_func();
+
+  /* Nearly always the span is in one object */
+  obj = lookupNode( addr );
+  if (obj != NULL && addr + len - obj->addr <= obj_extent(obj->size)) {
+    update_access(addr, func_id, bytes_read, bytes_written);
+    return;
+  }
+  update_span_pieces(addr, addr + len, addr, len, func_id,
+                     bytes_read, bytes_written);
+}
+
+
+/* With --batch-events=N, the instrumented code doesn't call a helper for
+   each memory event; it just appends an (addr, info) record to batch_buf
+   and only calls batch_drain once the buffer is full.  Since the address
+   lookup depends on which objects are live, and the access node depends
+   on the current iteration of the accessing function, the buffer must
+   also be drained before any allocation, free or call is recorded.  As
+   threads never run concurrently, a single buffer serves all threads.
+   Repeated (object, function) pairs within a batch are folded into one
+   access node by the update_access cache.
+   A coalesced access takes two records: the first has the span's start
+   address, and its length in place of a size, with Event_Ir (which is
+   never batched) as its kind; the second holds the bytes read and
+   written, packed by mkBatchTotals in place of an address. */
+
+static UWord mkBatchInfo ( EventKind ekind, Int size, UWord func_id )
+{
+  tl_assert(ekind < (1 << BATCH_KIND_BITS));
+  tl_assert(size > 0 && size < (1 << BATCH_SIZE_BITS));
+  tl_assert(func_id < (1UL << (8 * sizeof(UWord) - BATCH_FUNC_SHIFT)));
+  return (func_id << BATCH_FUNC_SHIFT) 
+         | ((UWord)size << BATCH_KIND_BITS) | (UWord)ekind;
+}
+
+static UWord mkBatchTotals ( Int bytes_read, Int bytes_written )
+{
+  tl_assert(bytes_read >= 0 && bytes_read < (1 << BATCH_SIZE_BITS));
+  tl_assert(bytes_written >= 0 && bytes_written < (1 << BATCH_SIZE_BITS));
+  return ((UWord)bytes_read << BATCH_SIZE_BITS) | (UWord)bytes_written;
+}
+
+static VG_REGPARM(0) void batch_drain(void)
+{
+  UWord i;
+  for (i = 0; i < batch_used; i++) {
+    BatchRec* rec  = &batch_buf[i];
+    UWord func_id  = rec->info >> BATCH_FUNC_SHIFT;
+    SizeT size     = (rec->info >> BATCH_KIND_BITS) 
+                     & ((1 << BATCH_SIZE_BITS) - 1);
+    UWord totals;
+    switch (rec->info & ((1 << BATCH_KIND_BITS) - 1)) {
+      case Event_Dr: update_access(rec->addr, func_id, size, 0);    break;
+      case Event_Dw: update_access(rec->addr, func_id, 0, size);    break;
+      case Event_Dm: update_access(rec->addr, func_id, size, size); break;
+      case Event_Ir:
+        tl_assert(i + 1 < batch_used);
+        totals = batch_buf[++i].addr;
+        update_span_access(rec->addr, size, func_id,
+                           totals >> BATCH_SIZE_BITS,
+                           totals & ((1 << BATCH_SIZE_BITS) - 1));
+        break;
+      default:       tl_assert(0);
+    }
+  }
+  batch_used = 0;
+}
+
+void PG_(drain_events)( void )
+{
+  if (batch_used > 0) {
+    batch_drain();
+  }
+}
+
+/*------------------------------------------------------------*/
+/*--- Stuff for --fold-iterations                          ---*/
+/*------------------------------------------------------------*/
+
+/* When an iteration of a function finishes (which, for want of return
+   tracking, is when the next one starts), its signature is hashed from
+   the functions it called and the objects it accessed, with the bytes
+   read and written.  If an earlier iteration had the same signature, the
+   records of the finished iteration are thrown away and the earlier one's
+   count is bumped, so memory and output scale with the number of
+   distinct behaviours rather than with the length of the run.  Any
+   reference to a folded iteration is mapped onto its class's
+   representative at output time.  Signatures are hashed to find the
+   classes they may belong to, and then compared in full.  Heap blocks
+   appear in them by allocation site and size rather than by address, so
+   that an iteration doing the same with a block allocated afresh still
+   folds.  Only single-threaded clients are folded: from the creation of
+   a second thread on, iterations are kept as they are (see
+   pg_pre_thread_ll_create). */
+
+/* The signature of the iteration being finished */
+static XArray* iter_sig = NULL;    /* of UWord */
+
+static void sig_add ( UWord w )
+{
+  VG_(addToXA)( iter_sig, &w );
+}
+
+static inline UWord mix_sig ( UWord sig, UWord w )
+{
+  return (sig ^ w) * (sizeof(UWord) == 8 ? 0x100000001B3ULL : 0x01000193UL)
+         + (sig >> 29);
+}
+
+/* Visit the call edges made during the current iteration 'j' of func,
+   which are at the end of its call log: if 'drop' is set, remove them,
+   otherwise add their targets to iter_sig. */
+static void calls_sig ( PG_Func * func, UInt j, Bool drop )
+{
+  Word k = VG_(sizeXA)( func->calls ) - 1;
+  while (k >= 0) {
+    PG_CallEdge * e = VG_(indexXA)( func->calls, k );
+    if (e->caller_iter + e->run - 1 != j) break;
+    if (!drop) {
+      sig_add( e->target_id );
+    } else if (e->run > 1) {
+      e->run--;
+      break;
+    } else {
+      VG_(dropTailXA)( func->calls, 1 );
+    }
+    k--;
+  }
+}
+
+/* Add the objects accessed in the current iteration of func to iter_sig:
+   heap blocks by allocation site and size, other objects (globals, and
+   alloc-site objects) by address. */
+static void accesses_sig ( PG_Func * func )
+{
+  PG_Access * a;
+  sig_add( (UWord)-1 );    /* ends the calls */
+  for (a = func->iter_accesses; a != NULL; a = a->iter_next) {
+    sig_add( a->obj->ecu != 0 ? a->obj->ecu : a->obj->addr );
+    sig_add( a->obj->size );
+    sig_add( a->bytes_read );
+    sig_add( a->bytes_written );
+  }
+}
+
+static PG_IterClass* find_class ( PG_Func * func, UWord hash )
+{
+  UWord          n   = VG_(sizeXA)( iter_sig );
+  UWord*         sig = n == 0 ? NULL : VG_(indexXA)( iter_sig, 0 );
+  PG_IterClass * head = VG_(HT_lookup) ( func->iter_classes, hash );
+  PG_IterClass * cls  = head;
+  if (head == NULL) return NULL;
+  do {
+    if (cls->sig_len == n
+        && VG_(memcmp)( cls->sig, sig, n * sizeof(UWord) ) == 0)
+      return cls;
+    cls = cls->same_key;
+  } while (cls != head);
+  return NULL;
+}
+
+/* Make a class for iteration j, with iter_sig as its signature */
+static PG_IterClass* new_class ( PG_Func * func, UWord hash, UInt j )
+{
+  UWord          n    = VG_(sizeXA)( iter_sig );
+  PG_IterClass * head = VG_(HT_lookup) ( func->iter_classes, hash );
+  PG_IterClass * cls  = VG_(malloc) ( "pg.iter_class",
+                                      sizeof(PG_IterClass)
+                                      + n * sizeof(UWord) );
+  cls->key     = hash;
+  cls->rep     = j;
+  cls->count   = 1;
+  cls->sig_len = n;
+  cls->sig     = (UWord*)(cls + 1);
+  if (n > 0)
+    VG_(memcpy)( cls->sig, VG_(indexXA)( iter_sig, 0 ), n * sizeof(UWord) );
+  if (head == NULL) {
+    cls->same_key = cls;
+  } else {
+    cls->same_key  = head->same_key;
+    head->same_key = cls;
+  }
+  VG_(HT_add_node) ( func->iter_classes, cls );
+  return cls;
+}
+
+/* Unhook the access nodes of the current iteration from their objects;
+   each is the newest node for func in its object's access_ht. */
+static void drop_accesses ( PG_Func * func )
+{
+  PG_Access * a = func->iter_accesses;
+  access_cache_invalidate_func( func );
+  while (a != NULL) {
+    PG_Access * next = a->iter_next;
+    PG_Access * head = VG_(HT_remove)( a->obj->access_ht, a->key );
+    tl_assert(head == a);
+    if (a->ll_next != NULL) {
+      VG_(HT_add_node)( a->obj->access_ht, a->ll_next );
+    }
+    PG_(pool_free)( PG_(access_pool), a );
+    a = next;
+  }
+}
+
+static void map_iteration ( PG_Func * func, UInt j, UInt rep )
+{
+  PG_IterRun * last = NULL;
+  PG_IterRun   run;
+  Word         n;
+  UInt         enc = (rep == j) ? 0 : rep;
+
+  if (func->iter_map == NULL) {
+    func->iter_map = VG_(newXA) ( VG_(malloc), "pg.iter_map", VG_(free),
+                                  sizeof(PG_IterRun) );
+  }
+  n = VG_(sizeXA)( func->iter_map );
+  if (n > 0) {
+    last = VG_(indexXA)( func->iter_map, n - 1 );
+  }
+  if (last != NULL && last->first + last->n == j && last->rep == enc) {
+    last->n++;
+  } else {
+    run.first = j;
+    run.n     = 1;
+    run.rep   = enc;
+    VG_(addToXA)( func->iter_map, &run );
+  }
+}
+
+/* Return the iteration whose records stand for iteration j of func. */
+static UInt rep_iteration ( PG_Func * func, UInt j )
+{
+  Word lo, hi, mid;
+  if (!clo_fold_iterations || func->iter_map == NULL) return j;
+  lo = 0;
+  hi = VG_(sizeXA)( func->iter_map ) - 1;
+  while (lo <= hi) {
+    PG_IterRun * run;
+    mid = (lo + hi) / 2;
+    run = VG_(indexXA)( func->iter_map, mid );
+    if (j < run->first) {
+      hi = mid - 1;
+    } else if (j >= run->first + run->n) {
+      lo = mid + 1;
+    } else {
+      return run->rep == 0 ? j : run->rep;
+    }
+  }
+  return j;
+}
+
+static void finish_iteration ( PG_Func * func )
+{
+  UInt           j = func->iteration;
+  UWord          hash = 0;
+  Word           k;
+  PG_IterClass * cls;
+
+  if (!clo_fold_iterations) return;
+  /* Iteration 0 (before the first call) is never output */
+  if (j == 0) {
+    func->iter_accesses = NULL;
+    return;
+  }
+
+  if (iter_sig == NULL) {
+    iter_sig = VG_(newXA)( VG_(malloc), "pg.iter_sig", VG_(free),
+                           sizeof(UWord) );
+  }
+  VG_(dropTailXA)( iter_sig, VG_(sizeXA)( iter_sig ) );
+  if (folding) {
+    calls_sig( func, j, False );
+    accesses_sig( func );
+    for (k = 0; k < VG_(sizeXA)( iter_sig ); k++) {
+      hash = mix_sig( hash, *(UWord*)VG_(indexXA)( iter_sig, k ) );
+    }
+  }
+
+  if (func->iter_classes == NULL) {
+    func->iter_classes = VG_(HT_construct) ( "iter_classes" );
+  }
+  /* Once folding has stopped, each iteration is a class of its own */
+  cls = folding ? find_class( func, hash ) : NULL;
+  if (cls == NULL) {
+    cls = new_class( func, hash, j );
+  } else {
+    cls->count++;
+    calls_sig( func, j, True );
+    drop_accesses( func );
+  }
+  map_iteration( func, j, cls->rep );
+  func->iter_accesses = NULL;
+}
+
+/* Start a new iteration of the target and append the call to the
+   caller's call log, extending the caller's last run of calls if this
+   call continues it. */
+static void record_call(PG_Func *caller_func, PG_Func *target_func)
+{
+  PG_CallEdge *last;
+  PG_CallEdge  edge;
+  Word         n;
+  UInt         caller_iter = thread_iteration(caller_func->id);
+
+  finish_iteration(target_func);
+  target_func->iteration++;
+  set_thread_iteration(target_func->id, target_func->iteration);
+
+  n = VG_(sizeXA)( caller_func->calls );
+  last = n > 0 ? VG_(indexXA)( caller_func->calls, n - 1 ) : NULL;
+  if (last != NULL
+      && last->target_id == target_func->id
+      && last->tid == cur_tid
+      && last->caller_iter + last->run == caller_iter
+      && last->target_iter + last->run == target_func->iteration) {
+    last->run++;
+    return;
+  }
+
+  edge.target_id   = target_func->id;
+  edge.caller_iter = caller_iter;
+  edge.target_iter = target_func->iteration;
+  edge.run         = 1;
+  edge.tid         = cur_tid;
+  /* Only the last edge can be extended, so the one before can go */
+  if (last != NULL && pg_json_stream_call( caller_func, last )) {
+    *last = edge;
+    return;
+  }
+  VG_(addToXA)( caller_func->calls, &edge );
+}
+
+/* The id of the --boundary-function, once it has been translated, and the
+   number of snapshots taken on calls to it. */
+static UWord boundary_func_id = UNKNOWN_FUNC_ID;
+static UInt  boundary_epoch   = 0;
+
+static Bool any_matches ( XArray* pats, const Char* s )
+{
+  Word i;
+  for (i = 0; i < VG_(sizeXA)( pats ); i++) {
+    if (VG_(string_match)( *(Char**)VG_(indexXA)( pats, i ), s )) return True;
+  }
+  return False;
+}
+
+static Bool obj_matches ( XArray* pats, const Char* path )
+{
+  const Char* base = VG_(strrchr)( path, '/' );
+  return any_matches( pats, path )
+         || (base != NULL && any_matches( pats, base + 1 ));
+}
+
+/* Whether function 'fnname', found at 'addr', is to be instrumented
+   according to --instrument-objs, --instrument-fns and their exclude
+   counterparts.  Called once per function, when it is first seen. */
+Bool PG_(instrument_func)( Char* fnname, Addr addr )
+{
+  const DebugInfo* di  = addr == 0 ? NULL : VG_(find_DebugInfo)( addr );
+  const Char*      obj = "";
+
+  if (di != NULL) obj = (const Char*)VG_(DebugInfo_get_filename)( di );
+
+  if (clo_instrument_objs != NULL && !obj_matches( clo_instrument_objs, obj ))
+    return False;
+  if (clo_instrument_fns != NULL && !any_matches( clo_instrument_fns, fnname ))
+    return False;
+  if (clo_exclude_objs != NULL && obj_matches( clo_exclude_objs, obj ))
+    return False;
+  if (clo_exclude_fns != NULL && any_matches( clo_exclude_fns, fnname ))
+    return False;
+  return True;
+}
+
+/* getFuncId, also noting the id of the --boundary-function when code
+   that belongs to it or calls it is first translated. */
+static UWord lookupFuncId ( Addr addr )
+{
+  UWord func_id = getFuncId(addr, func_ht);
+  if (clo_boundary_fun != NULL
+      && boundary_func_id == UNKNOWN_FUNC_ID
+      && func_id != UNKNOWN_FUNC_ID
+      && VG_(strcmp)(getFunc(func_id)->fnname, clo_boundary_fun) == 0) {
+    boundary_func_id = func_id;
+  }
+  tl_assert(func_id != ATTRIB_FUNC_ID);
+  return func_id;
+}
+
+/* On entry to the boundary function, write out the function iterations,
+   calls and objects accessed since the previous boundary, and then
+   forget them so that memory use is bounded by what one epoch records.
+   Live objects carry over to the next epoch, but their accesses are
+   written out and forgotten with the rest. */
+static void boundary_snapshot ( void )
+{
+  PG_Func    * func;
+  PG_DataObj * addr;
+  UWord        keyW, valW;
+
+  if (!clo_json) return;
+
+  pg_write_json(++boundary_epoch);
+
+  VG_(HT_ResetIter)(func_ht);
+  while ( (func = VG_(HT_Next)(func_ht)) ) {
+    VG_(dropTailXA)(func->calls, VG_(sizeXA)(func->calls));
+    func->epoch_iter = func->iteration;
+  }
+  while (freed_objs != NULL) {
+    addr = freed_objs;
+    freed_objs = addr->next;
+    release_obj(addr);
+  }
+  access_cache_clear();
+  VG_(initIterFM)(live_objs);
+  while (VG_(nextIterFM)(live_objs, &keyW, &valW)) {
+    release_accesses((PG_DataObj *)keyW);
+  }
+  VG_(doneIterFM)(live_objs);
+  if (site_ht != NULL) {
+    VG_(HT_ResetIter)(site_ht);
+    while ( (addr = VG_(HT_Next)(site_ht)) ) {
+      release_accesses(addr);
+    }
+  }
+}
+
+/* Forget where each thread was: calls and returns made while tracing was
+   off were not seen, so the shadow stacks (and the attribution of
+   accesses from code that is not instrumented, which is read off them)
+   and the threads' current iterations no longer hold.  Each thread
+   restarts outside any iteration, as at startup. */
+static void reset_thread_states ( void )
+{
+  ThreadId tid;
+  for (tid = 0; tid < VG_N_THREADS; tid++) {
+    ThreadState* ts = &threads[tid];
+    if (ts->stack != NULL)
+      VG_(dropTailXA)( ts->stack, VG_(sizeXA)( ts->stack ) );
+    if (ts->cur_iter != NULL)
+      VG_(memset)( ts->cur_iter, 0, ts->n_cur_iter * sizeof(UInt) );
+  }
+  access_cache_clear();
+}
+
+static void set_tracing ( Bool on )
+{
+  if (tracing == on) return;
+  PG_(drain_events)();
+  tracing = on;
+  if (on) reset_thread_states();
+  VG_(discard_translations)( (Addr64)0x1000, (ULong) ~0xfffl, "privgrind" );
+  if (VG_(clo_verbosity) > 1)
+    VG_(message)(Vg_DebugMsg, "privgrind: tracing switched %s\n",
+                 on ? "on" : "off");
+}
+
+static Bool pg_handle_client_request ( ThreadId tid, UWord* args, UWord* ret )
+{
+  if (!VG_IS_TOOL_USERREQ('P','G',args[0]))
+    return False;
+
+  switch (args[0]) {
+  case VG_USERREQ__PG_START_TRACING:
+    set_tracing(True);
+    break;
+  case VG_USERREQ__PG_STOP_TRACING:
+    set_tracing(False);
+    break;
+  case VG_USERREQ__PG_DUMP:
+    if (clo_fold_iterations) {
+      VG_(message)(Vg_UserMsg,
+                   "PRIVGRIND_DUMP is ignored with --fold-iterations\n");
+      break;
+    }
+    PG_(drain_events)();
+    boundary_snapshot();
+    break;
+  default:
+    VG_(message)(Vg_UserMsg,
+                 "Warning: unknown privgrind client request code %llx\n",
+                 (ULong)args[0]);
+    return False;
+  }
+  *ret = 0;                 /* meaningless */
+  return True;
+}
+
+/* Record a call or tail jump from caller_func_id to target_func_id. */
+static void do_call(UWord caller_func_id, UWord target_func_id)
+{
+  PG_Func *caller_func;
+  PG_Func *target_func;
+
+  target_func = getFunc(target_func_id);
+  tl_assert(target_func != NULL);
+  caller_func = getFunc(caller_func_id);
+  tl_assert(caller_func != NULL);
+
+  if (!target_func->instrumented) return;
+  
+  record_call(caller_func, target_func);
+
+  if (target_func_id == boundary_func_id
+      && boundary_func_id != UNKNOWN_FUNC_ID) {
+    boundary_snapshot();
+  }
+}
+
+/* Each thread has a shadow stack of the functions it is in, as
+   callgrind's callstack.c, so that a jump back into a function further
+   up the stack is known to be a return rather than a call.  Calls push
+   their target, and returns (Ijk_Ret) pop back to below the returning
+   function.  Code that is not instrumented pushes and pops nothing, so
+   the frame pushed for a call into it is left behind when it returns;
+   calls and jumps from instrumented code, which must be running in the
+   topmost frame of its function, first cut such stale frames away.
+   Translations are not chased across calls, so that every call ends
+   its superblock with an Ijk_Call exit. */
+static void stack_push ( UWord func_id )
+{
+  if (cur_thread->stack == NULL) {
+    cur_thread->stack = VG_(newXA)( VG_(malloc), "pg.stack", VG_(free),
+                                    sizeof(UWord) );
+  }
+  VG_(addToXA)( cur_thread->stack, &func_id );
+}
+
+/* Index of the topmost frame of func_id, or -1 */
+static Word stack_find ( UWord func_id )
+{
+  Word i = cur_thread->stack == NULL ? 0 : VG_(sizeXA)( cur_thread->stack );
+  while (--i >= 0) {
+    if (*(UWord*)VG_(indexXA)( cur_thread->stack, i ) == func_id) break;
+  }
+  return i;
+}
+
+static void stack_cut ( Word n )
+{
+  VG_(dropTailXA)( cur_thread->stack, VG_(sizeXA)( cur_thread->stack ) - n );
+}
+
+static VG_REGPARM(2) void trace_call(UWord caller_func_id, UWord target_func_id)
+{
+  Word i;
+
+  PG_(drain_events)();
+  i = stack_find(caller_func_id);
+  if (i >= 0) stack_cut(i + 1);
+  stack_push(target_func_id);
+  do_call(caller_func_id, target_func_id);
+}
+
+static VG_REGPARM(2) void trace_call_indirect(UWord caller_func_id, 
+					      Addr target_addr)
+{
+  trace_call(caller_func_id, lookupFuncId(target_addr));
+}
+
+/* A jump, or falling through, from one function into another: a return
+   if the target is on the stack, otherwise a tail call. */
+static VG_REGPARM(2) void trace_jump(UWord src_func_id, UWord target_func_id)
+{
+  Word i;
+
+  PG_(drain_events)();
+  i = stack_find(target_func_id);
+  if (i >= 0) {
+    stack_cut(i + 1);
+    return;
+  }
+  i = stack_find(src_func_id);
+  if (i >= 0) stack_cut(i);
+  stack_push(target_func_id);
+  do_call(src_func_id, target_func_id);
+}
+
+static VG_REGPARM(2) void trace_jump_indirect(UWord src_func_id,
+					      Addr target_addr)
+{
+  UWord target_func_id = lookupFuncId(target_addr);
+  if (target_func_id != src_func_id)
+    trace_jump(src_func_id, target_func_id);
+}
+
+static VG_REGPARM(1) void trace_return(UWord func_id)
+{
+  Word i;
+
+  /* Buffered accesses of code that is not instrumented belong to the
+     callers on the stack before the return */
+  PG_(drain_events)();
+  i = stack_find(func_id);
+  if (i >= 0) stack_cut(i);
+}
 
-   Flushing the list consists of walking it start to end and emitting
-   instrumentation IR for each event, in the order in which they
-   appear. */
+static void trace_access(Addr addr, SizeT len, SizeT bytes_read,
+                         SizeT bytes_written, UWord func_id)
+{
+  update_span_access(addr, len, func_id, bytes_read, bytes_written);
+}
 
-static Event events[N_EVENTS];
-static Int events_used = 0;
+#define binop(_op, _arg1, _arg2) IRExpr_Binop((_op),(_arg1),(_arg2))
+#define mkexpr(_tmp)             IRExpr_RdTmp((_tmp))
+#define mkU8(_n)                 IRExpr_Const(IRConst_U8(_n))
+#define assign(_t, _e)           IRStmt_WrTmp((_t), (_e))
+
+#if defined(VG_BIGENDIAN)
+# define END Iend_BE
+#elif defined(VG_LITTLEENDIAN)
+# define END Iend_LE
+#else
+# error "Unknown endianness"
+#endif
+
+/* Emit IR to append the record (addr, info) to batch_buf, followed by
+   (addr2, 0) if addr2 is not NULL, draining it when it becomes full:
+     t1 = Load(&batch_used)
+     t2 = Add(&batch_buf[0], Shl(t1, log2(sizeof(BatchRec))))
+     Store(t2) = addr
+     Store(t2 + sizeof(Addr)) = info
+     [Store(t2 + sizeof(BatchRec)) = addr2
+      Store(t2 + sizeof(BatchRec) + sizeof(Addr)) = 0]
+     t3 = Add(t1, <number of records>)
+     Store(&batch_used) = t3
+     if (t3 >= clo_batch_events) batch_drain()
+   batch_buf has a spare slot past clo_batch_events, so the pair always
+   fits.
+*/
+static void addBatchedRecs ( IRSB* sb, IRAtom* addr, UWord info,
+                             IRAtom* addr2 )
+{
+   IRType   tyW   = sizeof(UWord) == 8 ? Ity_I64 : Ity_I32;
+   IROp     opAdd = sizeof(UWord) == 8 ? Iop_Add64 : Iop_Add32;
+   IROp     opShl = sizeof(UWord) == 8 ? Iop_Shl64 : Iop_Shl32;
+   IROp     opCmp = sizeof(UWord) == 8 ? Iop_CmpLE64U : Iop_CmpLE32U;
+   UChar    shift = sizeof(BatchRec) == 16 ? 4 : 3;
+   IRTemp   t1    = newIRTemp(sb->tyenv, tyW);
+   IRTemp   t2    = newIRTemp(sb->tyenv, tyW);
+   IRTemp   t3    = newIRTemp(sb->tyenv, tyW);
+   IRTemp   guard = newIRTemp(sb->tyenv, Ity_I1);
+   IRExpr*  used_addr = mkIRExpr_HWord( (HWord)&batch_used );
+   IRDirty* di;
+
+   tl_assert(sizeof(BatchRec) == (1 << shift));
+   tl_assert(typeOfIRExpr(sb->tyenv, addr) == tyW);
+
+   addStmtToIRSB( sb, assign(t1, IRExpr_Load(END, tyW, used_addr)) );
+   addStmtToIRSB( sb, assign(t2, binop(opAdd, 
+                                       mkIRExpr_HWord( (HWord)batch_buf ),
+                                       binop(opShl, mkexpr(t1), 
+                                             mkU8(shift)))) );
+   addStmtToIRSB( sb, IRStmt_Store(END, mkexpr(t2), addr) );
+   addStmtToIRSB( sb, IRStmt_Store(END, 
+                                   binop(opAdd, mkexpr(t2),
+                                         mkIRExpr_HWord( sizeof(Addr) )),
+                                   mkIRExpr_HWord( info )) );
+   if (addr2 != NULL) {
+      addStmtToIRSB( sb, IRStmt_Store(END,
+                                      binop(opAdd, mkexpr(t2),
+                                            mkIRExpr_HWord( sizeof(BatchRec) )),
+                                      addr2) );
+      addStmtToIRSB( sb, IRStmt_Store(END,
+                                      binop(opAdd, mkexpr(t2),
+                                            mkIRExpr_HWord( sizeof(BatchRec)
+                                                            + sizeof(Addr) )),
+                                      mkIRExpr_HWord( 0 )) );
+   }
+   addStmtToIRSB( sb, assign(t3, binop(opAdd, mkexpr(t1), 
+                                       mkIRExpr_HWord( addr2 ? 2 : 1 ))) );
+   addStmtToIRSB( sb, IRStmt_Store(END, used_addr, mkexpr(t3)) );
+   addStmtToIRSB( sb, assign(guard, binop(opCmp,
+                                          mkIRExpr_HWord( clo_batch_events ),
+                                          mkexpr(t3))) );
+
+   di = unsafeIRDirty_0_N( /*regparms*/0, 
+                           "batch_drain", VG_(fnptr_to_fnentry)( batch_drain ),
+                           mkIRExprVec_0() );
+   di->guard = mkexpr(guard);
+   addStmtToIRSB( sb, IRStmt_Dirty(di) );
+}
 
-static void update_access(Addr addr, UWord func_id,  SizeT bytes_read, 
-			  SizeT bytes_written)
+static void addBatchedEvent ( IRSB* sb, Event* ev )
 {
-  /* look up address in malloced list */
-  PG_DataObj * addr_node = PG_(dataobj_get_node)( addr );
-  if (addr_node == NULL) {
-    /* Check if it is a global that we have not yet added to our list */
-    Addr glob_start;
-    Word glob_size;
-    if (VG_(get_global_obj) ( addr, &glob_start, &glob_size )) {
-      /* Treat this global as having been malloced to add it to the list
-	 of addresses traced */
-      addr_node = PG_(dataobj_node_malloced)( glob_start, glob_size );
-    } else if (VG_(DebugInfo_sect_kind)( NULL, 0, addr) == Vg_SectData) {
-      /* If it is in the data section, just add an object based on access */
-      addr_node = PG_(dataobj_node_malloced)( addr, 
-			bytes_read == 0 ? bytes_read : bytes_written);
-    }
-  }
-  if (addr_node != NULL) {
-    PG_Access* access_node = VG_(HT_lookup) ( addr_node->access_ht, func_id );
-    if (access_node == NULL) {
-		access_node = VG_(malloc) ("trace_load.access_node", sizeof(PG_Access) );
-		access_node->func_id = func_id;
-		/* Lookup iteration */
-		access_node->iteration = getFunc(func_id)->iteration;
-		access_node->bytes_read = 0;
-		access_node->bytes_written = 0;
-		VG_(HT_add_node) (addr_node->access_ht, access_node);
-    } else if (access_node->iteration < getFunc(func_id)->iteration) {
-		/* If more recent function iteration, create new node */
-		PG_Access* new_access_node = VG_(malloc) ("trace_load.access_node", sizeof(PG_Access) );
-		new_access_node->func_id = func_id;
-		/* Lookup iteration */
-		new_access_node->iteration = getFunc(func_id)->iteration;
-		new_access_node->bytes_read = 0;
-		new_access_node->bytes_written = 0;
-		/* Insert into node list */
-		new_access_node->ll_next = access_node;
-		VG_(HT_remove) ( addr_node->access_ht, func_id );
-		VG_(HT_add_node) (addr_node->access_ht, new_access_node);
-	}
-    access_node->bytes_read += bytes_read;
-    access_node->bytes_written += bytes_written;
-  }
+   addBatchedRecs( sb, ev->addr, mkBatchInfo(ev->ekind, ev->size, ev->func_id),
+                   NULL );
+}
 
+/* A coalesced event starting at 'addr' takes two records; see
+   batch_drain. */
+static void addBatchedSpan ( IRSB* sb, IRAtom* addr, Event* ev )
+{
+   addBatchedRecs( sb, addr, mkBatchInfo(Event_Ir, ev->size, ev->func_id),
+                   mkIRExpr_HWord( mkBatchTotals(ev->bytes_read,
+                                                 ev->bytes_written) ) );
 }
 
-static VG_REGPARM(3) void trace_load(Addr addr, SizeT size, UWord func_id)
+/* Emit IR stepping the countdown at 'left', which restarts from 'period'
+   when it reaches zero, and return an atom telling whether it did:
+     t0  = Load:I32(left)
+     t1  = Sub32(t0, 1)
+     hit = CmpEQ32(t1, 0)
+     Store(left) = Mux0X(1Uto8(hit), t1, period)
+   If 'only_if' is not NULL the countdown is only stepped when it holds,
+   the stored value being Mux0X(1Uto8(only_if), t0, <as above>); the
+   returned atom must then be masked by 'only_if' too. */
+static IRAtom* mkSampleGuard ( IRSB* sb, UInt* left, UInt period,
+                               IRAtom* only_if )
 {
-  if (size > 0) {
-    update_access(addr, func_id, size, 0);
-  }
+   IRExpr*  ea  = mkIRExpr_HWord( (HWord)left );
+   IRTemp   t0  = newIRTemp(sb->tyenv, Ity_I32);
+   IRTemp   t1  = newIRTemp(sb->tyenv, Ity_I32);
+   IRTemp   hit = newIRTemp(sb->tyenv, Ity_I1);
+   IRTemp   c   = newIRTemp(sb->tyenv, Ity_I8);
+   IRTemp   nxt = newIRTemp(sb->tyenv, Ity_I32);
+
+   addStmtToIRSB( sb, assign(t0, IRExpr_Load(END, Ity_I32, ea)) );
+   addStmtToIRSB( sb, assign(t1, binop(Iop_Sub32, mkexpr(t0),
+                                       IRExpr_Const(IRConst_U32(1)))) );
+   addStmtToIRSB( sb, assign(hit, binop(Iop_CmpEQ32, mkexpr(t1),
+                                        IRExpr_Const(IRConst_U32(0)))) );
+   addStmtToIRSB( sb, assign(c, IRExpr_Unop(Iop_1Uto8, mkexpr(hit))) );
+   addStmtToIRSB( sb, assign(nxt, IRExpr_Mux0X(mkexpr(c), mkexpr(t1),
+                                     IRExpr_Const(IRConst_U32(period)))) );
+   if (only_if != NULL) {
+      IRTemp c2   = newIRTemp(sb->tyenv, Ity_I8);
+      IRTemp nxt2 = newIRTemp(sb->tyenv, Ity_I32);
+      addStmtToIRSB( sb, assign(c2, IRExpr_Unop(Iop_1Uto8, only_if)) );
+      addStmtToIRSB( sb, assign(nxt2, IRExpr_Mux0X(mkexpr(c2), mkexpr(t0),
+                                                   mkexpr(nxt))) );
+      nxt = nxt2;
+   }
+   addStmtToIRSB( sb, IRStmt_Store(END, ea, mkexpr(nxt)) );
+   return mkexpr(hit);
 }
 
-static VG_REGPARM(3) void trace_store(Addr addr, SizeT size, UWord func_id)
+/* With --sample-blocks, whether the superblock being instrumented is
+   recording its accesses on this execution; NULL otherwise. */
+static IRAtom* block_sampled = NULL;
+
+/* Emit IR for And32(t, 1Sto32(b)): t if b holds, else 0. */
+static IRTemp mkMaskedBy ( IRSB* sb, IRTemp t, IRAtom* b )
 {
-  if (size > 0) {
-    update_access(addr, func_id, 0, size);
-  }
+   IRTemp mask = newIRTemp(sb->tyenv, Ity_I32);
+   IRTemp res  = newIRTemp(sb->tyenv, Ity_I32);
+   addStmtToIRSB( sb, assign(mask, IRExpr_Unop(Iop_1Sto32, b)) );
+   addStmtToIRSB( sb, assign(res, binop(Iop_And32, mkexpr(t), mkexpr(mask))) );
+   return res;
 }
 
-static VG_REGPARM(3) void trace_modify(Addr addr, SizeT size, UWord func_id)
+/* Emit IR loading PG_(shadow_chunk_live)'s slot for addr's chunk. */
+static IRTemp mkChunkLive ( IRSB* sb, IRAtom* addr )
 {
-  if (size > 0) {
-    update_access(addr, func_id, size, size);
-  }
+   IRType   tyW   = sizeof(UWord) == 8 ? Ity_I64 : Ity_I32;
+   IROp     opAdd = sizeof(UWord) == 8 ? Iop_Add64 : Iop_Add32;
+   IROp     opShr = sizeof(UWord) == 8 ? Iop_Shr64 : Iop_Shr32;
+   IROp     opShl = sizeof(UWord) == 8 ? Iop_Shl64 : Iop_Shl32;
+   IROp     opAnd = sizeof(UWord) == 8 ? Iop_And64 : Iop_And32;
+   IRTemp   slot  = newIRTemp(sb->tyenv, tyW);
+   IRTemp   ea    = newIRTemp(sb->tyenv, tyW);
+   IRTemp   t2    = newIRTemp(sb->tyenv, Ity_I32);
+
+   tl_assert(typeOfIRExpr(sb->tyenv, addr) == tyW);
+
+   addStmtToIRSB( sb, assign(slot, binop(opAnd,
+                                         binop(opShr, addr,
+                                               mkU8(PG_SHADOW_CHUNK_BITS)),
+                                         mkIRExpr_HWord( PG_SHADOW_CHUNK_SLOTS-1 ))) );
+   addStmtToIRSB( sb, assign(ea, binop(opAdd,
+                                       mkIRExpr_HWord( (HWord)PG_(shadow_chunk_live) ),
+                                       binop(opShl, mkexpr(slot), mkU8(2)))) );
+   addStmtToIRSB( sb, assign(t2, IRExpr_Load(END, Ity_I32, mkexpr(ea))) );
+   return t2;
 }
 
+/* Emit IR computing whether the helper for a data access to 'addr' must
+   be called.  As every object (globals included) is in the shadow map, an
+   access can only hit one if PG_(shadow_chunk_live) says the address'
+   chunk, or one sharing its slot, holds a live object.  For a coalesced
+   access, 'last' is the span's last byte, whose chunk is tested too: a
+   span is much shorter than a chunk, so it is in one or both of them.
+   When sampling, the access must also be the sampled one, in a sampled
+   block.  The --sample-mem countdown only counts accesses in sampled
+   blocks: were it stepped in the others too, the two countdowns could
+   stay in step and always pick the same access of the same block, so
+   that the recorded ones would not stand for sample_scale of them each.
+     t2    = Load:I32(&PG_(shadow_chunk_live)[(addr >> 16) & mask])
+     guard = CmpNE32(t2, 0)
+   where t2 is first or'd with the same for 'last', if given, and masked
+   by the --sample-mem and --sample-blocks guards in use.
+*/
+static IRAtom* mkTrackedGuard ( IRSB* sb, IRAtom* addr, IRAtom* last )
+{
+   IRTemp   t2    = mkChunkLive( sb, addr );
+   IRTemp   guard = newIRTemp(sb->tyenv, Ity_I1);
+
+   if (last != NULL) {
+      IRTemp t2last = mkChunkLive( sb, last );
+      IRTemp t2both = newIRTemp(sb->tyenv, Ity_I32);
+      addStmtToIRSB( sb, assign(t2both, binop(Iop_Or32, mkexpr(t2),
+                                              mkexpr(t2last))) );
+      t2 = t2both;
+   }
+
+   if (clo_sample_mem > 1) {
+      IRAtom* hit = mkSampleGuard( sb, &sample_mem_left, clo_sample_mem,
+                                   block_sampled );
+      t2 = mkMaskedBy( sb, t2, hit );
+   }
+   if (block_sampled != NULL) {
+      t2 = mkMaskedBy( sb, t2, block_sampled );
+   }
 
-static VG_REGPARM(2) void trace_call(UWord caller_func_id, UWord target_func_id)
+   addStmtToIRSB( sb, assign(guard, binop(Iop_CmpNE32, mkexpr(t2),
+                                          IRExpr_Const(IRConst_U32(0)))) );
+   return mkexpr(guard);
+}
+
+static Bool constToLong ( IRExpr* e, Long* res )
 {
-  PG_Func *caller_func;
-  PG_Func *target_func;
-  PG_CallHistory *call_history;  
-  PG_Calls *target;
-  
-  /* Extend target call history list to next iteration */
-  target_func = getFunc(target_func_id);
-  tl_assert(target_func != NULL);
-  call_history = VG_(malloc) ("func_ht.node.call_history", sizeof (PG_CallHistory));
-  call_history->calls_ht = VG_(HT_construct) ( "calls_hash" );
-  call_history->next = target_func->call_history;
-  target_func->call_history = call_history;    
-  target_func->iteration++;
-  
-  caller_func = getFunc(caller_func_id);
-  tl_assert(caller_func != NULL);
-  
-  /* Append call to source caller */
-  target = VG_(HT_lookup) ( caller_func->call_history->calls_ht, target_func_id );
-  if (target == NULL) {
-	// Create new hash table node
-    target = VG_(malloc) ("trace_calls.calls", sizeof(PG_Calls));
-    target->target_id = target_func_id;
-    target->iteration = target_func->iteration;
-    target->ll_next = NULL;
-    VG_(HT_add_node) ( caller_func->call_history->calls_ht, target );
-  } else {
-	// Extend hash table linked list for this call
-    PG_Calls *new_target = VG_(malloc) ("trace_calls.calls", sizeof(PG_Calls));
-    new_target->target_id = target_func_id;
-    new_target->iteration = target_func->iteration;
-    new_target->ll_next = target;
-    VG_(HT_remove) ( caller_func->call_history->calls_ht, target_func_id  );
-	VG_(HT_add_node) (caller_func->call_history->calls_ht, new_target);
-  }
+   if (e->tag != Iex_Const) return False;
+   switch (e->Iex.Const.con->tag) {
+      case Ico_U32: *res = (Long)(Int)e->Iex.Const.con->Ico.U32; return True;
+      case Ico_U64: *res = (Long)e->Iex.Const.con->Ico.U64;      return True;
+      default:      return False;
+   }
+}
 
+/* Pre-pass over sbIn: record, for every temp, the base temp it is a
+   constant offset from.  The IR is flat and in SSA form, so a temp's
+   definition is always seen before any use of it. */
+static void findAddrBases ( IRSB* sbIn )
+{
+   Int i;
+   if (addr_bases_size < sbIn->tyenv->types_used) {
+      addr_bases_size = sbIn->tyenv->types_used;
+      addr_bases = VG_(realloc)( "pg.addr_bases", addr_bases,
+                                 addr_bases_size * sizeof(AddrBase) );
+   }
+   for (i = 0; i < sbIn->tyenv->types_used; i++) {
+      addr_bases[i].base   = i;
+      addr_bases[i].offset = 0;
+   }
+   for (i = 0; i < sbIn->stmts_used; i++) {
+      IRStmt* st = sbIn->stmts[i];
+      IRExpr* data;
+      Long    c;
+      if (!st || st->tag != Ist_WrTmp) continue;
+      data = st->Ist.WrTmp.data;
+      if (data->tag != Iex_Binop
+          || data->Iex.Binop.arg1->tag != Iex_RdTmp
+          || !constToLong(data->Iex.Binop.arg2, &c))
+         continue;
+      switch (data->Iex.Binop.op) {
+         case Iop_Add32: case Iop_Add64: break;
+         case Iop_Sub32: case Iop_Sub64: c = -c; break;
+         default: continue;
+      }
+      addr_bases[st->Ist.WrTmp.tmp] 
+         = addr_bases[data->Iex.Binop.arg1->Iex.RdTmp.tmp];
+      addr_bases[st->Ist.WrTmp.tmp].offset += c;
+   }
+}
 
-   // Check for a marker function call
-  if (target_func_id == 27) {
-	  if (clo_trace_mem) {
-		  // TODO - live output on boundary function detection
-	  }
-  }
-  
+static void setEventBase ( Event* evt )
+{
+   if (evt->addr->tag == Iex_RdTmp) {
+      AddrBase* ab = &addr_bases[evt->addr->Iex.RdTmp.tmp];
+      evt->base   = ab->base;
+      evt->offset = ab->offset;
+   } else {
+      evt->base   = IRTemp_INVALID;
+      evt->offset = 0;
+   }
 }
 
-static VG_REGPARM(2) void trace_call_indirect(UWord caller_func_id, 
-					      Addr target_addr)
+/* Try to fold a data access into a pending event with the same base
+   temp and function, as long as the combined span and byte totals stay
+   within MAX_DSIZE.  The coalesced event is reported with its whole
+   span, whose bytes are shared out among the objects it overlaps; see
+   update_span_access. */
+static Bool coalesceEvent ( EventKind ekind, IRAtom* daddr, Int dsize,
+                            UWord func_id )
 {
-  PG_Func *caller_func;
-  PG_Func *target_func;
-  PG_CallHistory *call_history;  
-  PG_Calls *target;
-  UWord target_func_id;
-  
-  caller_func = getFunc(caller_func_id);
-  tl_assert(caller_func != NULL);
-  target_func_id = getFuncId(target_addr, func_ht);
-  
-  /* Extend call history list */
-  target_func = getFunc(target_func_id);
-  tl_assert(target_func != NULL);
-  call_history = VG_(malloc) ("func_ht.node.call_history", sizeof (PG_CallHistory));
-  call_history->calls_ht = VG_(HT_construct) ( "calls_hash" );
-  call_history->next = target_func->call_history;
-  target_func->call_history = call_history;    
-  target_func->iteration++;
-  
-  /* Append call to source caller */
-  target = VG_(HT_lookup) ( caller_func->call_history->calls_ht, target_func_id );
-  if (target == NULL) {
-	// Create new hash table node
-    target = VG_(malloc) ("trace_calls.calls", sizeof(PG_Calls));
-    target->target_id = target_func_id;
-    target->iteration = target_func->iteration;
-    target->ll_next = NULL;
-    VG_(HT_add_node) ( caller_func->call_history->calls_ht, target );
-  } else {
-	// Extend hash table linked list for this call
-    PG_Calls *new_target = VG_(malloc) ("trace_calls.calls", sizeof(PG_Calls));
-    new_target->target_id = target_func_id;
-    new_target->iteration = target_func->iteration;
-    new_target->ll_next = target;
-    VG_(HT_remove) ( caller_func->call_history->calls_ht, target_func_id  );
-	VG_(HT_add_node) (caller_func->call_history->calls_ht, new_target);
-  }
-  
+   Int    i;
+   Event  nyu;
+   nyu.addr = daddr;
+   setEventBase( &nyu );
+   if (nyu.base == IRTemp_INVALID) return False;
+
+   for (i = events_used - 1; i >= 0; i--) {
+      Event* ev = &events[i];
+      Long   lo, hi;
+      Int    rd, wr;
+      if (ev->ekind == Event_Ir || ev->base != nyu.base 
+          || ev->func_id != func_id)
+         continue;
+      lo = ev->offset < nyu.offset ? ev->offset : nyu.offset;
+      hi = ev->offset + ev->size > nyu.offset + dsize 
+              ? ev->offset + ev->size : nyu.offset + dsize;
+      rd = ev->bytes_read    + (ekind == Event_Dr ? dsize : 0);
+      wr = ev->bytes_written + (ekind == Event_Dw ? dsize : 0);
+      if (hi - lo > MAX_DSIZE || rd > MAX_DSIZE || wr > MAX_DSIZE)
+         continue;
+      ev->ekind         = Event_Dspan;
+      ev->offset        = lo;
+      ev->size          = hi - lo;
+      ev->bytes_read    = rd;
+      ev->bytes_written = wr;
+      return True;
+   }
+   return False;
+}
+
+/* Return an atom for the address 'offset' bytes into the base temp of a
+   coalesced event. */
+static IRAtom* spanAddr ( IRSB* sb, Event* ev, Long offset )
+{
+   IRType tyW = sizeof(UWord) == 8 ? Ity_I64 : Ity_I32;
+   IRTemp t;
+   if (offset == 0)
+      return IRExpr_RdTmp(ev->base);
+   t = newIRTemp(sb->tyenv, tyW);
+   addStmtToIRSB( sb, IRStmt_WrTmp(t, 
+                     IRExpr_Binop(sizeof(UWord) == 8 ? Iop_Add64 : Iop_Add32,
+                                  IRExpr_RdTmp(ev->base),
+                                  mkIRExpr_HWord( (HWord)offset ))) );
+   return IRExpr_RdTmp(t);
 }
 
 static void flushEvents(IRSB* sb)
@@ -429,6 +2003,34 @@ static void flushEvents(IRSB* sb)
 
       ev = &events[i];
       
+      if (ev->ekind == Event_Dspan) {
+         IRAtom* addr = spanAddr( sb, ev, ev->offset );
+         if (clo_batch_events > 0) {
+            addBatchedSpan( sb, addr, ev );
+         } else {
+            IRAtom* last = spanAddr( sb, ev, ev->offset + ev->size - 1 );
+            argv = mkIRExprVec_5( addr,
+                                  mkIRExpr_HWord( ev->size ),
+                                  mkIRExpr_HWord( ev->bytes_read ),
+                                  mkIRExpr_HWord( ev->bytes_written ),
+                                  mkIRExpr_HWord( ev->func_id ) );
+            di   = unsafeIRDirty_0_N( /*regparms*/0, 
+                                      "trace_access",
+                                      VG_(fnptr_to_fnentry)( trace_access ),
+                                      argv );
+            di->guard = mkTrackedGuard( sb, addr, last );
+            addStmtToIRSB( sb, IRStmt_Dirty(di) );
+         }
+         continue;
+      }
+
+      if (clo_batch_events > 0) {
+         if (ev->ekind != Event_Ir) {
+            addBatchedEvent( sb, ev );
+         }
+         continue;
+      }
+
       // Decide on helper fn to call and args to pass it.
       switch (ev->ekind) {
          case Event_Ir: continue;
@@ -450,6 +2052,7 @@ static void flushEvents(IRSB* sb)
       di   = unsafeIRDirty_0_N( /*regparms*/3, 
                                 helperName, VG_(fnptr_to_fnentry)( helperAddr ),
                                 argv );
+      di->guard = mkTrackedGuard( sb, ev->addr, NULL );
       addStmtToIRSB( sb, IRStmt_Dirty(di) );
    }
 
@@ -473,6 +2076,10 @@ static void addEvent_Ir ( IRSB* sb, IRAtom* iaddr, UInt isize, UWord func_id )
    evt->addr    = iaddr;
    evt->size    = isize;
    evt->func_id = func_id;
+   evt->base    = IRTemp_INVALID;
+   evt->offset  = 0;
+   evt->bytes_read    = 0;
+   evt->bytes_written = 0;
    events_used++;
 }
 
@@ -483,6 +2090,8 @@ void addEvent_Dr ( IRSB* sb, IRAtom* daddr, Int dsize, UWord func_id )
    tl_assert(clo_trace_mem);
    tl_assert(isIRAtom(daddr));
    tl_assert(dsize >= 1 && dsize <= MAX_DSIZE);
+   if (coalesceEvent(Event_Dr, daddr, dsize, func_id))
+      return;
    if (events_used == N_EVENTS)
       flushEvents(sb);
    tl_assert(events_used >= 0 && events_used < N_EVENTS);
@@ -491,6 +2100,9 @@ void addEvent_Dr ( IRSB* sb, IRAtom* daddr, Int dsize, UWord func_id )
    evt->addr  = daddr;
    evt->size  = dsize;
    evt->func_id = func_id;
+   setEventBase(evt);
+   evt->bytes_read    = dsize;
+   evt->bytes_written = 0;
    events_used++;
 }
 
@@ -511,9 +2123,14 @@ void addEvent_Dw ( IRSB* sb, IRAtom* daddr, Int dsize, UWord func_id )
     && eqIRAtom(lastEvt->addr, daddr))
    {
       lastEvt->ekind = Event_Dm;
+      lastEvt->bytes_written = dsize;
       return;
    }
 
+   // Or to fold it into a pending access off the same base?
+   if (coalesceEvent(Event_Dw, daddr, dsize, func_id))
+      return;
+
    // No.  Add as normal.
    if (events_used == N_EVENTS)
       flushEvents(sb);
@@ -523,19 +2140,25 @@ void addEvent_Dw ( IRSB* sb, IRAtom* daddr, Int dsize, UWord func_id )
    evt->size  = dsize;
    evt->addr  = daddr;
    evt->func_id = func_id;
+   setEventBase(evt);
+   evt->bytes_read    = 0;
+   evt->bytes_written = dsize;
    events_used++;
 }
 
+/* A call or jump to target_func_id; if guard is not NULL, it is the
+   guard of a side exit and the helper only runs when the exit is taken. */
 static
-void addEvent_Call ( IRSB* sb, UWord func_id, UWord target_func_id )
+void addEvent_Call ( IRSB* sb, UWord func_id, UWord target_func_id,
+                     Bool is_call, IRExpr* guard )
 {
   Char*      helperName;
   void*      helperAddr;
   IRExpr**   argv;
   IRDirty*   di;
 
-  helperName = "trace_call";
-  helperAddr =  trace_call;
+  helperName = is_call ? "trace_call" : "trace_jump";
+  helperAddr = is_call ?  trace_call  :  trace_jump;
 
   // Add the helper.
   argv = mkIRExprVec_2( mkIRExpr_HWord( func_id ), 
@@ -543,20 +2166,21 @@ void addEvent_Call ( IRSB* sb, UWord func_id, UWord target_func_id )
   di   = unsafeIRDirty_0_N( /*regparms*/2, 
 			    helperName, VG_(fnptr_to_fnentry)( helperAddr ),
 			    argv );
+  if (guard) di->guard = guard;
   addStmtToIRSB( sb, IRStmt_Dirty(di) );
-  
 }
 
 static
-void addEvent_Call_Indirect ( IRSB *sb, UWord func_id, IRExpr *target_addr )
+void addEvent_Call_Indirect ( IRSB *sb, UWord func_id, IRExpr *target_addr,
+                              Bool is_call )
 {
   Char*      helperName;
   void*      helperAddr;
   IRExpr**   argv;
   IRDirty*   di;
 
-  helperName = "trace_call_indirect";
-  helperAddr =  trace_call_indirect;
+  helperName = is_call ? "trace_call_indirect" : "trace_jump_indirect";
+  helperAddr = is_call ?  trace_call_indirect  :  trace_jump_indirect;
 
   // Add the helper.
   argv = mkIRExprVec_2( mkIRExpr_HWord( func_id ), 
@@ -567,6 +2191,17 @@ void addEvent_Call_Indirect ( IRSB *sb, UWord func_id, IRExpr *target_addr )
   addStmtToIRSB( sb, IRStmt_Dirty(di) );
 }
 
+static
+void addEvent_Return ( IRSB *sb, UWord func_id )
+{
+  IRDirty*   di;
+
+  di   = unsafeIRDirty_0_N( /*regparms*/1, 
+			    "trace_return", VG_(fnptr_to_fnentry)( trace_return ),
+			    mkIRExprVec_1( mkIRExpr_HWord( func_id ) ) );
+  addStmtToIRSB( sb, IRStmt_Dirty(di) );
+}
+
 static
 IRSB* pg_instrument ( VgCallbackClosure* closure,
                       IRSB* sbIn, 
@@ -578,12 +2213,16 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
    IRSB*      sbOut;
    IRTypeEnv* tyenv = sbIn->tyenv;
    UWord      func_id = -1;       
+   UWord      mem_fid = -1;       /* func_id for memory events */
+   Bool       instr   = True;     /* whether func_id is instrumented */
 
    if (gWordTy != hWordTy) {
       /* We don't currently support this case. */
       VG_(tool_panic)("host/guest word size mismatch");
    }
 
+   if (!tracing) return sbIn;
+
    /* Set up SB */
    sbOut = deepCopyIRSBExceptStmts(sbIn);
   
@@ -596,10 +2235,18 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
 
    if (clo_trace_mem) {
       events_used = 0;
+      findAddrBases(sbIn);
+      /* Step the thread's block countdown once per execution */
+      block_sampled = clo_sample_blocks > 1
+                      ? mkSampleGuard( sbOut, &sample_blocks_left,
+                                       clo_sample_blocks, NULL )
+                      : NULL;
    }
    
    if (i < sbIn->stmts_used) {
-     func_id = getFuncId(sbIn->stmts[i]->Ist.IMark.addr, func_ht);
+     func_id = lookupFuncId(sbIn->stmts[i]->Ist.IMark.addr);
+     instr   = getFunc(func_id)->instrumented;
+     mem_fid = instr ? func_id : ATTRIB_FUNC_ID;
    }     
 
    for (/*use current i*/; i < sbIn->stmts_used; i++) {
@@ -618,23 +2265,26 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
          case Ist_IMark:
 	   {
 	     /* reset function id if it has changed */
-	     Int new_func_id = getFuncId(sbIn->stmts[i]->Ist.IMark.addr, func_ht);
+	     Int new_func_id = lookupFuncId(sbIn->stmts[i]->Ist.IMark.addr);
 	     if (new_func_id != func_id) {
 	       /* changed functions midway through a block */
-	       if (clo_trace_calls) {
-		 addEvent_Call( sbOut, func_id, new_func_id);
-	       }
+	       /* The events so far are the old function's */
 	       if (clo_trace_mem) {
 		 flushEvents(sbOut);
 	       }
+	       if (clo_trace_calls && instr) {
+		 addEvent_Call( sbOut, func_id, new_func_id, False, NULL );
+	       }
 	       func_id = new_func_id;
+	       instr   = getFunc(func_id)->instrumented;
+	       mem_fid = instr ? func_id : ATTRIB_FUNC_ID;
 	     }
 	     if (clo_trace_mem) {
                // WARNING: do not remove this function call, even if you
                // aren't interested in instruction reads.  See the comment
                // above the function itself for more detail.
                addEvent_Ir( sbOut, mkIRExpr_HWord( (HWord)st->Ist.IMark.addr ),
-                            st->Ist.IMark.len, func_id );
+                            st->Ist.IMark.len, mem_fid );
 	     }
 	     addStmtToIRSB( sbOut, st );
 	     break;
@@ -644,7 +2294,7 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
                IRExpr* data = st->Ist.WrTmp.data;
                if (data->tag == Iex_Load) {
                   addEvent_Dr( sbOut, data->Iex.Load.addr,
-                               sizeofIRType(data->Iex.Load.ty), func_id );
+                               sizeofIRType(data->Iex.Load.ty), mem_fid );
                }
             }
             addStmtToIRSB( sbOut, st );
@@ -654,7 +2304,7 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
             if (clo_trace_mem) {
                IRExpr* data  = st->Ist.Store.data;
                addEvent_Dw( sbOut, st->Ist.Store.addr,
-                            sizeofIRType(typeOfIRExpr(tyenv, data)), func_id );
+                            sizeofIRType(typeOfIRExpr(tyenv, data)), mem_fid );
             }
             addStmtToIRSB( sbOut, st );
             break;
@@ -669,9 +2319,9 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
                   tl_assert(d->mSize != 0);
                   dsize = d->mSize;
                   if (d->mFx == Ifx_Read || d->mFx == Ifx_Modify)
-                     addEvent_Dr( sbOut, d->mAddr, dsize, func_id );
+                     addEvent_Dr( sbOut, d->mAddr, dsize, mem_fid );
                   if (d->mFx == Ifx_Write || d->mFx == Ifx_Modify)
-                     addEvent_Dw( sbOut, d->mAddr, dsize, func_id );
+                     addEvent_Dw( sbOut, d->mAddr, dsize, mem_fid );
                } else {
                   tl_assert(d->mAddr == NULL);
                   tl_assert(d->mSize == 0);
@@ -697,8 +2347,8 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
             if (cas->dataHi != NULL)
                dataSize *= 2; /* since it's a doubleword-CAS */
             if (clo_trace_mem) {
-               addEvent_Dr( sbOut, cas->addr, dataSize, func_id );
-               addEvent_Dw( sbOut, cas->addr, dataSize, func_id );
+               addEvent_Dr( sbOut, cas->addr, dataSize, mem_fid );
+               addEvent_Dw( sbOut, cas->addr, dataSize, mem_fid );
             }
             addStmtToIRSB( sbOut, st );
             break;
@@ -711,13 +2361,13 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
                dataTy = typeOfIRTemp(tyenv, st->Ist.LLSC.result);
                if (clo_trace_mem)
                   addEvent_Dr( sbOut, st->Ist.LLSC.addr,
-                                      sizeofIRType(dataTy), func_id );
+                                      sizeofIRType(dataTy), mem_fid );
             } else {
                /* SC */
                dataTy = typeOfIRExpr(tyenv, st->Ist.LLSC.storedata);
                if (clo_trace_mem)
                   addEvent_Dw( sbOut, st->Ist.LLSC.addr,
-                                      sizeofIRType(dataTy), func_id );
+                                      sizeofIRType(dataTy), mem_fid );
             }
             addStmtToIRSB( sbOut, st );
             break;
@@ -725,18 +2375,20 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
 
          case Ist_Exit:
 
-	   if (clo_trace_calls) {
+	   if (clo_trace_mem) {
+	     flushEvents(sbOut);
+	   }
+	   if (clo_trace_calls && instr) {
 	     if (st->Ist.Exit.jk == Ijk_Call || st->Ist.Exit.jk ==  Ijk_Boring) {
+	       Bool is_call = st->Ist.Exit.jk == Ijk_Call;
 	       Addr target = irConstToAddr(st->Ist.Exit.dst);
-	       UWord target_fid = getFuncId(target, func_ht);
-	       if (target_fid != func_id) {
-		 addEvent_Call( sbOut, func_id, target_fid);
+	       UWord target_fid = lookupFuncId(target);
+	       if (is_call || target_fid != func_id) {
+		 addEvent_Call( sbOut, func_id, target_fid, is_call,
+				st->Ist.Exit.guard );
 	       }
 	     }
 	   }
-	   if (clo_trace_mem) {
-	     flushEvents(sbOut);
-	   }
 	   
 	   addStmtToIRSB( sbOut, st );
 	   
@@ -747,21 +2399,31 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
       }
    }
 
-   if (clo_trace_calls) {
+   if (clo_trace_mem) {
+      /* At the end of the sbIn.  Flush outstandings, before any call
+         starts a new iteration. */
+      flushEvents(sbOut);
+   }
+
+   if (clo_trace_calls && instr) {
+     if (sbIn->jumpkind == Ijk_Ret) {
+       addEvent_Return( sbOut, func_id );
+     }
      if (sbIn->jumpkind == Ijk_Call || sbIn->jumpkind == Ijk_Boring) {
+       Bool is_call = sbIn->jumpkind == Ijk_Call;
        switch (sbIn->next->tag) {
        case Iex_Const:
 	 {
 	   Addr target = irConstToAddr(sbIn->next->Iex.Const.con);
-	   UWord target_fid = getFuncId(target, func_ht);
-	   if (target_fid != func_id) {
-	     addEvent_Call( sbOut, func_id, target_fid);
+	   UWord target_fid = lookupFuncId(target);
+	   if (is_call || target_fid != func_id) {
+	     addEvent_Call( sbOut, func_id, target_fid, is_call, NULL );
 	   }
 	   break;
 	 }
        case Iex_RdTmp:
 	 /* looks like an indirect branch (branch to unknown) */
-	 addEvent_Call_Indirect( sbOut, func_id, sbIn->next );
+	 addEvent_Call_Indirect( sbOut, func_id, sbIn->next, is_call );
 	 break;
        default:
 	 /* shouldn't happen - if the incoming IR is properly
@@ -771,11 +2433,6 @@ IRSB* pg_instrument ( VgCallbackClosure* closure,
        }
      }
    }
-   if (clo_trace_mem) {
-      /* At the end of the sbIn.  Flush outstandings. */
-      flushEvents(sbOut);
-   }
-
 
    return sbOut;
 }
@@ -785,9 +2442,9 @@ static void pg_out_fun (void)
 {
 
 	PG_Func * func;
-	PG_Calls * call;
-	PG_CallHistory * call_history;
-	unsigned int i;
+	PG_CallEdge * call;
+	unsigned int i, r;
+	Word k;
 	
   VG_(HT_ResetIter)(func_ht);
   while ( (func = VG_(HT_Next)(func_ht)) ) {
@@ -796,73 +2453,278 @@ static void pg_out_fun (void)
 		 
     if (clo_trace_calls) {
 	  
-      i=func->iteration;
-      call_history = func->call_history;
-      while (i>0) {
-		  VG_(printf) ("  ITERATION: %lu \n", i );
-		  VG_(HT_ResetIter)(call_history->calls_ht);
-		  while ( (call = VG_(HT_Next)(call_history->calls_ht)) ) {
-			  
-			while (call != NULL) {
-				
-				VG_(printf) ("  	CALL: %lu, iter:%u \n",
-				call->target_id, call->iteration);
-				
-				call = call->ll_next;
-			}
-		  
+      /* Walk the call log backwards, most recent iteration first */
+      i=func->iteration + 1;
+      for (k = VG_(sizeXA)(func->calls) - 1; k >= 0; k--) {
+		  call = VG_(indexXA)(func->calls, k);
+		  for (r = call->run; r > 0; r--) {
+			  if (call->caller_iter + r - 1 == 0) break;
+			  while (i > call->caller_iter + r - 1) {
+				  i--;
+				  if (rep_iteration(func, i) == i)
+					  VG_(printf) ("  ITERATION: %lu \n", i );
+			  }
+			  VG_(printf) ("  	CALL: %lu, iter:%u \n",
+				call->target_id, call->target_iter + r - 1);
 		  }
-		  call_history = call_history->next;
+      }
+      while (i>1) {
 		  i--;
+		  if (rep_iteration(func, i) == i)
+			  VG_(printf) ("  ITERATION: %lu \n", i );
       }
       
     }
   }
 }
 
-/* Output data object details */
-static void pg_out_obj (PG_PageRange * page, PG_DataObj * addr)
+static void pg_out_accesses (PG_DataObj * addr)
 {
   PG_Access  * access;
+
+	VG_(HT_ResetIter)(addr->access_ht);
+	while ( (access = VG_(HT_Next)(addr->access_ht)) ) {
+		while (access != NULL) { 
+			VG_(printf) ("  ACCESS: %lu, iter:%u, %lu, %lu\n",
+				access->func_id, access->iteration,
+				access->bytes_read, access->bytes_written);
+			access = access->ll_next;
+		}
+	}
+}
+
+/* Output data object details */
+static void pg_out_obj (void)
+{
+  PG_DataObj * addr;
   
-	addr = freed_objs.first;
+	addr = freed_objs;
 	while (addr != NULL) {
-		if (VG_(HT_count_nodes) (addr->access_ht) > 1) {
+		if (obj_shared(addr)) {
 			VG_(printf) ("ADDR: 0x%lx\n", addr->addr);
-			VG_(HT_ResetIter)(addr->access_ht);
-			while ( (access = VG_(HT_Next)(addr->access_ht)) ) {
-				
-				while (access != NULL) { 
-					VG_(printf) ("  ACCESS: %lu, iter:%u, %lu, %lu\n",
-						access->func_id, access->iteration,
-						access->bytes_read, access->bytes_written);
-					access = access->ll_next;
-				}
-						
-			}
+			pg_out_accesses(addr);
 		
-		VG_(HT_destruct) (addr->access_ht);
+		PG_(destroy_pooled_ht) (addr->access_ht);
 		
 		}
 	  addr = addr->next;
 	}
+
+	if (site_ht == NULL) return;
+	VG_(HT_ResetIter)(site_ht);
+	while ( (addr = VG_(HT_Next)(site_ht)) ) {
+		if (obj_shared(addr)) {
+			VG_(printf) ("SITE: %lu, size:%lu\n", addr->addr, addr->size);
+			VG_(pp_ExeContext)(VG_(get_ExeContext_from_ECU)(addr->addr));
+			pg_out_accesses(addr);
+		}
+		release_accesses(addr);
+	}
 }
 
-static void pg_write_json()
+/* Previous values of the delta encoded fields of the binary dump; the
+   records streamed out as objects are freed come first in the final
+   file, so the state carries over to the records written at exit. */
+static Addr  bin_prev_loc      = 0;
+static Addr  bin_prev_target   = 0;
+static UWord bin_prev_acc_iter = 0;
+static UInt  bin_prev_src_iter = 0;
+static UInt  bin_prev_tgt_iter = 0;
+
+/* Write the "calls" records of one of func's call edges. */
+static void pg_json_call( PG_Writer* w, PG_Func* func, PG_CallEdge* call )
 {
-	
-	Int     fd;
-	SysRes  sres;
-	Char    buf[512];
-   
-	PG_PageRange * page;
+	PG_Func * target = getFunc(call->target_id);
+	UInt i, r, t;
+
+	if (func->id == 0 || call->target_id == 0) return;
+	for (r = call->run; r > 0; r--) {
+		i = call->caller_iter + r - 1;
+		if (i == 0) continue;
+		t = rep_iteration(target, call->target_iter + r - 1);
+		if (clo_binary) {
+			PG_(writer_uvarint) (w, PG_BIN_RECORD);
+			PG_(writer_uvarint) (w, func->id);
+			PG_(writer_svarint) (w, (Long)i - bin_prev_src_iter);
+			PG_(writer_uvarint) (w, call->target_id);
+			PG_(writer_svarint) (w, (Long)t - bin_prev_tgt_iter);
+			PG_(writer_uvarint) (w, call->tid);
+			bin_prev_src_iter = i;
+			bin_prev_tgt_iter = t;
+			continue;
+		}
+		PG_(writer_printf) (w,
+			"		{\"id\":%u, "
+			"\"source_id\":%u,  \"source_iteration\":%u, "
+			"\"target_id\":%u, \"target_iteration\":%u, "
+			"\"thread\":%u },\n",
+			json_call_id++, func->id, i, call->target_id, t, call->tid
+		);
+	}
+}
+
+/* Write the "locations" record of an object, if it was accessed by more
+   than one function. */
+static void pg_json_location( PG_Writer* w, PG_DataObj* addr )
+{
+	if (!obj_shared(addr)) return;
+
+	if (clo_binary) {
+		PG_(writer_uvarint) (w, PG_BIN_RECORD);
+		PG_(writer_svarint) (w, (Long)(addr->addr - bin_prev_loc));
+		bin_prev_loc = addr->addr;
+	} else {
+		PG_(writer_printf) (w, "		{\"id\":%lu },\n", addr->addr);
+	}
+}
+
+/* Write the "sites" record of an allocation site, if it was accessed by
+   more than one function.  Its id is the ECU of its stack, which is not
+   an address, so sites are kept apart from locations. */
+static void pg_json_site( PG_Writer* w, PG_DataObj* site )
+{
+	if (!obj_shared(site)) return;
+
+	if (clo_binary) {
+		PG_(writer_uvarint) (w, PG_BIN_RECORD);
+		PG_(writer_uvarint) (w, site->addr);
+		PG_(writer_uvarint) (w, site->size);
+	} else {
+		PG_(writer_printf) (w, "		{\"id\":%lu, \"size\":%lu },\n",
+			site->addr, site->size);
+	}
+}
+
+/* Write the "accesses" records of an object, or of an allocation site if
+   'site' is set, if it was accessed by more than one function.  Accesses
+   to a site name it by "target_site" rather than "target_id". */
+static void pg_json_accesses( PG_Writer* w, PG_DataObj* addr, Bool site )
+{
+	PG_Access * access;
+
+	if (!obj_shared(addr)) return;
+
+	// Scan through accesses
+	VG_(HT_ResetIter)(addr->access_ht);
+	while ( (access = VG_(HT_Next)(addr->access_ht)) ) {
+		while (access != NULL) {
+			if (clo_binary) {
+				PG_(writer_uvarint) (w, site ? PG_BIN_SITE_RECORD
+				                             : PG_BIN_RECORD);
+				PG_(writer_uvarint) (w, access->func_id);
+				PG_(writer_svarint) (w,
+					(Long)(access->iteration - bin_prev_acc_iter));
+				if (site) {
+					PG_(writer_uvarint) (w, addr->addr);
+				} else {
+					PG_(writer_svarint) (w,
+						(Long)(addr->addr - bin_prev_target));
+					bin_prev_target = addr->addr;
+				}
+				PG_(writer_uvarint) (w, access->bytes_read);
+				PG_(writer_uvarint) (w, access->bytes_written);
+				PG_(writer_uvarint) (w, access->tid);
+				bin_prev_acc_iter = access->iteration;
+				json_access_id++;
+			} else {
+				PG_(writer_printf) (w, "		{\"id\":%u, "
+					"\"source_id\":%lu, \"source_iteration\":%lu, \"%s\":%lu, "
+					"\"bytes_read\":%lu, \"bytes_written\":%lu, \"thread\":%u},\n",
+					json_access_id++, access->func_id, access->iteration,
+					site ? "target_site" : "target_id", addr->addr,
+					access->bytes_read, access->bytes_written, access->tid);
+			}
+			access = access->ll_next;
+		}
+	}
+}
+
+/* Close a streamed section's temporary file and copy it into w. */
+static void pg_json_stream_append( PG_Writer* w, PG_Writer** sw, Char* file )
+{
+	if (*sw == NULL) return;
+	PG_(writer_close)(*sw);
+	*sw = NULL;
+	PG_(writer_append_file)(w, file);
+	VG_(unlink)(file);
+}
+
+static void pg_json_section_start( PG_Writer* w, const HChar* name )
+{
+	if (!clo_binary) PG_(writer_printf) (w, "\n	\"%s\":[\n", name);
+}
+
+static void pg_json_section_end( PG_Writer* w, Bool last )
+{
+	if (clo_binary)
+		PG_(writer_uvarint) (w, PG_BIN_END);
+	else
+		PG_(writer_printf) (w, last ? "		{}\n	]\n}" : "		{}\n	],\n");
+}
+
+static Word cmp_strings ( UWord key1, UWord key2 )
+{
+	return VG_(strcmp) ( (Char*)key1, (Char*)key2 );
+}
+
+/* Write the string table of the binary dump, holding every function and
+   file name once, and return the map from name to its index. */
+static WordFM* pg_bin_strings( PG_Writer* w )
+{
+	WordFM  * idx = VG_(newFM) ( VG_(malloc), "pg.bin_strings", VG_(free),
+	                             cmp_strings );
+	XArray  * tab = VG_(newXA) ( VG_(malloc), "pg.bin_strtab", VG_(free),
+	                             sizeof(Char*) );
+	PG_Func * func;
+	Char    * name[3];
+	Word      k, n;
+
+	name[0] = "";
+	VG_(addToFM) (idx, (UWord)name[0], 0);
+	VG_(addToXA) (tab, &name[0]);
+
+	VG_(HT_ResetIter)(func_ht);
+	while ( (func = VG_(HT_Next)(func_ht)) ) {
+		name[1] = func->fnname;
+		name[2] = func->filename;
+		for (k = 1; k <= 2; k++) {
+			if (name[k] == NULL
+			    || VG_(lookupFM) (idx, NULL, NULL, (UWord)name[k])) continue;
+			VG_(addToFM) (idx, (UWord)name[k], VG_(sizeXA)(tab));
+			VG_(addToXA) (tab, &name[k]);
+		}
+	}
+
+	n = VG_(sizeXA)(tab);
+	PG_(writer_uvarint) (w, n);
+	for (k = 0; k < n; k++) {
+		Char * str = *(Char**)VG_(indexXA)(tab, k);
+		SizeT  len = VG_(strlen)(str);
+		PG_(writer_uvarint) (w, len);
+		PG_(writer_write) (w, str, len);
+	}
+	VG_(deleteXA) (tab);
+	return idx;
+}
+
+static UWord pg_bin_string( WordFM* idx, Char* name )
+{
+	UWord keyW, valW;
+	if (name == NULL || !VG_(lookupFM) (idx, &keyW, &valW, (UWord)name))
+		return 0;
+	return valW;
+}
+
+static void pg_write_json( UInt epoch )
+{
+	PG_Writer * w;
+	WordFM * strs = NULL;
 	PG_DataObj * addr;
-	PG_Access  * access;
    	PG_Func * func;
-   	PG_Func * func_temp;
-	PG_Calls * call;
-	PG_CallHistory * call_history;
+	PG_CallEdge * call;
 	unsigned int i;
+	Word k;
+	UWord keyW, valW;
 
    // Setup output filename.  Nb: it's important to do this now, ie. as late
    // as possible.  If we do it at start-up and the program forks and the
@@ -872,140 +2734,162 @@ static void pg_write_json()
    Char* json_file =
       VG_(expand_file_name)("--json-file", clo_json_file);
 
-   sres = VG_(open)(json_file, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
-                                         VKI_S_IRUSR|VKI_S_IWUSR);
-   if (sr_isError(sres)) {
+   // Boundary snapshots go to <json-file>.<epoch>
+   if (epoch > 0) {
+      Char* snap_file = VG_(malloc)("pg.snap_file",
+                                    VG_(strlen)(json_file) + 12);
+      VG_(sprintf)(snap_file, "%s.%u", json_file, epoch);
+      VG_(free)(json_file);
+      json_file = snap_file;
+   }
+
+   w = PG_(writer_open)(json_file);
+   if (w == NULL) {
       // If the file can't be opened for whatever reason (conflict
       // between multiple privgrinded processes?), give up now.
-      VG_(umsg)("error: can't open JSON output file '%s'\n",
-                json_file );
+      VG_(umsg)("error: can't open %s output file '%s'\n",
+                clo_binary ? "binary" : "JSON", json_file );
       VG_(umsg)("       ... so output will be missing.\n");
       VG_(free)(json_file);
+      pg_json_stream_discard();
       return;
+   }
+   VG_(free)(json_file);
+
+   // Output start of JSON, or the header and string table of the binary dump
+   if (clo_binary) {
+      PG_(writer_write) (w, PG_BIN_MAGIC, PG_BIN_MAGIC_LEN);
+      PG_(writer_uvarint) (w, PG_BIN_VERSION);
+      PG_(writer_uvarint) (w, (clo_fold_iterations ? PG_BIN_FOLDED : 0)
+                              | (clo_by_site ? PG_BIN_ALLOC_SITES : 0));
+      strs = pg_bin_strings(w);
    } else {
-      fd = sr_Res(sres);
-      VG_(free)(json_file);
+      PG_(writer_printf) (w, "{\n	\"functions\":[\n");
    }
 
-   // Output start of JSON 
-   VG_(sprintf) (buf, "{\n	\"functions\":[\n");
-   VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-
    // Output list of functions
 	VG_(HT_ResetIter)(func_ht);
 	while ( (func = VG_(HT_Next)(func_ht)) ) {	  
-		i=func->iteration;
-		call_history = func->call_history;
-		while (i>0) {
-			// Output JSON string for function
-			if (func->id != 0) {
-				VG_(sprintf) (buf,
-					"		{\"id\":%u, \"iteration\":%u, \"label\":\"%s\" },\n",
-					func->id, i, func->fnname
+		if (clo_fold_iterations) {
+			// Output one JSON string per class of iterations
+			PG_IterClass * cls;
+			if (func->id == 0 || func->iter_classes == NULL) continue;
+			if (clo_binary) {
+				PG_(writer_uvarint) (w, PG_BIN_RECORD);
+				PG_(writer_uvarint) (w, func->id);
+				PG_(writer_uvarint) (w, pg_bin_string(strs, func->fnname));
+				PG_(writer_uvarint) (w, pg_bin_string(strs, func->filename));
+				PG_(writer_uvarint) (w, VG_(HT_count_nodes)(func->iter_classes));
+			}
+			VG_(HT_ResetIter)(func->iter_classes);
+			while ( (cls = VG_(HT_Next)(func->iter_classes)) ) {
+				if (clo_binary) {
+					PG_(writer_uvarint) (w, cls->rep);
+					PG_(writer_uvarint) (w, cls->count);
+					continue;
+				}
+				PG_(writer_printf) (w,
+					"		{\"id\":%u, \"iteration\":%u, \"label\":\"%s\", "
+					"\"count\":%llu },\n",
+					func->id, cls->rep, func->fnname, cls->count
 				);
-				VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
 			}
-			call_history = call_history->next;
+			continue;
+		}
+		if (func->id == 0) continue;
+		if (clo_binary) {
+			PG_(writer_uvarint) (w, PG_BIN_RECORD);
+			PG_(writer_uvarint) (w, func->id);
+			PG_(writer_uvarint) (w, pg_bin_string(strs, func->fnname));
+			PG_(writer_uvarint) (w, pg_bin_string(strs, func->filename));
+			PG_(writer_uvarint) (w, func->epoch_iter);
+			PG_(writer_uvarint) (w, func->iteration - func->epoch_iter);
+			continue;
+		}
+		i=func->iteration;
+		while (i>func->epoch_iter) {
+			// Output JSON string for function
+			PG_(writer_printf) (w,
+				"		{\"id\":%u, \"iteration\":%u, \"label\":\"%s\" },\n",
+				func->id, i, func->fnname
+			);
 			i--;
 		}
 	}
-	
-	VG_(sprintf) (buf,"		{}\n");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-	VG_(sprintf) (buf, "	],\n");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-
-	// Write function call links
-	VG_(sprintf) (buf, "\n	\"calls\":[\n");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
+	if (strs) VG_(deleteFM) (strs, NULL, NULL);
+	pg_json_section_end(w, False);
+
+	// Write function call links: those streamed out, then the rest
+	pg_json_section_start(w, "calls");
+	pg_json_stream_append(w, &stream_calls, stream_calls_file);
 	VG_(HT_ResetIter)(func_ht);
-	unsigned int j = 0;
 	while ( (func = VG_(HT_Next)(func_ht)) ) {	  
-		i=func->iteration;
-		call_history = func->call_history;
-		while (i>0) {
-			VG_(HT_ResetIter)(call_history->calls_ht);
-			while ( (call = VG_(HT_Next)(call_history->calls_ht)) ) {
-				while (call != NULL) {
-					func_temp = getFunc(call->target_id);
-					// Output JSON string for link
-					if (func->id != 0 && call->target_id!=0) {
-						VG_(sprintf) (buf,
-							"		{\"id\":%u, "
-							"\"source_id\":%u,  \"source_iteration\":%u, "
-							"\"target_id\":%u, \"target_iteration\":%u },\n",
-							j++, func->id, i, call->target_id, call->iteration
-						);
-						VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-					}
-					call = call->ll_next;
-				}
-			}
-			call_history = call_history->next;
-			i--;
+		for (k = VG_(sizeXA)(func->calls) - 1; k >= 0; k--) {
+			call = VG_(indexXA)(func->calls, k);
+			pg_json_call(w, func, call);
 		}
 	}
-	VG_(sprintf) (buf,"		{}\n");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
+	pg_json_section_end(w, False);
 
-	
-	VG_(sprintf) (buf, "	],\n");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-   
-
-	// Write data access nodes
-	VG_(sprintf) (buf, "\n	\"locations\":[\n");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-	addr = freed_objs.first;
-	j = 0;
-	while (addr != NULL) {
-		if (VG_(HT_count_nodes) (addr->access_ht) > 1) {
-			VG_(sprintf) (buf, "		{\"id\":%lu },\n", addr->addr);
-			VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
+	// Write data access nodes: those streamed out when freed, then the rest
+	pg_json_section_start(w, "locations");
+	pg_json_stream_append(w, &stream_locs, stream_locs_file);
+	for (addr = freed_objs; addr != NULL; addr = addr->next) {
+		pg_json_location(w, addr);
+	}
+	if (epoch > 0) {
+		// A snapshot also has the accesses made to objects still live
+		VG_(initIterFM)(live_objs);
+		while (VG_(nextIterFM)(live_objs, &keyW, &valW)) {
+			pg_json_location(w, (PG_DataObj *)keyW);
 		}
-		addr = addr->next;
+		VG_(doneIterFM)(live_objs);
 	}
-	VG_(sprintf) (buf,"		{}\n");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-	VG_(sprintf) (buf, "	],\n");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-
+	pg_json_section_end(w, False);
+
+	// Write allocation sites
+	pg_json_section_start(w, "sites");
+	if (site_ht != NULL) {
+		VG_(HT_ResetIter)(site_ht);
+		while ( (addr = VG_(HT_Next)(site_ht)) ) {
+			pg_json_site(w, addr);
+		}
+	}
+	pg_json_section_end(w, False);
 
 	// Write data access links
-	VG_(sprintf) (buf, "\n	\"accesses\":[\n");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-	addr = freed_objs.first;
-	j=0;
-	while (addr != NULL) {
-		if (VG_(HT_count_nodes) (addr->access_ht) > 1) {
-			// Scan through accesses
-			VG_(HT_ResetIter)(addr->access_ht);
-			while ( (access = VG_(HT_Next)(addr->access_ht)) ) {
-				while (access != NULL) {
-					
-					func_temp = getFunc(access->func_id);
-					
-					VG_(sprintf) (buf, "		{\"id\":%lu, "
-						"\"source_id\":%lu, \"source_iteration\":%lu, \"target_id\":%lu, "
-						"\"bytes_read\":%lu, \"bytes_written\":%lu},\n",
-						j++, access->func_id, access->iteration, addr->addr,
-						access->bytes_read, access->bytes_written);
-					VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-					
-					access = access->ll_next;
-				}
-			}
+	pg_json_section_start(w, "accesses");
+	pg_json_stream_append(w, &stream_accs, stream_accs_file);
+	for (addr = freed_objs; addr != NULL; addr = addr->next) {
+		pg_json_accesses(w, addr, False);
+	}
+	if (epoch > 0) {
+		VG_(initIterFM)(live_objs);
+		while (VG_(nextIterFM)(live_objs, &keyW, &valW)) {
+			pg_json_accesses(w, (PG_DataObj *)keyW, False);
 		}
-		addr = addr->next;
+		VG_(doneIterFM)(live_objs);
 	}
-	VG_(sprintf) (buf,"		{}\n");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-	VG_(sprintf) (buf, "	]\n}");
-	VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
-
-   // Close file
-   VG_(close) (fd);
-   	
+	if (site_ht != NULL) {
+		VG_(HT_ResetIter)(site_ht);
+		while ( (addr = VG_(HT_Next)(site_ht)) ) {
+			pg_json_accesses(w, addr, True);
+		}
+	}
+	pg_json_section_end(w, True);
+
+   // Flush and close file
+   PG_(writer_close) (w);
+   pg_json_stream_discard();
+
+   // The next file (snapshot) starts afresh
+   json_access_id    = 0;
+   json_call_id      = 0;
+   bin_prev_loc      = 0;
+   bin_prev_target   = 0;
+   bin_prev_acc_iter = 0;
+   bin_prev_src_iter = 0;
+   bin_prev_tgt_iter = 0;
 }
 
 /* Free up function table */
@@ -1015,49 +2899,78 @@ static void pg_free_table (void)
 	
   VG_(HT_ResetIter)(func_ht);
   while ( (func = VG_(HT_Next)(func_ht)) ) {
+    VG_(deleteXA) (func->calls);
+    if (func->iter_classes != NULL) VG_(HT_destruct) (func->iter_classes);
+    if (func->iter_map != NULL) VG_(deleteXA) (func->iter_map);
     if (func->id != UNKNOWN_FUNC_ID) { 
       VG_(free) (func->fnname);
       VG_(free) (func->filename);
       VG_(free) (func->dirname);
     }
   }
+  if (iter_sig != NULL) {
+    VG_(deleteXA) (iter_sig);
+    iter_sig = NULL;
+  }
 }
 
 static void pg_fini(Int exitcode)
 {
-  PG_PageRange * page;
-  PG_DataObj * addr;
+  PG_Func * func;
+
+  /* Close off the current iteration of every function */
+  if (clo_fold_iterations) {
+    PG_(drain_events)();
+    VG_(HT_ResetIter)(func_ht);
+    while ( (func = VG_(HT_Next)(func_ht)) ) {
+      finish_iteration(func);
+    }
+  }
 
-  /* Output function details */
+  /* The summary can't be printed once calls and freed objects have been
+     streamed out and released; the JSON file has it all */
+  if (!stream_objs) {
 	pg_out_fun();
+  }
 
 
   if (clo_trace_mem) {
 /*	  
-    // Scan through live list, adding to freed list
-    VG_(HT_ResetIter)(live_ht);
-    while ( (page = VG_(HT_Next)(live_ht)) ) {
-      addr = page->first;
-      while ( addr != NULL ) {
-				PG_DataObj * next = addr->next;
-				PG_(dataobj_node_freed)(addr->addr);
-				addr = next;
-      }
+    // Scan through live tree, adding to freed list
+    UWord keyW, valW;
+    for (;;) {
+      VG_(initIterFM)(live_objs);
+      if (!VG_(nextIterFM)(live_objs, &keyW, &valW)) break;
+      VG_(doneIterFM)(live_objs);
+      PG_(dataobj_node_freed)(((PG_DataObj *)keyW)->addr);
     }
 */
 
-	if (clo_json) pg_write_json();
-	
+	PG_(drain_events)();
+  }
+
+  /* The calls are written out even with --trace-mem=no */
+  if (clo_json) pg_write_json(0);
+
+  if (clo_trace_mem && !stream_objs) {
 	// Output data object details
-	pg_out_obj(page, addr);
-	
+	pg_out_obj();
   }
   
   /* Release memory for function table */
   pg_free_table();
+  destroyFuncIndex();
 
   VG_(HT_destruct) (func_ht);
-  VG_(HT_destruct) (live_ht);
+  VG_(deleteFM) (live_objs, NULL, NULL);
+  if (site_ht != NULL) PG_(destroy_pooled_ht) (site_ht);
+
+  if (VG_(clo_stats)) {
+    PG_(print_pool_stats)();
+    PG_(shadow_print_stats)();
+  }
+  PG_(shadow_destroy)();
+  PG_(destroy_pools)();
   
 }
 
@@ -1078,6 +2991,18 @@ static void pg_pre_clo_init(void)
                                    pg_print_usage,
                                    pg_print_debug_usage);
 
+   VG_(needs_client_requests)     (pg_handle_client_request);
+
+   VG_(track_start_client_code)   (pg_start_client_code);
+   VG_(track_pre_thread_ll_create)(pg_pre_thread_ll_create);
+
+   /* Function ranges of unmapped code are stale */
+   VG_(track_die_mem_munmap)      (pg_die_mem_munmap);
+
+   /* Globals are registered when their object's debuginfo is read */
+   VG_(track_new_mem_startup)     (pg_new_mem_mmap);
+   VG_(track_new_mem_mmap)        (pg_new_mem_mmap);
+
    VG_(needs_malloc_replacement)  (PG_(malloc),
                                    PG_(__builtin_new),
                                    PG_(__builtin_vec_new),
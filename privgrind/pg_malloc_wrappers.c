@@ -12,19 +12,19 @@
 static void* PG_(new_obj)  ( ThreadId tid, SizeT szB, SizeT alignB, 
 			     Bool is_zeroed)
 {
-  ExeContext* ec;
+  void *p;
+
+  PG_(drain_events)();
   
   // Allocate and zero if necessary
-  void *p = VG_(cli_malloc)( alignB, szB );
+  p = VG_(cli_malloc)( alignB, szB );
   if (!p) {
     return NULL;
   }
   if (is_zeroed) {
     VG_(memset)((void*)p, 0, szB);
   } 
-  ec = VG_(record_ExeContext)(tid, 0/*first_ip_delta*/);
-  tl_assert(ec);
-  PG_(dataobj_node_malloced)( (Addr) p, szB );
+  PG_(dataobj_alloc_site)( PG_(dataobj_node_malloced)( (Addr) p, szB ), tid );
 
   return p;
 }
@@ -32,6 +32,7 @@ static void* PG_(new_obj)  ( ThreadId tid, SizeT szB, SizeT alignB,
 
 static void PG_(handle_free) ( ThreadId tid, void *p )
 {
+  PG_(drain_events)();
   PG_(dataobj_node_freed)( (Addr) p );
   VG_(cli_free) ( p );
 }
@@ -82,13 +83,14 @@ void* PG_(realloc) (ThreadId tid, void* addr, SizeT new_szB)
    void       *p_new, *p_old;
    SizeT      old_szB;
 
+   PG_(drain_events)();
+
    /* Get the old block info */
    obj = PG_(dataobj_get_node)((Addr)addr);
    if (obj == NULL) {
       return NULL;
    }
 
-   obj = PG_(dataobj_get_node)( (Addr) addr );
    p_old   = addr; 
    old_szB = obj->size;
 
@@ -98,13 +100,9 @@ void* PG_(realloc) (ThreadId tid, void* addr, SizeT new_szB)
    if (p_new) {
      /* Copy from old to new */
      VG_(memcpy)(p_new, p_old, new_szB <= old_szB ? new_szB : old_szB);
-     
-     /* free old address */
-     VG_(cli_free) ( p_old );
 
      /* update data access node */
-     obj->addr = (Addr)p_new;
-     obj->size = new_szB;
+     PG_(dataobj_node_moved)( obj, (Addr)p_new, new_szB );
    } else {
      /* remove old address from live database */
      PG_(dataobj_node_freed)( (Addr) addr );
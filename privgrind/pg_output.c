@@ -0,0 +1,127 @@
+/*--------------------------------------------------------------------*/
+/*--- Privgrind: The Priv-seperation Valgrind tool.    pg_output.c ---*/
+/*--------------------------------------------------------------------*/
+
+/* Buffered output files for PrivGrind.  Records are formatted straight
+ * into a large buffer, which is only handed to VG_(write) when full, so
+ * that writing millions of records doesn't take millions of syscalls. */
+
+#include "pg_include.h"
+#include "pub_tool_vki.h"
+#include "pub_tool_libcfile.h"
+
+#define PG_WRITER_BUF_SZB  (1024 * 1024)
+
+struct _PG_Writer {
+   Int    fd;
+   UInt   used;
+   Char*  buf;
+};
+
+PG_Writer* PG_(writer_open) ( Char* filename )
+{
+   PG_Writer* w;
+   SysRes     sres = VG_(open)(filename, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
+                                         VKI_S_IRUSR|VKI_S_IWUSR);
+   if (sr_isError(sres)) {
+      return NULL;
+   }
+   w = VG_(malloc)( "pg.writer", sizeof(PG_Writer) );
+   w->fd   = sr_Res(sres);
+   w->used = 0;
+   w->buf  = VG_(malloc)( "pg.writer.buf", PG_WRITER_BUF_SZB );
+   return w;
+}
+
+static void writer_flush ( PG_Writer* w )
+{
+   if (w->used > 0) {
+      VG_(write)( w->fd, w->buf, w->used );
+      w->used = 0;
+   }
+}
+
+void PG_(writer_write) ( PG_Writer* w, const void* p, SizeT n )
+{
+   if (w->used + n > PG_WRITER_BUF_SZB) {
+      writer_flush( w );
+      if (n > PG_WRITER_BUF_SZB) {
+         VG_(write)( w->fd, p, n );
+         return;
+      }
+   }
+   VG_(memcpy)( w->buf + w->used, p, n );
+   w->used += n;
+}
+
+static void add_to_writer ( HChar c, void* opaque )
+{
+   PG_Writer* w = (PG_Writer*)opaque;
+   if (w->used == PG_WRITER_BUF_SZB) {
+      writer_flush( w );
+   }
+   w->buf[w->used++] = c;
+}
+
+void PG_(writer_printf) ( PG_Writer* w, const HChar* format, ... )
+{
+   va_list vargs;
+   va_start(vargs, format);
+   VG_(vcbprintf)( add_to_writer, w, format, vargs );
+   va_end(vargs);
+}
+
+/* Write v as an unsigned LEB128 varint; see pg_binary.h. */
+void PG_(writer_uvarint) ( PG_Writer* w, ULong v )
+{
+   UChar b[10];
+   Int   n = 0;
+   do {
+      b[n] = v & 0x7f;
+      v >>= 7;
+      if (v) b[n] |= 0x80;
+      n++;
+   } while (v);
+   PG_(writer_write)( w, b, n );
+}
+
+/* Write v zigzag encoded, so small negative deltas stay small too. */
+void PG_(writer_svarint) ( PG_Writer* w, Long v )
+{
+   PG_(writer_uvarint)( w, ((ULong)v << 1) ^ (ULong)(v >> 63) );
+}
+
+/* Append the whole contents of file 'filename' to w. */
+void PG_(writer_append_file) ( PG_Writer* w, Char* filename )
+{
+   Int    n;
+   SysRes sres = VG_(open)(filename, VKI_O_RDONLY, 0);
+   if (sr_isError(sres)) {
+      return;
+   }
+   writer_flush( w );
+   while ((n = VG_(read)( sr_Res(sres), w->buf, PG_WRITER_BUF_SZB )) > 0) {
+      VG_(write)( w->fd, w->buf, n );
+   }
+   VG_(close)( sr_Res(sres) );
+}
+
+static void writer_free ( PG_Writer* w )
+{
+   VG_(close)( w->fd );
+   VG_(free)( w->buf );
+   VG_(free)( w );
+}
+
+void PG_(writer_close) ( PG_Writer* w )
+{
+   writer_flush( w );
+   writer_free( w );
+}
+
+/* Close w without writing out what is still buffered; used by a forked
+   child, whose inherited buffer holds its parent's output. */
+void PG_(writer_abandon) ( PG_Writer* w )
+{
+   writer_free( w );
+}
@@ -0,0 +1,128 @@
+/*--------------------------------------------------------------------*/
+/*--- Privgrind: The Priv-seperation Valgrind tool.      pg_pool.c ---*/
+/*--------------------------------------------------------------------*/
+
+/* Fixed-size node pools for PrivGrind.  Access records and data objects
+ * are allocated by the million on long runs, so rather than going to
+ * VG_(malloc) for each of them they are carved out of large blocks.  Freed
+ * nodes go onto a free list, and everything is released in one go by
+ * PG_(destroy_pools) at exit.  Call history is not pooled: it is kept in
+ * one growable PG_CallEdge array per function (see PG_Func.calls). */
+
+#include "pg_include.h"
+
+/* Size of each block requested from the tool heap. */
+#define PG_POOL_BLOCK_SZB  (64 * 1024)
+
+struct _PG_Pool {
+   HChar* name;
+   SizeT  elemSzB;         /* rounded up to a multiple of the word size */
+   void*  blocks;          /* blocks, linked through their first word */
+   UChar* next_free;       /* next never-used element in current block */
+   UChar* block_end;
+   void*  free_list;       /* freed elements, linked through first word */
+   ULong  n_blocks;
+   ULong  n_live;
+   ULong  max_live;
+};
+
+PG_Pool* PG_(access_pool);
+PG_Pool* PG_(dataobj_pool);
+
+static PG_Pool* pool_create ( HChar* name, SizeT elemSzB )
+{
+   PG_Pool* pool = VG_(malloc)( "pg.pool", sizeof(PG_Pool) );
+   VG_(memset)( pool, 0, sizeof(PG_Pool) );
+   pool->name    = name;
+   pool->elemSzB = VG_ROUNDUP(elemSzB, sizeof(void*));
+   tl_assert(pool->elemSzB <= PG_POOL_BLOCK_SZB - sizeof(void*));
+   return pool;
+}
+
+void* PG_(pool_alloc) ( PG_Pool* pool )
+{
+   void* elem;
+   if (pool->free_list != NULL) {
+      elem = pool->free_list;
+      pool->free_list = *(void**)elem;
+   } else {
+      if (pool->next_free == NULL
+          || pool->next_free + pool->elemSzB > pool->block_end) {
+         /* Start a new block; its first word links it to the others */
+         void** block = VG_(malloc)( pool->name, PG_POOL_BLOCK_SZB );
+         *block = pool->blocks;
+         pool->blocks    = block;
+         pool->next_free = (UChar*)block + sizeof(void*);
+         pool->block_end = (UChar*)block + PG_POOL_BLOCK_SZB;
+         pool->n_blocks++;
+      }
+      elem = pool->next_free;
+      pool->next_free += pool->elemSzB;
+   }
+   pool->n_live++;
+   if (pool->n_live > pool->max_live)
+      pool->max_live = pool->n_live;
+   return elem;
+}
+
+void PG_(pool_free) ( PG_Pool* pool, void* elem )
+{
+   tl_assert(pool->n_live > 0);
+   *(void**)elem = pool->free_list;
+   pool->free_list = elem;
+   pool->n_live--;
+}
+
+static void pool_destroy ( PG_Pool* pool )
+{
+   void* block = pool->blocks;
+   while (block != NULL) {
+      void* next = *(void**)block;
+      VG_(free)( block );
+      block = next;
+   }
+   VG_(free)( pool );
+}
+
+static void pool_print_stats ( PG_Pool* pool )
+{
+   VG_(message)(Vg_DebugMsg,
+      " privgrind: %-22s %9llu live (%llu max) x %lu bytes, "
+      "%llu blocks (%llu bytes)\n",
+      pool->name, pool->n_live, pool->max_live, pool->elemSzB,
+      pool->n_blocks, pool->n_blocks * PG_POOL_BLOCK_SZB );
+}
+
+void PG_(init_pools) ( void )
+{
+   PG_(access_pool)  = pool_create( "pg.pool.access",
+                                    sizeof(PG_Access) );
+   PG_(dataobj_pool) = pool_create( "pg.pool.dataobj",
+                                    sizeof(PG_DataObj) );
+}
+
+void PG_(print_pool_stats) ( void )
+{
+   pool_print_stats( PG_(access_pool) );
+   pool_print_stats( PG_(dataobj_pool) );
+}
+
+void PG_(destroy_pools) ( void )
+{
+   pool_destroy( PG_(access_pool) );
+   pool_destroy( PG_(dataobj_pool) );
+}
+
+/* Destroy a hash table whose nodes came from a pool.  VG_(HT_destruct)
+   would hand the nodes to VG_(free), so unhook them first; they are
+   released along with the rest of their pool. */
+void PG_(destroy_pooled_ht) ( VgHashTable ht )
+{
+   UInt         i, n;
+   VgHashNode** nodes = VG_(HT_to_array)( ht, &n );
+   for (i = 0; i < n; i++)
+      VG_(HT_remove)( ht, nodes[i]->key );
+   if (nodes != NULL)
+      VG_(free)( nodes );
+   VG_(HT_destruct)( ht );
+}
@@ -0,0 +1,359 @@
+/*--------------------------------------------------------------------*/
+/*--- Privgrind: The Priv-seperation Valgrind tool.    pg_shadow.c ---*/
+/*--------------------------------------------------------------------*/
+
+/* Shadow map from addresses to the live data objects holding them, for
+ * PrivGrind.  This is a two-level table in the style of memcheck's
+ * primary_map/SecMap: each 8-byte granule of memory has a 32-bit object
+ * id, so finding the object behind an access is two loads rather than a
+ * walk of the interval tree.
+ *
+ * A granule holds 0 if no live object covers any of it, the id of the one
+ * object covering it, or SHARED_ID while several objects share it (small
+ * globals can be packed closer than 8 bytes).  SHARED_ID granules are left
+ * to the interval tree in pg_main.c, which stays the authoritative index.
+ * The ids of the objects sharing a granule are kept on the side, in
+ * shared_map, so that the granule gets back the id of the last one left
+ * once the others have gone.
+ *
+ * Addresses below MAX_PRIMARY_ADDRESS are mapped by primary_map; higher
+ * ones by an auxiliary WordFM fronted by a small direct-mapped cache.
+ * Chunks that no live object touches all point at sm_empty, and a SecMap
+ * goes back to the tool heap once its last granule is cleared, so only
+ * the parts of the address space holding tracked objects cost memory. */
+
+#include "pg_include.h"
+#include "pub_tool_wordfm.h"
+
+#define SM_BITS           PG_SHADOW_CHUNK_BITS
+#define SM_SIZE           (1UL << SM_BITS)
+#define SM_MASK           (SM_SIZE - 1)
+#define GRANULE_BITS      3
+#define SM_GRANULES       (SM_SIZE >> GRANULE_BITS)
+
+#if VG_WORDSIZE == 8
+#  define N_PRIMARY_BITS  20     /* 64GB */
+#else
+#  define N_PRIMARY_BITS  16     /* all of it */
+#endif
+#define N_PRIMARY_MAP        (1UL << N_PRIMARY_BITS)
+#define MAX_PRIMARY_ADDRESS  ((Addr)((N_PRIMARY_MAP << SM_BITS) - 1))
+
+#define AUX_CACHE_SIZE    16
+
+#define SHARED_ID         0xFFFFFFFFU
+
+typedef
+   struct {
+      UInt  ids[SM_GRANULES];
+      UInt  n_used;             /* number of non-zero ids */
+   }
+   SecMap;
+
+static SecMap   sm_empty;       /* never written */
+static SecMap*  primary_map[N_PRIMARY_MAP];
+
+static WordFM*  aux_map;        /* chunk base -> SecMap* */
+
+/* The objects sharing a SHARED_ID granule.  Objects don't overlap, so at
+   most one per byte. */
+typedef
+   struct {
+      UInt  n;
+      UInt  ids[1 << GRANULE_BITS];
+   }
+   SharedGranule;
+
+static WordFM*  shared_map;     /* granule address -> SharedGranule* */
+static struct {
+   Addr     base;
+   SecMap*  sm;
+} aux_cache[AUX_CACHE_SIZE];
+
+/* Live objects by id; free ids are threaded through free_ids. */
+static PG_DataObj** obj_table    = NULL;
+static UInt         obj_table_sz = 0;
+static UInt         n_ids_used   = 1;     /* id 0 means "none" */
+static XArray*      free_ids;
+
+/* Number of SecMaps, other than sm_empty, whose chunk hashes to each slot.
+   Instrumented code reads this to skip accesses that can't hit a live
+   object; see mkTrackedGuard in pg_main.c. */
+UInt PG_(shadow_chunk_live)[PG_SHADOW_CHUNK_SLOTS];
+
+static inline UWord chunk_slot ( Addr base )
+{
+   return (base >> PG_SHADOW_CHUNK_BITS) & (PG_SHADOW_CHUNK_SLOTS - 1);
+}
+
+static ULong n_secmaps      = 0;
+static ULong max_secmaps    = 0;
+static ULong n_aux_lookups  = 0;
+
+void PG_(shadow_init) ( void )
+{
+   UWord i;
+   for (i = 0; i < N_PRIMARY_MAP; i++)
+      primary_map[i] = &sm_empty;
+   aux_map  = VG_(newFM)( VG_(malloc), "pg.shadow.aux_map", VG_(free),
+                          NULL/*unboxed UWord cmp*/ );
+   shared_map = VG_(newFM)( VG_(malloc), "pg.shadow.shared_map", VG_(free),
+                            NULL/*unboxed UWord cmp*/ );
+   free_ids = VG_(newXA)( VG_(malloc), "pg.shadow.free_ids", VG_(free),
+                          sizeof(UInt) );
+}
+
+static inline UWord aux_cache_ix ( Addr base )
+{
+   return (base >> SM_BITS) & (AUX_CACHE_SIZE - 1);
+}
+
+static SecMap* aux_secmap ( Addr base )
+{
+   UWord ix = aux_cache_ix( base );
+   UWord keyW, valW;
+   SecMap* sm;
+
+   if (aux_cache[ix].sm != NULL && aux_cache[ix].base == base)
+      return aux_cache[ix].sm;
+
+   n_aux_lookups++;
+   sm = VG_(lookupFM)( aux_map, &keyW, &valW, base ) ? (SecMap*)valW
+                                                      : &sm_empty;
+   aux_cache[ix].base = base;
+   aux_cache[ix].sm   = sm;
+   return sm;
+}
+
+static void set_secmap ( Addr base, SecMap* sm )
+{
+   if (base <= MAX_PRIMARY_ADDRESS) {
+      primary_map[base >> SM_BITS] = sm;
+      return;
+   }
+   if (sm == &sm_empty)
+      VG_(delFromFM)( aux_map, NULL, NULL, base );
+   else
+      VG_(addToFM)( aux_map, base, (UWord)sm );
+   aux_cache[aux_cache_ix( base )].base = base;
+   aux_cache[aux_cache_ix( base )].sm   = sm;
+}
+
+static inline SecMap* get_secmap ( Addr a )
+{
+   if (a <= MAX_PRIMARY_ADDRESS)
+      return primary_map[a >> SM_BITS];
+   return aux_secmap( a & ~SM_MASK );
+}
+
+static SecMap* get_secmap_for_writing ( Addr a )
+{
+   SecMap* sm = get_secmap( a );
+   if (sm == &sm_empty) {
+      sm = VG_(calloc)( "pg.shadow.secmap", 1, sizeof(SecMap) );
+      set_secmap( a & ~SM_MASK, sm );
+      PG_(shadow_chunk_live)[chunk_slot( a )]++;
+      if (++n_secmaps > max_secmaps)
+         max_secmaps = n_secmaps;
+   }
+   return sm;
+}
+
+/* Add object 'id' to those sharing the granule at ga, which holds
+   *slot. */
+static void share_granule ( Addr ga, UInt* slot, UInt id )
+{
+   UWord          keyW, valW;
+   SharedGranule* sg;
+
+   if (*slot != SHARED_ID) {
+      sg = VG_(malloc)( "pg.shadow.shared", sizeof(SharedGranule) );
+      sg->n      = 1;
+      sg->ids[0] = *slot;
+      VG_(addToFM)( shared_map, ga, (UWord)sg );
+      *slot = SHARED_ID;
+   } else {
+      Bool found = VG_(lookupFM)( shared_map, &keyW, &valW, ga );
+      tl_assert(found);
+      sg = (SharedGranule*)valW;
+   }
+   tl_assert(sg->n < (1 << GRANULE_BITS));
+   sg->ids[sg->n++] = id;
+}
+
+/* Remove object 'id' from those sharing the granule at ga, which holds
+   *slot == SHARED_ID.  Once one is left, the granule is its alone. */
+static void unshare_granule ( Addr ga, UInt* slot, UInt id )
+{
+   UWord          keyW, valW;
+   SharedGranule* sg;
+   UInt           i;
+   Bool           found = VG_(lookupFM)( shared_map, &keyW, &valW, ga );
+
+   tl_assert(found);
+   sg = (SharedGranule*)valW;
+   for (i = 0; i < sg->n && sg->ids[i] != id; i++)
+      ;
+   tl_assert(i < sg->n);
+   sg->ids[i] = sg->ids[--sg->n];
+   if (sg->n == 1) {
+      *slot = sg->ids[0];
+      VG_(delFromFM)( shared_map, NULL, NULL, ga );
+      VG_(free)( sg );
+   }
+}
+
+/* Mark the granules of [a, a+len) as held by object 'id', a SecMap's
+   worth at a time. */
+static void mark_range ( Addr a, SizeT len, UInt id )
+{
+   Addr first = a >> GRANULE_BITS;
+   Addr last  = (a + len - 1) >> GRANULE_BITS;
+
+   while (first <= last) {
+      Addr    ga    = first << GRANULE_BITS;
+      SecMap* sm    = get_secmap_for_writing( ga );
+      UWord   lo    = (ga & SM_MASK) >> GRANULE_BITS;
+      UWord   hi    = (last - first >= SM_GRANULES - lo)
+                      ? SM_GRANULES - 1 : lo + (last - first);
+      UWord   i;
+      for (i = lo; i <= hi; i++) {
+         if (sm->ids[i] == 0) {
+            sm->ids[i] = id;
+            sm->n_used++;
+         } else if (sm->ids[i] != id) {
+            share_granule( (ga & ~SM_MASK) + (i << GRANULE_BITS),
+                           &sm->ids[i], id );
+         }
+      }
+      first += hi - lo + 1;
+   }
+}
+
+static void clear_range ( Addr a, SizeT len, UInt id )
+{
+   Addr first = a >> GRANULE_BITS;
+   Addr last  = (a + len - 1) >> GRANULE_BITS;
+
+   while (first <= last) {
+      Addr    ga    = first << GRANULE_BITS;
+      SecMap* sm    = get_secmap( ga );
+      UWord   lo    = (ga & SM_MASK) >> GRANULE_BITS;
+      UWord   hi    = (last - first >= SM_GRANULES - lo)
+                      ? SM_GRANULES - 1 : lo + (last - first);
+      UWord   i;
+      if (sm != &sm_empty) {
+         for (i = lo; i <= hi; i++) {
+            if (sm->ids[i] == id) {
+               sm->ids[i] = 0;
+               sm->n_used--;
+            } else if (sm->ids[i] == SHARED_ID) {
+               unshare_granule( (ga & ~SM_MASK) + (i << GRANULE_BITS),
+                                &sm->ids[i], id );
+            }
+         }
+         if (sm->n_used == 0) {
+            set_secmap( ga & ~SM_MASK, &sm_empty );
+            PG_(shadow_chunk_live)[chunk_slot( ga )]--;
+            VG_(free)( sm );
+            n_secmaps--;
+         }
+      }
+      first += hi - lo + 1;
+   }
+}
+
+static UInt alloc_id ( PG_DataObj* obj )
+{
+   UInt id;
+   Word n = VG_(sizeXA)( free_ids );
+   if (n > 0) {
+      id = *(UInt*)VG_(indexXA)( free_ids, n - 1 );
+      VG_(dropTailXA)( free_ids, 1 );
+   } else {
+      id = n_ids_used++;
+      tl_assert(id != SHARED_ID);
+      if (id >= obj_table_sz) {
+         obj_table_sz = obj_table_sz == 0 ? 1024 : 2 * obj_table_sz;
+         obj_table = VG_(realloc)( "pg.shadow.obj_table", obj_table,
+                                   obj_table_sz * sizeof(PG_DataObj*) );
+      }
+   }
+   obj_table[id] = obj;
+   return id;
+}
+
+/* Zero-sized objects still occupy one byte, as in the interval tree. */
+static inline SizeT extent ( PG_DataObj* obj )
+{
+   return obj->size == 0 ? 1 : obj->size;
+}
+
+void PG_(shadow_insert) ( PG_DataObj* obj )
+{
+   obj->id = alloc_id( obj );
+   mark_range( obj->addr, extent( obj ), obj->id );
+}
+
+void PG_(shadow_remove) ( PG_DataObj* obj )
+{
+   clear_range( obj->addr, extent( obj ), obj->id );
+   obj_table[obj->id] = NULL;
+   VG_(addToXA)( free_ids, &obj->id );
+   obj->id = 0;
+}
+
+/* The live object holding a, or NULL if there is none.  Sets *shared, and
+   returns NULL, if a's granule is shared by several objects and the
+   caller must look it up itself. */
+PG_DataObj* PG_(shadow_lookup) ( Addr a, Bool* shared )
+{
+   SecMap*     sm = get_secmap( a );
+   UInt        id = sm->ids[(a & SM_MASK) >> GRANULE_BITS];
+   PG_DataObj* obj;
+
+   *shared = False;
+   if (id == 0)
+      return NULL;
+   if (id == SHARED_ID) {
+      *shared = True;
+      return NULL;
+   }
+   obj = obj_table[id];
+   /* Only part of the granule may belong to the object */
+   return a - obj->addr < extent( obj ) ? obj : NULL;
+}
+
+void PG_(shadow_print_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg,
+                " privgrind: shadow: %llu secmaps (%llu max, %lu bytes each),"
+                " %llu aux map lookups\n",
+                n_secmaps, max_secmaps, (UWord)sizeof(SecMap), n_aux_lookups);
+   VG_(message)(Vg_DebugMsg,
+                " privgrind: shadow: %u object ids used\n", n_ids_used - 1);
+}
+
+void PG_(shadow_destroy) ( void )
+{
+   UWord i, keyW, valW;
+   for (i = 0; i < N_PRIMARY_MAP; i++) {
+      if (primary_map[i] != &sm_empty) {
+         VG_(free)( primary_map[i] );
+         primary_map[i] = &sm_empty;
+      }
+   }
+   VG_(initIterFM)( aux_map );
+   while (VG_(nextIterFM)( aux_map, &keyW, &valW ))
+      VG_(free)( (SecMap*)valW );
+   VG_(doneIterFM)( aux_map );
+   VG_(deleteFM)( aux_map, NULL, NULL );
+   VG_(initIterFM)( shared_map );
+   while (VG_(nextIterFM)( shared_map, &keyW, &valW ))
+      VG_(free)( (SharedGranule*)valW );
+   VG_(doneIterFM)( shared_map );
+   VG_(deleteFM)( shared_map, NULL, NULL );
+   VG_(deleteXA)( free_ids );
+   if (obj_table != NULL)
+      VG_(free)( obj_table );
+}
@@ -2,10 +2,13 @@
 
 #include <string.h>
 #include "pg_include.h"
+#include "pub_tool_debuginfo.h"
+#include "pub_tool_wordfm.h"
 
 static int curr_func_id = UNKNOWN_FUNC_ID;
 static PG_Func ** func_array = NULL;
 static Int func_array_len = 0;
+static WordFM * func_names = NULL;    /* fnname -> PG_Func* */
 
 static void addFunc(PG_Func * func) {
   if (func_array == NULL || func->id >= func_array_len) {
@@ -29,55 +32,322 @@ PG_Func * getFunc(UWord func_id) {
 void initUnknownFunc(VgHashTable func_ht) 
 {
    PG_Func *func = VG_(malloc) ("func_ht.node", sizeof (PG_Func));
-   func->call_history = VG_(malloc) ("func_ht.node.call_history", sizeof (PG_CallHistory));
    func->fnname = "<Unknown>";
    func->filename = "";
    func->dirname = "";
-   func->key = hash_sdbm(func->fnname);
    func->id = curr_func_id++;
+   func->key = func->id;
    tl_assert(func->id == UNKNOWN_FUNC_ID);
-   func->call_history->calls_ht = VG_(HT_construct) ( "calls_hash" );
-   func->call_history->next = NULL;
+   func->calls = VG_(newXA) ( VG_(malloc), "func_ht.node.calls", VG_(free),
+                              sizeof(PG_CallEdge) );
    func->iteration = 0;
+   func->epoch_iter = 0;
+   func->instrumented = PG_(instrument_func)( func->fnname, 0 );
+   func->iter_accesses = NULL;
+   func->iter_classes = NULL;
+   func->iter_map = NULL;
    VG_(HT_add_node) ( func_ht, func );
    addFunc(func);
 }
 
-UWord getFuncId( Addr addr, VgHashTable func_ht)
+/* Functions by name.  Names are compared in full, so functions whose
+   names hash alike are still told apart. */
+static Word cmp_fnnames ( UWord key1, UWord key2 )
+{
+  return VG_(strcmp)( (Char*)key1, (Char*)key2 );
+}
+
+static UWord funcIdForName( Char* fnname, Addr addr, VgHashTable func_ht )
+{
+  UWord keyW, valW;
+  PG_Func * func;
+  UInt linenum;
+  Bool dirname_available;
+
+  if (func_names == NULL) {
+    func_names = VG_(newFM)( VG_(malloc), "func_names", VG_(free),
+                             cmp_fnnames );
+  }
+  if (VG_(lookupFM)( func_names, &keyW, &valW, (UWord)fnname )) {
+    return ((PG_Func *)valW)->id;
+  }
+
+  func = VG_(malloc) ("func_ht.node", sizeof (PG_Func));
+  func->id = curr_func_id++;
+  func->key = func->id;
+  func->fnname = VG_(malloc) ("func_ht.node.fnname", strlen(fnname) + 1);
+  func->filename = VG_(malloc)("func_ht.node.filename", FILENAME_LENGTH);
+  func->dirname  = VG_(malloc)("func_ht.node.dirname", DIRNAME_LENGTH);
+  memcpy(func->fnname, fnname, strlen(fnname) + 1);
+  VG_(get_filename_linenum) ( addr, func->filename, FILENAME_LENGTH,
+                              func->dirname,  DIRNAME_LENGTH,
+                              &dirname_available, &linenum );
+  func->calls = VG_(newXA) ( VG_(malloc), "func_ht.node.calls", 
+                             VG_(free), sizeof(PG_CallEdge) );
+  func->iteration = 0;
+  func->epoch_iter = 0;
+  func->instrumented = PG_(instrument_func)( func->fnname, addr );
+  func->iter_accesses = NULL;
+  func->iter_classes = NULL;
+  func->iter_map = NULL;
+  VG_(HT_add_node) ( func_ht, func );
+  VG_(addToFM)( func_names, (UWord)func->fnname, (UWord)func );
+  addFunc(func);
+  return func->id;
+}
+
+/* Function address ranges.  The text symbols of an object are read from
+   its debuginfo the first time code in it is translated, and kept sorted
+   by address, so that translating further code in the object finds the
+   function by binary search rather than by VG_(get_fnname) and a name
+   lookup.  A symbol's function id is only worked out the first time the
+   symbol is hit.  Objects are kept sorted by address too, and dropped
+   when their text is unmapped. */
+
+#define NO_FUNC_ID ((UWord)-1)
+
+typedef
+   struct {
+      Addr  start;
+      Addr  end;        /* inclusive */
+      UWord func_id;    /* or NO_FUNC_ID if not yet worked out */
+   }
+   FnRange;
+
+typedef
+   struct {
+      Addr    start;
+      Addr    end;      /* inclusive */
+      XArray* ranges;   /* of FnRange, sorted by start, not overlapping */
+   }
+   ObjRanges;
+
+/* ObjRanges, ordered by their (non-overlapping) text ranges */
+static WordFM* obj_ranges = NULL;
+
+/* The function ids of addresses outside any text symbol, which are
+   looked up by name: code in objects without symbols, or without
+   debuginfo at all, would otherwise search the debuginfo every time it
+   is translated.  Dropped with the ranges of unmapped memory. */
+static WordFM* name_lookups = NULL;    /* Addr -> function id */
+
+static Word cmp_intervals_ObjRanges ( UWord key1, UWord key2 )
+{
+  ObjRanges * obj1 = (ObjRanges *) key1;
+  ObjRanges * obj2 = (ObjRanges *) key2;
+  if (obj1->end < obj2->start) return -1L;
+  if (obj2->end < obj1->start) return 1L;
+  return 0;
+}
+
+static Int cmp_FnRange ( void* v1, void* v2 )
+{
+  FnRange* r1 = (FnRange*)v1;
+  FnRange* r2 = (FnRange*)v2;
+  if (r1->start < r2->start) return -1;
+  if (r1->start > r2->start) return 1;
+  /* Of several symbols at one address, put the largest first */
+  if (r1->end > r2->end) return -1;
+  if (r1->end < r2->end) return 1;
+  return 0;
+}
+
+/* The ObjRanges overlapping [start, end], if any. */
+static ObjRanges* findObjRanges( Addr start, Addr end )
+{
+  ObjRanges key;
+  UWord keyW, valW;
+  key.start = start;
+  key.end   = end;
+  if (VG_(lookupFM)( obj_ranges, &keyW, &valW, (UWord)&key )) {
+    return (ObjRanges *) keyW;
+  }
+  return NULL;
+}
+
+static FnRange* findFnRange( ObjRanges* obj, Addr addr )
+{
+  Word lo = 0, hi = VG_(sizeXA)( obj->ranges ) - 1, mid;
+  while (lo <= hi) {
+    FnRange* r;
+    mid = (lo + hi) / 2;
+    r = VG_(indexXA)( obj->ranges, mid );
+    if (addr < r->start) {
+      hi = mid - 1;
+    } else if (addr > r->end) {
+      lo = mid + 1;
+    } else {
+      return r;
+    }
+  }
+  return NULL;
+}
+
+/* Read the text symbols of the object holding addr into obj_ranges.
+   Returns the new ObjRanges, or NULL if addr is not in a known object's
+   text. */
+static ObjRanges* loadObjRanges( Addr addr )
+{
+  const DebugInfo* di = VG_(find_DebugInfo)( addr );
+  ObjRanges* obj;
+  FnRange    r;
+  Addr       text;
+  SizeT      text_size;
+  Int        i, n;
+  Word       j, k;
+
+  if (di == NULL) return NULL;
+  text      = VG_(DebugInfo_get_text_avma)( di );
+  text_size = VG_(DebugInfo_get_text_size)( di );
+  if (text_size == 0 || addr < text || addr - text >= text_size) {
+    return NULL;
+  }
+
+  obj = VG_(malloc)( "obj_ranges.node", sizeof(ObjRanges) );
+  obj->start  = text;
+  obj->end    = text + text_size - 1;
+  obj->ranges = VG_(newXA)( VG_(malloc), "obj_ranges.node.ranges",
+                            VG_(free), sizeof(FnRange) );
+
+  n = VG_(DebugInfo_syms_howmany)( di );
+  for (i = 0; i < n; i++) {
+    Addr   avma, tocptr;
+    UInt   size;
+    HChar* name;
+    Bool   isText, isIFunc;
+    VG_(DebugInfo_syms_getidx)( di, i, &avma, &tocptr, &size, &name,
+                                &isText, &isIFunc );
+    if (!isText || size == 0) continue;
+    r.start   = avma;
+    r.end     = avma + size - 1;
+    r.func_id = NO_FUNC_ID;
+    VG_(addToXA)( obj->ranges, &r );
+  }
+
+  /* Sort, and drop symbols that start inside the one before them */
+  VG_(setCmpFnXA)( obj->ranges, cmp_FnRange );
+  VG_(sortXA)( obj->ranges );
+  n = VG_(sizeXA)( obj->ranges );
+  for (j = 0, k = 0; j < n; j++) {
+    FnRange* cur = VG_(indexXA)( obj->ranges, j );
+    if (k > 0 && cur->start <= ((FnRange*)VG_(indexXA)( obj->ranges, k-1 ))->end)
+      continue;
+    *(FnRange*)VG_(indexXA)( obj->ranges, k++ ) = *cur;
+  }
+  VG_(dropTailXA)( obj->ranges, n - k );
+
+  VG_(addToFM)( obj_ranges, (UWord)obj, 0 );
+  return obj;
+}
+
+/* Forget the function ranges of objects whose text overlaps
+   [addr, addr+len), and the name lookups made in it. */
+void discardFuncRanges( Addr addr, SizeT len )
 {
-  UWord func_id;
-  Char fnname[FN_LENGTH];
-  Bool found_fn = VG_(get_fnname)(addr, fnname, FN_LENGTH);
-  if (!found_fn) {
-    func_id = UNKNOWN_FUNC_ID;
-  } else {
-    UWord key = hash_sdbm(fnname);
-    PG_Func * func = VG_(HT_lookup) ( func_ht, key );
-    if (func == NULL) {
-      UInt linenum;
-      Bool dirname_available;
-      func = VG_(malloc) ("func_ht.node", sizeof (PG_Func));
-      func->call_history = VG_(malloc) ("func_ht.node.call_history", sizeof (PG_CallHistory));
-      func->key = key;
-      func->id = curr_func_id++;
-      func->fnname = VG_(malloc) ("func_ht.node.fnname", strlen(fnname));
-      func->filename = VG_(malloc)("func_ht.node.filename", FILENAME_LENGTH);
-      func->dirname  = VG_(malloc)("func_ht.node.dirname", DIRNAME_LENGTH);
-      memcpy(func->fnname, fnname, strlen(fnname));
-      VG_(get_filename_linenum) ( addr, func->filename, FILENAME_LENGTH,
-				  func->dirname,  DIRNAME_LENGTH,
-				  &dirname_available, &linenum );
-      func->call_history->calls_ht = VG_(HT_construct) ( "calls_hash" );
-      func->call_history->next = NULL;
-      func->iteration = 0;
-      VG_(HT_add_node) ( func_ht, func );
-      addFunc(func);
+  ObjRanges* obj;
+  UWord      keyW, valW;
+  Addr       last = addr + len - 1;
+
+  if (len == 0) return;
+  if (last < addr) last = ~(Addr)0;
+  if (obj_ranges != NULL) {
+    while ((obj = findObjRanges( addr, last )) != NULL) {
+      VG_(delFromFM)( obj_ranges, NULL, NULL, (UWord)obj );
+      VG_(deleteXA)( obj->ranges );
+      VG_(free)( obj );
     }
-    func_id = func->id;
   }
+  if (name_lookups != NULL) {
+    for (;;) {
+      VG_(initIterAtFM)( name_lookups, addr );
+      if (!VG_(nextIterFM)( name_lookups, &keyW, &valW ) || keyW > last) {
+        VG_(doneIterFM)( name_lookups );
+        break;
+      }
+      VG_(doneIterFM)( name_lookups );
+      VG_(delFromFM)( name_lookups, NULL, NULL, keyW );
+    }
+  }
+}
+
+void destroyFuncIndex( void )
+{
+  if (obj_ranges != NULL) {
+    discardFuncRanges( 0, ~(SizeT)0 );
+    VG_(deleteFM)( obj_ranges, NULL, NULL );
+    obj_ranges = NULL;
+  }
+  if (name_lookups != NULL) {
+    VG_(deleteFM)( name_lookups, NULL, NULL );
+    name_lookups = NULL;
+  }
+  if (func_names != NULL) {
+    VG_(deleteFM)( func_names, NULL, NULL );
+    func_names = NULL;
+  }
+}
+
+/* Look up a function by name.  'entry' is the start of its symbol, or 0
+   if not known.  Names are read into a buffer of FN_LENGTH chars; one
+   that fills it may have been cut short, and so match another long name,
+   so it is told apart by its entry address when that is known. */
+static UWord getFuncIdByName( Addr addr, Addr entry, VgHashTable func_ht )
+{
+  static Char fnname[FN_LENGTH + 24];
+  if (!VG_(get_fnname)(addr, fnname, FN_LENGTH)) {
+    return UNKNOWN_FUNC_ID;
+  }
+  if (entry != 0 && VG_(strlen)(fnname) >= FN_LENGTH - 1) {
+    VG_(sprintf)(fnname + FN_LENGTH - 1, "@%#lx", entry);
+  }
+  return funcIdForName(fnname, addr, func_ht);
+}
+
+/* Look up, by name, the function of code outside any text symbol. */
+static UWord getFuncIdOutsideSyms( Addr addr, VgHashTable func_ht )
+{
+  UWord keyW, valW, func_id;
+  if (name_lookups == NULL) {
+    name_lookups = VG_(newFM)( VG_(malloc), "name_lookups", VG_(free),
+                               NULL );
+  }
+  if (VG_(lookupFM)( name_lookups, &keyW, &valW, addr )) {
+    return valW;
+  }
+  func_id = getFuncIdByName( addr, 0, func_ht );
+  VG_(addToFM)( name_lookups, addr, func_id );
   return func_id;
 }
 
+UWord getFuncId( Addr addr, VgHashTable func_ht)
+{
+  ObjRanges* obj;
+  FnRange*   r;
+  UWord      keyW, valW;
+
+  if (obj_ranges == NULL) {
+    obj_ranges = VG_(newFM)( VG_(malloc), "obj_ranges", VG_(free),
+                             cmp_intervals_ObjRanges );
+  }
+
+  obj = findObjRanges( addr, addr );
+  if (obj == NULL) {
+    if (name_lookups != NULL
+        && VG_(lookupFM)( name_lookups, &keyW, &valW, addr )) {
+      return valW;
+    }
+    obj = loadObjRanges( addr );
+  }
+  r = obj ? findFnRange( obj, addr ) : NULL;
+  if (r == NULL) {
+    return getFuncIdOutsideSyms( addr, func_ht );
+  }
+  if (r->func_id == NO_FUNC_ID) {
+    r->func_id = getFuncIdByName( r->start, r->start, func_ht );
+  }
+  return r->func_id;
+}
+
 Addr irConstToAddr(IRConst * con) {
   switch (con->tag) {
   case Ico_U8:
@@ -0,0 +1,101 @@
+
+/*
+   ----------------------------------------------------------------
+
+   Notice that the following BSD-style license applies to this one
+   file (privgrind.h) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+
+   ----------------------------------------------------------------
+
+   This file is part of Privgrind, the Priv-Separation Valgrind tool.
+
+   Copyright (C) 2011, Ross McIlroy.  All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+   2. The origin of this software must not be misrepresented; you must
+      not claim that you wrote the original software.  If you use this
+      software in a product, an acknowledgment in the product
+      documentation would be appreciated but is not required.
+
+   3. Altered source versions must be plainly marked as such, and must
+      not be misrepresented as being the original software.
+
+   4. The name of the author may not be used to endorse or promote
+      products derived from this software without specific prior written
+      permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+   OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   ----------------------------------------------------------------
+
+   Notice that the above BSD-style license applies to this one file
+   (privgrind.h) only.  The entire rest of Valgrind is licensed under
+   the terms of the GNU General Public License, version 2.  See the
+   COPYING file in the source distribution for details.
+
+   ----------------------------------------------------------------
+*/
+
+#ifndef __PRIVGRIND_H
+#define __PRIVGRIND_H
+
+#include "valgrind.h"
+
+/* !! ABIWARNING !! ABIWARNING !! ABIWARNING !! ABIWARNING !!
+   This enum comprises an ABI exported by Valgrind to programs
+   which use client requests.  DO NOT CHANGE THE ORDER OF THESE
+   ENTRIES, NOR DELETE ANY -- add new ones at the end.
+ */
+
+typedef
+   enum {
+      VG_USERREQ__PG_START_TRACING = VG_USERREQ_TOOL_BASE('P','G'),
+      VG_USERREQ__PG_STOP_TRACING,
+      VG_USERREQ__PG_DUMP
+   } Vg_PrivgrindClientRequest;
+
+/* Start tracing calls and memory accesses, if not already doing so.
+   This flushes Valgrind's translation cache so that code is translated
+   again with Privgrind's instrumentation.  To start Privgrind with
+   tracing off, e.g. to skip a program's startup, use the option
+   "--trace-at-start=no". */
+#define PRIVGRIND_START_TRACING                                         \
+  VALGRIND_DO_CLIENT_REQUEST_EXPR(0, VG_USERREQ__PG_START_TRACING,      \
+                                  0, 0, 0, 0, 0)
+
+/* Stop tracing, if not already stopped.  This flushes Valgrind's
+   translation cache, and adds no instrumentation afterwards, so the
+   program runs at about the speed of the "none" tool.  Heap blocks
+   are still tracked, so that objects allocated while tracing is off are
+   known when it is started again. */
+#define PRIVGRIND_STOP_TRACING                                          \
+  VALGRIND_DO_CLIENT_REQUEST_EXPR(0, VG_USERREQ__PG_STOP_TRACING,       \
+                                  0, 0, 0, 0, 0)
+
+/* Write what has been recorded since the start, or the previous dump,
+   to <json-file>.<n> and forget it, as on a call to the function given
+   by --boundary-function. */
+#define PRIVGRIND_DUMP                                                  \
+  VALGRIND_DO_CLIENT_REQUEST_EXPR(0, VG_USERREQ__PG_DUMP,               \
+                                  0, 0, 0, 0, 0)
+
+#endif /* __PRIVGRIND_H */
@@ -0,0 +1,39 @@
+/* A small client for convert.vgtest: a few calls, heap blocks and
+   globals, enough to exercise each kind of record in the output. */
+
+#include <stdlib.h>
+#include <string.h>
+
+static int table[16];
+
+static void fill ( char* buf, int n, char c )
+{
+   int i;
+   for (i = 0; i < n; i++)
+      buf[i] = c;
+}
+
+static int sum ( const char* buf, int n )
+{
+   int i, s = 0;
+   for (i = 0; i < n; i++)
+      s += buf[i];
+   return s;
+}
+
+int main ( void )
+{
+   int   i;
+   char* keep = malloc(64);
+
+   for (i = 0; i < 4; i++) {
+      char* buf = malloc(32 + 8 * i);
+      fill(buf, 32 + 8 * i, 'a' + i);
+      table[i] = sum(buf, 32 + 8 * i);
+      free(buf);
+   }
+   memset(keep, 0, 64);
+   table[15] = sum(keep, 64);
+   free(keep);
+   return table[15];
+}